@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+/* every allocation is aligned to this */
+#define ARENA_ALIGN 16
+
+/**
+ * Make a new chunk big enough for size bytes, or exit if there is no
+ * memory for it.
+ *
+ * @size: the smallest number of bytes the chunk must hold.
+*/
+static Chunk* new_chunk(size_t size) {
+    size_t dataSize = size > ARENA_CHUNK ? size : ARENA_CHUNK;
+    Chunk* chunk = (Chunk*) malloc(sizeof(Chunk) + dataSize);
+
+    // callers write through the chunk at once, so give up cleanly here
+    if (chunk == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    chunk->next = NULL;
+    chunk->size = dataSize;
+    chunk->used = 0;
+    return chunk;
+}
+
+/**
+ * Hand out size bytes from the arena. Chunks kept by an earlier reset
+ * are used before a new one is allocated, so a workload that repeats
+ * stops calling malloc after its first round.
+ *
+ * @arena: the arena.
+ * @size: the number of bytes wanted.
+*/
+void* arena_alloc(Arena* arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    if (arena->current == NULL) {
+        arena->first = new_chunk(size);
+        arena->current = arena->first;
+    }
+    while (arena->current->size - arena->current->used < size) {
+        Chunk* next = arena->current->next;
+        if (next == NULL || next->size < size) {
+            // keep the chunks after it for later, they are all empty
+            Chunk* chunk = new_chunk(size);
+            chunk->next = next;
+            arena->current->next = chunk;
+        }
+        arena->current = arena->current->next;
+    }
+
+    void* memory = arena->current->data + arena->current->used;
+    arena->current->used += size;
+    return memory;
+}
+
+/**
+ * Resize an allocation. The newest allocation grows in place when its
+ * chunk has room, anything else is copied.
+ *
+ * @arena: the arena.
+ * @old: the allocation, or NULL.
+ * @oldSize: the size old was allocated with.
+ * @newSize: the size wanted.
+*/
+void* arena_grow(Arena* arena, void* old, size_t oldSize, size_t newSize) {
+    Chunk* chunk = arena->current;
+    size_t oldAligned = (oldSize + ARENA_ALIGN - 1)
+            & ~(size_t)(ARENA_ALIGN - 1);
+    size_t newAligned = (newSize + ARENA_ALIGN - 1)
+            & ~(size_t)(ARENA_ALIGN - 1);
+
+    if (old != NULL && chunk != NULL
+            && (char*)old + oldAligned == chunk->data + chunk->used
+            && chunk->used - oldAligned + newAligned <= chunk->size) {
+        chunk->used = chunk->used - oldAligned + newAligned;
+        return old;
+    }
+
+    void* memory = arena_alloc(arena, newSize);
+    if (old != NULL) {
+        memcpy(memory, old, oldSize);
+    }
+    return memory;
+}
+
+/**
+ * Copy a string into the arena, NUL included.
+ *
+ * @arena: the arena.
+ * @str: the string to be copied.
+*/
+char* arena_strdup(Arena* arena, const char* str) {
+    size_t length = strlen(str) + 1;
+    char* copy = (char*) arena_alloc(arena, length);
+
+    memcpy(copy, str, length);
+    return copy;
+}
+
+/**
+ * Release everything allocated from the arena. The chunks themselves
+ * are kept for the next round of allocations.
+ *
+ * @arena: the arena.
+*/
+void arena_reset(Arena* arena) {
+    for (Chunk* chunk = arena->first; chunk != NULL; chunk = chunk->next) {
+        chunk->used = 0;
+    }
+    arena->current = arena->first;
+}
@@ -0,0 +1,31 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/* size of a chunk unless a single allocation needs more */
+#define ARENA_CHUNK (1 << 20)
+
+/* one block of arena memory */
+typedef struct Chunk {
+    struct Chunk* next; /* the next chunk, kept across resets */
+    size_t size; /* bytes in data */
+    size_t used; /* bytes handed out from data */
+    char data[]; /* the memory itself */
+} Chunk;
+
+/* a bump allocator, everything in it is released at once by a reset */
+typedef struct {
+    Chunk* first; /* the first chunk */
+    Chunk* current; /* the chunk allocations come from */
+} Arena;
+
+void* arena_alloc(Arena* arena, size_t size);
+
+void* arena_grow(Arena* arena, void* old, size_t oldSize, size_t newSize);
+
+char* arena_strdup(Arena* arena, const char* str);
+
+void arena_reset(Arena* arena);
+
+#endif
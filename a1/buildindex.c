@@ -0,0 +1,616 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "index.h"
+#include "rank.h"
+
+/* default size of a read chunk */
+#define DEFAULT_CHUNK_MB 4
+/* chunk buffers in flight per worker thread */
+#define BUFFERS_PER_WORKER 2
+
+/* a block of whole lines read from the dictionary */
+typedef struct {
+    char* data; /* the bytes */
+    size_t length; /* bytes holding whole lines */
+    size_t capacity; /* allocated size of data */
+    uint64_t fileOffset; /* where data[0] is in the dictionary */
+    long seq; /* chunk number, chunks are merged in this order */
+} ReadChunk;
+
+/* a FIFO of chunks, never holding more than the buffers that exist */
+typedef struct {
+    ReadChunk** items; /* ring of chunks */
+    int size; /* slots in items */
+    int head; /* next chunk to take */
+    int tail; /* next free slot */
+    sem_t count; /* chunks in the queue */
+    sem_t guard; /* lock for head and tail */
+} ChunkQueue;
+
+/* the words of one length found in one chunk */
+typedef struct {
+    uint64_t count; /* number of words */
+    uint64_t capacity; /* allocated words */
+    char* image; /* lowercased letters, length per word */
+    IndexEntry* entries; /* one entry per word */
+    uint64_t destination; /* position of the first word in the index */
+} ChunkBucket;
+
+/* everything a worker produced for one chunk */
+typedef struct ChunkResult {
+    long seq; /* the chunk number */
+    ChunkBucket buckets[MAX_WORD + 1]; /* bucketed words */
+    struct ChunkResult* next; /* the next result, in no order */
+} ChunkResult;
+
+/* counters of one thread, summed for the report */
+typedef struct {
+    double busy; /* seconds doing work */
+    double waiting; /* seconds blocked on a queue */
+    uint64_t bytes; /* dictionary bytes handled */
+    uint64_t words; /* words indexed */
+} Counters;
+
+struct Pipeline;
+
+/* what a stage thread is started with */
+typedef struct {
+    struct Pipeline* pipeline; /* the build */
+    Counters* counters; /* the thread's own counters */
+} StageArg;
+
+/* state shared by every stage of the build */
+typedef struct Pipeline {
+    int fd; /* the dictionary */
+    size_t chunkSize; /* bytes per read */
+    int threads; /* worker threads */
+    ChunkQueue empty; /* buffers free to be read into */
+    ChunkQueue full; /* buffers waiting to be folded */
+    ChunkResult* results; /* results of every chunk */
+    long resultCount; /* number of results */
+    sem_t resultGuard; /* lock for results */
+    uint64_t fileSize; /* dictionary size, for progress */
+    uint64_t wordsSoFar; /* words indexed so far, for progress */
+
+    char* output; /* the mapped index file */
+    IndexHeader* header; /* the header at the start of output */
+    ChunkResult** ordered; /* results by chunk number */
+    long nextTask; /* next (chunk, bucket) pair to merge */
+
+    Counters reader; /* the reader stage */
+    Counters* workers; /* the folding stage, one per thread */
+    Counters* mergers; /* the merge stage, one per thread */
+} Pipeline;
+
+/**
+ * Show errors and exit.
+*/
+void arg_error() {
+    fprintf(stderr, "Usage: buildindex [-threads N] [-chunk MB] "
+            "dictionary indexfile\n");
+    exit(1);
+}
+
+/**
+ * Return the current monotonic time in seconds.
+*/
+double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Initialise a queue with room for size chunks.
+ *
+ * @queue: the queue.
+ * @size: the number of chunk buffers in the pipeline.
+*/
+void queue_init(ChunkQueue* queue, int size) {
+    queue->items = (ReadChunk**) calloc(size, sizeof(ReadChunk*));
+    queue->size = size;
+    queue->head = 0;
+    queue->tail = 0;
+    sem_init(&queue->count, 0, 0);
+    sem_init(&queue->guard, 0, 1);
+}
+
+/**
+ * Append a chunk to a queue, NULL tells a worker to stop.
+ *
+ * @queue: the queue.
+ * @chunk: the chunk.
+*/
+void queue_push(ChunkQueue* queue, ReadChunk* chunk) {
+    sem_wait(&queue->guard);
+    queue->items[queue->tail] = chunk;
+    queue->tail = (queue->tail + 1) % queue->size;
+    sem_post(&queue->guard);
+    sem_post(&queue->count);
+}
+
+/**
+ * Take the oldest chunk from a queue, waiting until there is one.
+ * The time spent waiting is added to waited.
+ *
+ * @queue: the queue.
+ * @waited: the pointer to waited, seconds this thread has been blocked.
+*/
+ReadChunk* queue_pop(ChunkQueue* queue, double* waited) {
+    double start = now();
+    sem_wait(&queue->count);
+    *waited += now() - start;
+
+    sem_wait(&queue->guard);
+    ReadChunk* chunk = queue->items[queue->head];
+    queue->head = (queue->head + 1) % queue->size;
+    sem_post(&queue->guard);
+    return chunk;
+}
+
+/**
+ * Print how far the build has come, at most once a second.
+ *
+ * @pipeline: the build.
+ * @start: when the build started.
+ * @lastReport: the pointer to lastReport, when progress was last shown.
+*/
+void report_progress(Pipeline* pipeline, double start, double* lastReport) {
+    double time = now();
+
+    if (time - *lastReport < 1.0) {
+        return;
+    }
+    *lastReport = time;
+    uint64_t words = __atomic_load_n(&pipeline->wordsSoFar, __ATOMIC_RELAXED);
+    fprintf(stderr, "buildindex: %.0f%% read, %lu MB, %lu words, "
+            "%.1f MB/s\n",
+            pipeline->fileSize ? 100.0 * pipeline->reader.bytes
+            / pipeline->fileSize : 0.0,
+            (unsigned long)(pipeline->reader.bytes >> 20),
+            (unsigned long)words,
+            pipeline->reader.bytes / 1048576.0 / (time - start));
+}
+
+/**
+ * Stage one: read the dictionary into chunk buffers that end on a line
+ * boundary. The partial last line of a read moves to the next chunk.
+ * Time in read() is I/O, time waiting for a free buffer means the
+ * workers downstream are the bottleneck.
+ *
+ * @pipeline: the build.
+*/
+void read_stage(Pipeline* pipeline) {
+    char* carry = NULL; // the partial line left over from the last read
+    size_t carryLength = 0;
+    size_t carryCapacity = 0;
+    uint64_t fileOffset = 0;
+    long seq = 0;
+    int eof = 0;
+    double start = now();
+    double lastReport = start;
+
+    while (!eof) {
+        ReadChunk* chunk = queue_pop(&pipeline->empty,
+                &pipeline->reader.waiting);
+        double begin = now();
+        size_t filled = carryLength;
+
+        if (chunk->capacity < carryLength + pipeline->chunkSize) {
+            chunk->capacity = carryLength + pipeline->chunkSize;
+            chunk->data = (char*) realloc(chunk->data, chunk->capacity);
+        }
+        memcpy(chunk->data, carry, carryLength);
+        while (filled < chunk->capacity) {
+            ssize_t got = read(pipeline->fd, chunk->data + filled,
+                    chunk->capacity - filled);
+            if (got <= 0) {
+                eof = 1;
+                break;
+            }
+            filled += got;
+        }
+        pipeline->reader.bytes += filled - carryLength;
+
+        // keep whole lines, unless this is the end of the file
+        size_t length = filled;
+        if (!eof) {
+            while (length > 0 && chunk->data[length - 1] != '\n') {
+                length--;
+            }
+        }
+        carryLength = filled - length;
+        if (carryLength > carryCapacity) {
+            carryCapacity = carryLength;
+            carry = (char*) realloc(carry, carryCapacity);
+        }
+        memcpy(carry, chunk->data + length, carryLength);
+
+        chunk->length = length;
+        chunk->fileOffset = fileOffset;
+        chunk->seq = seq++;
+        fileOffset += length;
+        pipeline->reader.busy += now() - begin;
+        queue_push(&pipeline->full, chunk);
+        report_progress(pipeline, start, &lastReport);
+    }
+
+    for (int i = 0; i < pipeline->threads; i++) {
+        queue_push(&pipeline->full, NULL);
+    }
+    free(carry);
+}
+
+/**
+ * Add one folded word to its bucket.
+ *
+ * @bucket: the bucket for the word's length.
+ * @word: the lowercased letters.
+ * @length: the number of letters.
+ * @offset: where the word starts in the dictionary.
+ * @weight: the word's weight.
+*/
+void bucket_add(ChunkBucket* bucket, const char* word, int length,
+        uint64_t offset, int64_t weight) {
+    if (bucket->count == bucket->capacity) {
+        bucket->capacity = bucket->capacity == 0 ? 64 : bucket->capacity * 2;
+        bucket->image = (char*) realloc(bucket->image,
+                bucket->capacity * length);
+        bucket->entries = (IndexEntry*) realloc(bucket->entries,
+                bucket->capacity * sizeof(IndexEntry));
+    }
+    memcpy(bucket->image + bucket->count * length, word, length);
+    bucket->entries[bucket->count].offset = offset;
+    bucket->entries[bucket->count].weight = weight;
+    bucket->count++;
+}
+
+/**
+ * Fold and bucket every line of a chunk. Lines that are not made of
+ * letters only, or are too long, are left out of the index.
+ *
+ * @chunk: the chunk.
+ * @result: where the buckets go.
+ * @counters: the worker's counters.
+*/
+void fold_chunk(ReadChunk* chunk, ChunkResult* result, Counters* counters) {
+    const char* line = chunk->data;
+    const char* end = chunk->data + chunk->length;
+    char folded[MAX_WORD];
+
+    while (line < end) {
+        const char* newline = memchr(line, '\n', end - line);
+        int lineLength = (newline != NULL ? newline : end) - line;
+        long long weight;
+        int length = split_weight(line, lineLength, &weight);
+        int letters = length > 0 && length <= MAX_WORD;
+
+        // lowercase and check for letters in the same pass
+        for (int i = 0; letters && i < length; i++) {
+            unsigned char c = line[i] | 0x20;
+            folded[i] = c;
+            letters = c >= 'a' && c <= 'z';
+        }
+        if (letters) {
+            bucket_add(&result->buckets[length], folded, length,
+                    chunk->fileOffset + (line - chunk->data), weight);
+            counters->words++;
+        }
+        line += lineLength + 1;
+    }
+}
+
+/**
+ * Stage two: take chunks off the full queue, fold them and hand the
+ * buffer back to the reader. Time waiting on the queue means the
+ * reader (I/O) is the bottleneck.
+ *
+ * @arg: the StageArg of the thread.
+*/
+void* worker_stage(void* arg) {
+    Pipeline* pipeline = ((StageArg*)arg)->pipeline;
+    Counters* counters = ((StageArg*)arg)->counters;
+    ReadChunk* chunk;
+
+    while ((chunk = queue_pop(&pipeline->full, &counters->waiting)) != NULL) {
+        double begin = now();
+        ChunkResult* result = (ChunkResult*) calloc(1, sizeof(ChunkResult));
+        uint64_t before = counters->words;
+
+        result->seq = chunk->seq;
+        fold_chunk(chunk, result, counters);
+        counters->bytes += chunk->length;
+        __atomic_fetch_add(&pipeline->wordsSoFar, counters->words - before,
+                __ATOMIC_RELAXED);
+
+        sem_wait(&pipeline->resultGuard);
+        result->next = pipeline->results;
+        pipeline->results = result;
+        pipeline->resultCount++;
+        sem_post(&pipeline->resultGuard);
+
+        counters->busy += now() - begin;
+        queue_push(&pipeline->empty, chunk);
+    }
+    return NULL;
+}
+
+/**
+ * Stage three: copy the buckets of every chunk to their final place in
+ * the index. Each task is one (chunk, length) pair, so a few huge
+ * buckets still spread over every thread.
+ *
+ * @arg: the StageArg of the thread.
+*/
+void* merge_stage(void* arg) {
+    Pipeline* pipeline = ((StageArg*)arg)->pipeline;
+    Counters* counters = ((StageArg*)arg)->counters;
+    long tasks = pipeline->resultCount * MAX_WORD;
+    long task;
+    double begin = now();
+
+    while ((task = __atomic_fetch_add(&pipeline->nextTask, 1,
+            __ATOMIC_RELAXED)) < tasks) {
+        ChunkResult* result = pipeline->ordered[task / MAX_WORD];
+        int length = task % MAX_WORD + 1;
+        ChunkBucket* from = &result->buckets[length];
+        IndexBucket* to = &pipeline->header->buckets[length];
+
+        if (from->count == 0) {
+            continue;
+        }
+        memcpy(pipeline->output + to->entryOffset
+                + from->destination * sizeof(IndexEntry),
+                from->entries, from->count * sizeof(IndexEntry));
+        memcpy(pipeline->output + to->imageOffset
+                + from->destination * length,
+                from->image, from->count * length);
+        counters->bytes += from->count * (sizeof(IndexEntry) + length);
+        counters->words += from->count;
+        free(from->entries);
+        free(from->image);
+    }
+    counters->busy = now() - begin;
+    return NULL;
+}
+
+/**
+ * Compare chunk results by chunk number, for qsort.
+*/
+int compare_results(const void* a, const void* b) {
+    long x = (*(ChunkResult* const*)a)->seq;
+    long y = (*(ChunkResult* const*)b)->seq;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Lay the index file out: every bucket gets its entries, then every
+ * bucket its image, and each chunk learns where its words go.
+ * Return the total size of the file.
+ *
+ * @pipeline: the build, with every chunk folded.
+ * @header: the header to be filled in.
+*/
+uint64_t plan_layout(Pipeline* pipeline, IndexHeader* header) {
+    uint64_t position = sizeof(IndexHeader);
+
+    for (int length = 1; length <= MAX_WORD; length++) {
+        uint64_t count = 0;
+        for (long i = 0; i < pipeline->resultCount; i++) {
+            ChunkBucket* bucket = &pipeline->ordered[i]->buckets[length];
+            bucket->destination = count;
+            count += bucket->count;
+        }
+        header->buckets[length].count = count;
+        header->buckets[length].entryOffset = position;
+        position += count * sizeof(IndexEntry);
+        header->total += count;
+    }
+    for (int length = 1; length <= MAX_WORD; length++) {
+        header->buckets[length].imageOffset = position;
+        position += header->buckets[length].count * length;
+    }
+    return position;
+}
+
+/**
+ * Run a stage on every thread and wait for all of them.
+ *
+ * @pipeline: the build.
+ * @stage: the thread function.
+ * @counters: one Counters per thread.
+*/
+void run_threads(Pipeline* pipeline, void* (*stage)(void*),
+        Counters* counters) {
+    pthread_t* threads = (pthread_t*) malloc(sizeof(pthread_t)
+            * pipeline->threads);
+    StageArg* args = (StageArg*) malloc(sizeof(StageArg)
+            * pipeline->threads);
+
+    for (int i = 0; i < pipeline->threads; i++) {
+        args[i].pipeline = pipeline;
+        args[i].counters = &counters[i];
+        pthread_create(&threads[i], NULL, stage, &args[i]);
+    }
+    if (stage == worker_stage) {
+        read_stage(pipeline);
+    }
+    for (int i = 0; i < pipeline->threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(args);
+    free(threads);
+}
+
+/**
+ * Print the throughput of each stage and which resource bounded the
+ * build: the reader blocking on free buffers means the workers could
+ * not keep up (CPU-bound), workers blocking on chunks means the reader
+ * could not (I/O-bound).
+ *
+ * @pipeline: the finished build.
+ * @readSeconds: wall time of the read and fold stages.
+ * @mergeSeconds: wall time of the merge stage.
+*/
+void report_summary(Pipeline* pipeline, double readSeconds,
+        double mergeSeconds) {
+    Counters fold = {0, 0, 0, 0};
+    Counters merge = {0, 0, 0, 0};
+    double mb = pipeline->reader.bytes / 1048576.0;
+
+    for (int i = 0; i < pipeline->threads; i++) {
+        fold.busy += pipeline->workers[i].busy;
+        fold.waiting += pipeline->workers[i].waiting;
+        fold.words += pipeline->workers[i].words;
+        merge.busy += pipeline->mergers[i].busy;
+        merge.bytes += pipeline->mergers[i].bytes;
+    }
+    double idle = fold.waiting / (fold.busy + fold.waiting + 1e-9);
+
+    fprintf(stderr, "buildindex: %lu words from %.1f MB in %.2fs "
+            "(%.1f MB/s)\n", (unsigned long)fold.words, mb,
+            readSeconds + mergeSeconds, mb / (readSeconds + mergeSeconds));
+    fprintf(stderr, "buildindex: read   %.2fs in read(), %.2fs waiting for "
+            "buffers, %.1f MB/s\n", pipeline->reader.busy,
+            pipeline->reader.waiting, mb / (pipeline->reader.busy + 1e-9));
+    fprintf(stderr, "buildindex: fold   %d threads, %.2fs busy, %.2fs idle, "
+            "%.1f MB/s per thread\n", pipeline->threads, fold.busy,
+            fold.waiting, mb / (fold.busy + 1e-9));
+    fprintf(stderr, "buildindex: merge  %.2fs, %.1f MB written\n",
+            mergeSeconds, merge.bytes / 1048576.0);
+    if (pipeline->reader.waiting > pipeline->reader.busy) {
+        fprintf(stderr, "buildindex: CPU-bound, the reader waited on the "
+                "workers for %.0f%% of its time\n", 100.0
+                * pipeline->reader.waiting / (pipeline->reader.waiting
+                + pipeline->reader.busy));
+    } else {
+        fprintf(stderr, "buildindex: %s, the workers were idle "
+                "%.0f%% of their time\n", idle > 0.5 ? "I/O-bound"
+                : "balanced", 100.0 * idle);
+    }
+}
+
+/**
+ * Merge the folded chunks into the index file and write its header.
+ * Return 0 on success, -1 if the file can not be written.
+ *
+ * @pipeline: the build, with every chunk folded.
+ * @path: the index file.
+ * @info: the dictionary's stat.
+*/
+int write_index(Pipeline* pipeline, const char* path, struct stat* info) {
+    IndexHeader header;
+    long i = 0;
+
+    memset(&header, 0, sizeof(IndexHeader));
+    memcpy(header.magic, INDEX_MAGIC, 8);
+    header.maxWord = MAX_WORD;
+    header.dictSize = info->st_size;
+    header.dictMtime = info->st_mtime;
+
+    pipeline->ordered = (ChunkResult**) malloc(sizeof(ChunkResult*)
+            * (pipeline->resultCount + 1));
+    for (ChunkResult* result = pipeline->results; result != NULL;
+            result = result->next) {
+        pipeline->ordered[i++] = result;
+    }
+    qsort(pipeline->ordered, pipeline->resultCount, sizeof(ChunkResult*),
+            compare_results);
+    uint64_t size = plan_layout(pipeline, &header);
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, size) != 0) {
+        return -1;
+    }
+    pipeline->output = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+            fd, 0);
+    close(fd);
+    if (pipeline->output == MAP_FAILED) {
+        return -1;
+    }
+    pipeline->header = (IndexHeader*)pipeline->output;
+    memcpy(pipeline->header, &header, sizeof(IndexHeader));
+
+    run_threads(pipeline, merge_stage, pipeline->mergers);
+    munmap(pipeline->output, size);
+    return 0;
+}
+
+/**
+ * Read a positive number option, or show usage.
+ *
+ * @value: the argument.
+*/
+int positive_arg(const char* value) {
+    char* end;
+    long number = strtol(value, &end, 10);
+
+    if (*end != '\0' || number <= 0 || number > 4096) {
+        arg_error();
+    }
+    return (int)number;
+}
+
+int main(int argc, char** argv) {
+    Pipeline pipeline;
+    struct stat info;
+    char* paths[2];
+    int pathCount = 0;
+
+    memset(&pipeline, 0, sizeof(Pipeline));
+    pipeline.threads = sysconf(_SC_NPROCESSORS_ONLN);
+    pipeline.chunkSize = (size_t)DEFAULT_CHUNK_MB << 20;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) {
+            pipeline.threads = positive_arg(argv[++i]);
+        } else if (strcmp(argv[i], "-chunk") == 0 && i + 1 < argc) {
+            pipeline.chunkSize = (size_t)positive_arg(argv[++i]) << 20;
+        } else if (argv[i][0] != '-' && pathCount < 2) {
+            paths[pathCount++] = argv[i];
+        } else {
+            arg_error();
+        }
+    }
+    if (pathCount != 2 || pipeline.threads < 1) {
+        arg_error();
+    }
+
+    pipeline.fd = open(paths[0], O_RDONLY);
+    if (pipeline.fd < 0 || fstat(pipeline.fd, &info) != 0) {
+        fprintf(stderr, "buildindex: file \"%s\" can not be opened\n",
+                paths[0]);
+        exit(1);
+    }
+    pipeline.fileSize = info.st_size;
+
+    int buffers = pipeline.threads * BUFFERS_PER_WORKER;
+    queue_init(&pipeline.empty, buffers);
+    queue_init(&pipeline.full, buffers + pipeline.threads);
+    sem_init(&pipeline.resultGuard, 0, 1);
+    for (int i = 0; i < buffers; i++) {
+        queue_push(&pipeline.empty, (ReadChunk*) calloc(1,
+                sizeof(ReadChunk)));
+    }
+    pipeline.workers = (Counters*) calloc(pipeline.threads, sizeof(Counters));
+    pipeline.mergers = (Counters*) calloc(pipeline.threads, sizeof(Counters));
+
+    double start = now();
+    run_threads(&pipeline, worker_stage, pipeline.workers);
+    double folded = now();
+    if (write_index(&pipeline, paths[1], &info) < 0) {
+        fprintf(stderr, "buildindex: file \"%s\" can not be written\n",
+                paths[1]);
+        exit(1);
+    }
+    report_summary(&pipeline, folded - start, now() - folded);
+
+    return 0;
+}
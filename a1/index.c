@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "index.h"
+
+/**
+ * Return 1 if count items of size bytes starting at offset lie inside
+ * a file of fileSize bytes. Nothing is multiplied before it is known
+ * not to wrap.
+ *
+ * @offset: where the items start.
+ * @count: the number of items.
+ * @size: the size of one item, not 0.
+ * @fileSize: the size of the file.
+*/
+static int span_fits(uint64_t offset, uint64_t count, uint64_t size,
+        uint64_t fileSize) {
+    return offset <= fileSize && count <= (fileSize - offset) / size;
+}
+
+/**
+ * Map an index file and check it describes the dictionary given.
+ * Return the mapped header, or NULL if the file can not be opened,
+ * is not an index, is stale or points outside itself or the dictionary.
+ *
+ * @path: the index file.
+ * @dictSize: the size of the dictionary being searched.
+ * @dictMtime: the modification time of that dictionary.
+*/
+const IndexHeader* index_load(const char* path, uint64_t dictSize,
+        int64_t dictMtime) {
+    struct stat info;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &info) != 0 || info.st_size < sizeof(IndexHeader)) {
+        close(fd);
+        return NULL;
+    }
+    const IndexHeader* index = mmap(NULL, info.st_size, PROT_READ,
+            MAP_SHARED, fd, 0);
+    close(fd);
+    if (index == MAP_FAILED) {
+        return NULL;
+    }
+
+    if (memcmp(index->magic, INDEX_MAGIC, 8) != 0
+            || index->maxWord != MAX_WORD || index->dictSize != dictSize
+            || index->dictMtime != dictMtime) {
+        munmap((void*)index, info.st_size);
+        return NULL;
+    }
+    // every bucket has to lie inside the file
+    for (int length = 1; length <= MAX_WORD; length++) {
+        const IndexBucket* bucket = &index->buckets[length];
+        if (!span_fits(bucket->entryOffset, bucket->count,
+                sizeof(IndexEntry), info.st_size)
+                || !span_fits(bucket->imageOffset, bucket->count, length,
+                info.st_size)) {
+            munmap((void*)index, info.st_size);
+            return NULL;
+        }
+        // and every word inside the dictionary, search prints from there
+        const IndexEntry* entries = index_entries(index, length);
+        for (uint64_t i = 0; i < bucket->count; i++) {
+            if (!span_fits(entries[i].offset, 1, length, dictSize)) {
+                munmap((void*)index, info.st_size);
+                return NULL;
+            }
+        }
+    }
+    return index;
+}
+
+/**
+ * Return the entries of the words with length letters.
+ *
+ * @index: a loaded index.
+ * @length: the bucket, 1..MAX_WORD.
+*/
+const IndexEntry* index_entries(const IndexHeader* index, int length) {
+    return (const IndexEntry*)((const char*)index
+            + index->buckets[length].entryOffset);
+}
+
+/**
+ * Return the lowercase image of the words with length letters.
+ *
+ * @index: a loaded index.
+ * @length: the bucket, 1..MAX_WORD.
+*/
+const char* index_image(const IndexHeader* index, int length) {
+    return (const char*)index + index->buckets[length].imageOffset;
+}
@@ -0,0 +1,47 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "pattern.h"
+
+/* first bytes of every index file */
+#define INDEX_MAGIC "SRCHIDX1"
+
+/* the words of one length: their entries and their lowercase image */
+typedef struct {
+    uint64_t count; /* number of words of this length */
+    uint64_t entryOffset; /* file offset of count IndexEntry */
+    uint64_t imageOffset; /* file offset of count * length letters */
+} IndexBucket;
+
+/* one indexed word */
+typedef struct {
+    uint64_t offset; /* where the word starts in the dictionary */
+    int64_t weight; /* weight from a "word<TAB>weight" line, 0 if none */
+} IndexEntry;
+
+/*
+ * The start of an index file. Only words made of letters are indexed,
+ * the only words search can match, bucketed by length. Within a bucket
+ * words keep dictionary order and the image holds them lowercased and
+ * back to back without separators.
+ */
+typedef struct {
+    char magic[8]; /* INDEX_MAGIC */
+    uint32_t maxWord; /* MAX_WORD the index was built with */
+    uint32_t reserved; /* always 0 */
+    uint64_t dictSize; /* size of the dictionary described */
+    int64_t dictMtime; /* modification time of the dictionary */
+    uint64_t total; /* words in all buckets */
+    IndexBucket buckets[MAX_WORD + 1]; /* bucket L holds words of L letters */
+} IndexHeader;
+
+const IndexHeader* index_load(const char* path, uint64_t dictSize,
+        int64_t dictMtime);
+
+const IndexEntry* index_entries(const IndexHeader* index, int length);
+
+const char* index_image(const IndexHeader* index, int length);
+
+#endif
@@ -0,0 +1,487 @@
+#include <stdio.h>
+#include <string.h>
+#include "pattern.h"
+#include "utf8.h"
+
+/* every letter 'a'..'z' */
+#define ALL_LETTERS 0x3FFFFFF
+/* slots in the state index, a power of two larger than MAX_STATES */
+#define TABLE_SIZE (2 * MAX_STATES)
+
+/* a "[...]" set, or a single letter, as parsed from the pattern */
+typedef struct {
+    long mask; /* ASCII letters listed */
+    int negate; /* 1 for "[^...]" */
+    int* wide; /* non-ASCII letters listed, NULL to only count them */
+    int wideCount; /* number of letters in wide */
+} CharSet;
+
+/**
+ * Turn a letter into its index 0..25, or -1 if it is not a letter.
+ *
+ * @c: the character to be checked.
+*/
+static int letter_index(int c) {
+    if (c >= 'a' && c <= 'z') {
+        return c - 'a';
+    }
+    if (c >= 'A' && c <= 'Z') {
+        return c - 'A';
+    }
+    return -1;
+}
+
+/**
+ * Read the character at pattern[*index] and move past it. In UTF-8
+ * mode a whole code point is read, case folded. Return -1 for bytes
+ * that are not valid UTF-8.
+ *
+ * @pattern: the whole pattern.
+ * @index: the pointer to index, the position to read from.
+ * @utf8: 1 in UTF-8 mode.
+*/
+static int next_char(const char* pattern, int* index, int utf8) {
+    int c = (unsigned char)pattern[*index];
+
+    if (utf8 && c >= 0x80) {
+        int size = utf8_decode(pattern + *index, strlen(pattern + *index),
+                &c);
+        if (size < 0) {
+            return -1;
+        }
+        *index += size;
+        return utf8_fold(c);
+    }
+    *index += 1;
+    return c;
+}
+
+/**
+ * Add a letter to a set. Return 0, or -1 if it is not a letter.
+ *
+ * @set: the set.
+ * @c: the character, already folded.
+ * @utf8: 1 in UTF-8 mode, where non-ASCII letters are allowed.
+*/
+static int add_letter(CharSet* set, int c, int utf8) {
+    if (letter_index(c) >= 0) {
+        set->mask |= 1L << letter_index(c);
+        return 0;
+    }
+    if (!utf8 || c < 0x80 || !utf8_is_letter(c)) {
+        return -1;
+    }
+    if (set->wide != NULL) {
+        set->wide[set->wideCount] = c;
+    }
+    set->wideCount++;
+    return 0;
+}
+
+/**
+ * Parse a "[...]" character set starting at pattern[*index]. Return 0,
+ * or -1 if the set is malformed. Ranges are only allowed between
+ * ASCII letters. On success *index is left just past the closing ']'.
+ *
+ * @pattern: the whole pattern.
+ * @index: the pointer to index, the position of the '['.
+ * @utf8: 1 in UTF-8 mode.
+ * @set: the set to be filled in, its wide array if any must have room
+ * for every character left in the pattern.
+*/
+static int parse_set(const char* pattern, int* index, int utf8,
+        CharSet* set) {
+    int i = *index + 1;
+
+    set->mask = 0;
+    set->negate = 0;
+    set->wideCount = 0;
+    if (pattern[i] == '^' || pattern[i] == '!') {
+        set->negate = 1;
+        i++;
+    }
+    while (pattern[i] != '\0' && pattern[i] != ']') {
+        int from = next_char(pattern, &i, utf8);
+        // a range like "a-f"
+        if (letter_index(from) >= 0 && pattern[i] == '-'
+                && letter_index(pattern[i + 1]) >= 0) {
+            int to = letter_index(pattern[i + 1]);
+            if (to < letter_index(from)) {
+                return -1;
+            }
+            for (int c = letter_index(from); c <= to; c++) {
+                set->mask |= 1L << c;
+            }
+            i += 2;
+        } else if (from < 0 || add_letter(set, from, utf8) < 0) {
+            return -1;
+        }
+    }
+    // unterminated or empty set
+    if (pattern[i] != ']'
+            || (set->mask == 0 && set->wideCount == 0 && !set->negate)) {
+        return -1;
+    }
+    *index = i + 1;
+    return 0;
+}
+
+/**
+ * Check the pattern syntax: letters, '?', '*' and "[...]" sets with
+ * optional ranges and a leading '^' or '!' for negation. In UTF-8 mode
+ * letters outside ASCII are allowed too.
+ * Return PATTERN_OK, PATTERN_BAD_CHAR or PATTERN_BAD_SET.
+ *
+ * @pattern: the pattern to be checked.
+ * @utf8: 1 in UTF-8 mode.
+*/
+int pattern_valid(const char* pattern, int utf8) {
+    int i = 0;
+    CharSet set;
+
+    set.wide = NULL;
+    while (pattern[i] != '\0') {
+        if (pattern[i] == '[') {
+            if (parse_set(pattern, &i, utf8, &set) < 0) {
+                return PATTERN_BAD_SET;
+            }
+            continue;
+        }
+        int c = next_char(pattern, &i, utf8);
+        set.mask = 0;
+        if (c != '?' && c != '*' && (c < 0 || add_letter(&set, c, utf8) < 0)) {
+            return PATTERN_BAD_CHAR;
+        }
+    }
+    return PATTERN_OK;
+}
+
+/**
+ * Append one element to the compiled pattern, merging runs of '*'.
+ *
+ * @dfa: the pattern being compiled.
+ * @set: the letters the element accepts, NULL for a star.
+ * @letters: the pointer to letters, number of single letter elements.
+*/
+static void add_element(Dfa* dfa, CharSet* set, int* letters) {
+    int star = set == NULL;
+
+    if (star && dfa->elemCount > 0 && dfa->stars[dfa->elemCount - 1]) {
+        return;
+    }
+    if (!star && ++(*letters) > MAX_WORD) {
+        // longer than any word, nothing can match
+        dfa->neverMatch = 1;
+        return;
+    }
+    if (dfa->neverMatch) {
+        return;
+    }
+    dfa->stars[dfa->elemCount] = (char)star;
+    if (!star) {
+        dfa->sets[dfa->elemCount] = set->negate
+                ? (uint32_t)(~set->mask & ALL_LETTERS) : (uint32_t)set->mask;
+        dfa->wide[dfa->elemCount] = set->wide;
+        dfa->wideCount[dfa->elemCount] = set->wideCount;
+        dfa->negated[dfa->elemCount] = (char)set->negate;
+    }
+    dfa->elemCount++;
+}
+
+/**
+ * Test or set bit pos of a StateSet.
+*/
+static int set_has(const StateSet* s, int pos) {
+    return pos < 64 ? (s->lo >> pos) & 1 : (s->hi >> (pos - 64)) & 1;
+}
+
+static void set_add(StateSet* s, int pos) {
+    if (pos < 64) {
+        s->lo |= (uint64_t)1 << pos;
+    } else {
+        s->hi |= (uint64_t)1 << (pos - 64);
+    }
+}
+
+/**
+ * Follow the empty moves of every '*' in the set: a star may match
+ * no letters, so being before it also means being after it.
+ *
+ * @dfa: the compiled pattern.
+ * @s: the set to be closed.
+*/
+static void closure(Dfa* dfa, StateSet* s) {
+    for (int i = 0; i < dfa->elemCount; i++) {
+        if (dfa->stars[i] && set_has(s, i)) {
+            set_add(s, i + 1);
+        }
+    }
+}
+
+/**
+ * Find the DFA state for the NFA set s, adding it if it is new.
+ * When the cache is full every state is dropped and building restarts,
+ * so memory stays bounded no matter how many states the pattern has.
+ *
+ * @dfa: the compiled pattern.
+ * @s: the set of NFA positions.
+*/
+static int state_for(Dfa* dfa, StateSet s) {
+    uint64_t hash = (s.lo ^ (s.hi * 0x9E3779B97F4A7C15ULL))
+            * 0xBF58476D1CE4E5B9ULL;
+    int slot = (int)(hash >> 40) & (TABLE_SIZE - 1);
+
+    while (dfa->table[slot] >= 0) {
+        StateSet* old = &dfa->states[dfa->table[slot]];
+        if (old->lo == s.lo && old->hi == s.hi) {
+            return dfa->table[slot];
+        }
+        slot = (slot + 1) & (TABLE_SIZE - 1);
+    }
+
+    if (dfa->stateCount == MAX_STATES) {
+        dfa->stateCount = 0;
+        memset(dfa->table, -1, sizeof(int) * TABLE_SIZE);
+        memset(dfa->trans, -1, sizeof(int) * 26 * MAX_STATES);
+        dfa->start = -1;
+        return state_for(dfa, s);
+    }
+
+    int state = dfa->stateCount++;
+    dfa->states[state] = s;
+    dfa->accept[state] = (char)set_has(&s, dfa->elemCount);
+    dfa->table[slot] = state;
+    return state;
+}
+
+/**
+ * Build the transition from state on letter c and return its target.
+ *
+ * @dfa: the compiled pattern.
+ * @state: the state the transition leaves from.
+ * @c: the letter index 0..25.
+*/
+static int build_transition(Dfa* dfa, int state, int c) {
+    StateSet from = dfa->states[state];
+    StateSet to = {0, 0};
+
+    for (int i = 0; i < dfa->elemCount; i++) {
+        if (!set_has(&from, i)) {
+            continue;
+        }
+        if (dfa->stars[i]) {
+            set_add(&to, i);
+        } else if (dfa->sets[i] & (1U << c)) {
+            set_add(&to, i + 1);
+        }
+    }
+    closure(dfa, &to);
+
+    int target = state_for(dfa, to);
+    // the cache may have been flushed and state reused by something else
+    if (dfa->stateCount > state && dfa->states[state].lo == from.lo
+            && dfa->states[state].hi == from.hi) {
+        dfa->trans[state * 26 + c] = target;
+    }
+    return target;
+}
+
+/**
+ * Compile a valid pattern into a DFA. The search mode only changes
+ * the anchoring: PREFIX appends a '*' and ANYWHERE wraps the pattern
+ * in '*', so every mode becomes a whole word match.
+ *
+ * @pattern: a pattern accepted by pattern_valid.
+ * @mode: EXACT, PREFIX or ANYWHERE.
+ * @utf8: 1 in UTF-8 mode.
+ * @arena: the arena the DFA and its tables live in.
+*/
+Dfa* dfa_compile(const char* pattern, int mode, int utf8, Arena* arena) {
+    Dfa* dfa = (Dfa*) arena_alloc(arena, sizeof(Dfa));
+    memset(dfa, 0, sizeof(Dfa));
+    int letters = 0;
+    int i = 0;
+    CharSet set;
+
+    if (mode == ANYWHERE) {
+        add_element(dfa, NULL, &letters);
+    }
+    while (pattern[i] != '\0') {
+        set.mask = 0;
+        set.negate = 0;
+        set.wideCount = 0;
+        set.wide = NULL;
+        if (utf8) {
+            set.wide = (int*) arena_alloc(arena,
+                    sizeof(int) * (strlen(pattern + i) + 1));
+        }
+        if (pattern[i] == '[') {
+            parse_set(pattern, &i, utf8, &set);
+            add_element(dfa, &set, &letters);
+            continue;
+        }
+        int c = next_char(pattern, &i, utf8);
+        if (c == '*') {
+            add_element(dfa, NULL, &letters);
+        } else if (c == '?') {
+            // any letter at all: every ASCII one and no exceptions
+            set.negate = 1;
+            add_element(dfa, &set, &letters);
+        } else {
+            add_letter(&set, c, utf8);
+            add_element(dfa, &set, &letters);
+        }
+    }
+    if (mode == PREFIX || mode == ANYWHERE) {
+        add_element(dfa, NULL, &letters);
+    }
+
+    dfa->states = (StateSet*) arena_alloc(arena,
+            sizeof(StateSet) * MAX_STATES);
+    dfa->trans = (int*) arena_alloc(arena, sizeof(int) * 26 * MAX_STATES);
+    dfa->accept = (char*) arena_alloc(arena, sizeof(char) * MAX_STATES);
+    dfa->table = (int*) arena_alloc(arena, sizeof(int) * TABLE_SIZE);
+    memset(dfa->trans, -1, sizeof(int) * 26 * MAX_STATES);
+    memset(dfa->table, -1, sizeof(int) * TABLE_SIZE);
+    dfa->start = -1;
+
+    return dfa;
+}
+
+/**
+ * Run the DFA over a word in one pass. Return 1 if the whole word
+ * consists of letters and matches, 0 otherwise.
+ *
+ * @dfa: the compiled pattern.
+ * @word: the word, not necessarily NUL terminated.
+ * @length: the number of bytes in word.
+*/
+int dfa_match(Dfa* dfa, const char* word, int length) {
+    if (dfa->neverMatch || length == 0) {
+        return 0;
+    }
+    if (dfa->start < 0) {
+        StateSet s = {1, 0};
+        closure(dfa, &s);
+        dfa->start = state_for(dfa, s);
+    }
+
+    int state = dfa->start;
+    for (int i = 0; i < length; i++) {
+        int c = letter_index(word[i]);
+        if (c < 0) {
+            return 0;
+        }
+        int next = dfa->trans[state * 26 + c];
+        if (next < 0) {
+            next = build_transition(dfa, state, c);
+        }
+        state = next;
+        // no position left, the rest of the word can not match
+        if (dfa->states[state].lo == 0 && dfa->states[state].hi == 0) {
+            return 0;
+        }
+    }
+    return dfa->accept[state];
+}
+
+/**
+ * Find the shortest and longest word the pattern can match. A pattern
+ * that can never match gets a minimum above its maximum.
+ *
+ * @dfa: the compiled pattern.
+ * @minLength: the pointer to minLength, set to the fewest letters.
+ * @maxLength: the pointer to maxLength, set to the most letters.
+*/
+void dfa_length_range(Dfa* dfa, int* minLength, int* maxLength) {
+    int star = 0;
+
+    *minLength = 0;
+    for (int i = 0; i < dfa->elemCount; i++) {
+        if (dfa->stars[i]) {
+            star = 1;
+        } else {
+            (*minLength)++;
+        }
+    }
+    *maxLength = star ? MAX_WORD : *minLength;
+    if (dfa->neverMatch) {
+        *minLength = MAX_WORD + 1;
+    }
+}
+
+/**
+ * Return 1 if element i accepts the folded letter c.
+ *
+ * @dfa: the compiled pattern.
+ * @i: the element, not a star.
+ * @c: a folded letter.
+*/
+static int element_accepts(Dfa* dfa, int i, int c) {
+    int listed = 0;
+
+    if (c < 0x80) {
+        return (dfa->sets[i] >> letter_index(c)) & 1;
+    }
+    for (int k = 0; k < dfa->wideCount[i]; k++) {
+        if (dfa->wide[i][k] == c) {
+            listed = 1;
+            break;
+        }
+    }
+    return dfa->negated[i] ? !listed : listed;
+}
+
+/**
+ * Match a word that may hold UTF-8 letters, where '?' stands for one
+ * code point. Pure ASCII words, nearly all of them in an English
+ * dictionary, go straight to the DFA. The rest are decoded and run
+ * through the pattern's NFA one code point at a time.
+ * Return 1 if the whole word consists of letters and matches.
+ *
+ * @dfa: the pattern compiled in UTF-8 mode.
+ * @word: the word, not necessarily NUL terminated.
+ * @length: the number of bytes in word.
+*/
+int dfa_match_utf8(Dfa* dfa, const char* word, int length) {
+    if (utf8_is_ascii(word, length)) {
+        return length <= MAX_WORD && dfa_match(dfa, word, length);
+    }
+    if (dfa->neverMatch) {
+        return 0;
+    }
+
+    StateSet current = {1, 0};
+    int letters = 0;
+    closure(dfa, &current);
+    for (int i = 0; i < length; letters++) {
+        int c;
+        int size = utf8_decode(word + i, length - i, &c);
+        if (size < 0 || letters == MAX_WORD) {
+            return 0;
+        }
+        i += size;
+        c = utf8_fold(c);
+        if (!utf8_is_letter(c)) {
+            return 0;
+        }
+
+        StateSet next = {0, 0};
+        for (int e = 0; e < dfa->elemCount; e++) {
+            if (!set_has(&current, e)) {
+                continue;
+            }
+            if (dfa->stars[e]) {
+                set_add(&next, e);
+            } else if (element_accepts(dfa, e, c)) {
+                set_add(&next, e + 1);
+            }
+        }
+        closure(dfa, &next);
+        if (next.lo == 0 && next.hi == 0) {
+            return 0;
+        }
+        current = next;
+    }
+    return set_has(&current, dfa->elemCount);
+}
@@ -0,0 +1,61 @@
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include <stdint.h>
+#include "arena.h"
+
+#define EXACT 1
+#define PREFIX 2
+#define ANYWHERE 3
+
+/* results of pattern_valid */
+#define PATTERN_OK 0
+#define PATTERN_BAD_CHAR 1
+#define PATTERN_BAD_SET 2
+
+/* longest word (in letters) search will ever try to match */
+#define MAX_WORD 40
+/* most elements a pattern can hold once consecutive '*' are merged */
+#define MAX_ELEMS (2 * MAX_WORD + 1)
+/* most DFA states kept before the state cache is flushed */
+#define MAX_STATES 4096
+
+/* a set of NFA positions, one bit per position (MAX_ELEMS + 1 <= 128) */
+typedef struct {
+    uint64_t lo;
+    uint64_t hi;
+} StateSet;
+
+/*
+ * A pattern compiled to a lazily built DFA over the letters 'a'..'z'.
+ * In UTF-8 mode elements also accept letters outside ASCII, which only
+ * the slower dfa_match_utf8 looks at.
+ */
+typedef struct {
+    int elemCount; /* number of pattern elements */
+    uint32_t sets[MAX_ELEMS]; /* letters accepted by each element */
+    char stars[MAX_ELEMS]; /* 1 if the element is a '*' span */
+    int neverMatch; /* 1 if no word of MAX_WORD letters can match */
+    int* wide[MAX_ELEMS]; /* folded non-ASCII letters listed in an element */
+    int wideCount[MAX_ELEMS]; /* number of letters in wide */
+    char negated[MAX_ELEMS]; /* 1 if wide lists the letters NOT accepted */
+
+    int stateCount; /* number of DFA states built so far */
+    StateSet* states; /* NFA position set of every DFA state */
+    int* trans; /* transitions, 26 per state, -1 if not built yet */
+    char* accept; /* 1 if the DFA state is accepting */
+    int* table; /* open addressing index from StateSet to state */
+    int start; /* the start state */
+} Dfa;
+
+int pattern_valid(const char* pattern, int utf8);
+
+Dfa* dfa_compile(const char* pattern, int mode, int utf8, Arena* arena);
+
+int dfa_match(Dfa* dfa, const char* word, int length);
+
+int dfa_match_utf8(Dfa* dfa, const char* word, int length);
+
+void dfa_length_range(Dfa* dfa, int* minLength, int* maxLength);
+
+#endif
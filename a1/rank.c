@@ -0,0 +1,260 @@
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include "rank.h"
+
+/**
+ * Split a "word<TAB>weight" dictionary line and return the length of
+ * the word. Lines without a tab are all word and get weight 0, as does
+ * a weight that is not a number. A weight too large for a long long is
+ * clamped to LLONG_MAX. The line is not modified.
+ *
+ * @line: the line without its newline.
+ * @length: the number of bytes in line.
+ * @weight: the pointer to weight, set to the parsed weight.
+*/
+int split_weight(const char* line, int length, long long* weight) {
+    const char* tab = memchr(line, '\t', length);
+    long long value = 0;
+    int negative = 0;
+
+    *weight = 0;
+    if (tab == NULL) {
+        return length;
+    }
+    // the line is not NUL terminated, so no strtoll
+    const char* digit = tab + 1;
+    if (digit < line + length && *digit == '-') {
+        negative = 1;
+        digit++;
+    }
+    while (digit < line + length && *digit >= '0' && *digit <= '9') {
+        int d = *digit - '0';
+        // stop before value * 10 + d overflows
+        if (value > (LLONG_MAX - d) / 10) {
+            value = LLONG_MAX;
+            break;
+        }
+        value = value * 10 + d;
+        digit++;
+    }
+    *weight = negative ? -value : value;
+    return tab - line;
+}
+
+/**
+ * Create an empty top K collector. Items are allocated as the heap
+ * grows, so a large K costs nothing until that many words match.
+ *
+ * @limit: K, the number of words to keep.
+ * @arena: the arena the collector lives in.
+*/
+TopK* topk_create(int limit, Arena* arena) {
+    TopK* top = (TopK*) arena_alloc(arena, sizeof(TopK));
+    memset(top, 0, sizeof(TopK));
+    top->limit = limit;
+    top->arena = arena;
+    return top;
+}
+
+/**
+ * Return 1 if a ranks below b: a lower weight, or the same weight
+ * from a later line.
+*/
+static int ranks_below(const Ranked* a, const Ranked* b) {
+    if (a->weight != b->weight) {
+        return a->weight < b->weight;
+    }
+    return a->index > b->index;
+}
+
+/**
+ * Restore the heap order below position i.
+ *
+ * @items: the heap array.
+ * @count: the number of items in the heap.
+ * @i: the position that may be out of order.
+*/
+static void sift_down(Ranked* items, int count, int i) {
+    while (1) {
+        int worst = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+
+        if (left < count && ranks_below(&items[left], &items[worst])) {
+            worst = left;
+        }
+        if (right < count && ranks_below(&items[right], &items[worst])) {
+            worst = right;
+        }
+        if (worst == i) {
+            return;
+        }
+        Ranked temp = items[i];
+        items[i] = items[worst];
+        items[worst] = temp;
+        i = worst;
+    }
+}
+
+/**
+ * Offer a matching word. Once K words are kept, a word that does not
+ * beat the worst of them is rejected straight away.
+ *
+ * @top: the collector.
+ * @view: where the word is in the dictionary.
+ * @weight: the word's weight.
+ * @index: where the word's line starts.
+*/
+void topk_offer(TopK* top, WordView view, long long weight, long index) {
+    Ranked candidate;
+    candidate.view = view;
+    candidate.weight = weight;
+    candidate.index = index;
+
+    if (top->count == top->limit) {
+        if (!ranks_below(&top->items[0], &candidate)) {
+            return;
+        }
+        top->items[0] = candidate;
+        sift_down(top->items, top->count, 0);
+        return;
+    }
+
+    if (top->count == top->capacity) {
+        int capacity = top->capacity == 0 ? 16 : top->capacity * 2;
+        if (capacity > top->limit) {
+            capacity = top->limit;
+        }
+        top->items = (Ranked*) arena_grow(top->arena, top->items,
+                sizeof(Ranked) * top->capacity, sizeof(Ranked) * capacity);
+        top->capacity = capacity;
+    }
+
+    // sift the new word up from the bottom
+    int i = top->count++;
+    while (i > 0 && ranks_below(&candidate, &top->items[(i - 1) / 2])) {
+        top->items[i] = top->items[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    top->items[i] = candidate;
+}
+
+/**
+ * Heap sort the kept words in place, best first, and return how many
+ * there are.
+ *
+ * @top: the collector.
+*/
+int topk_finish(TopK* top) {
+    for (int end = top->count - 1; end > 0; end--) {
+        Ranked temp = top->items[0];
+        top->items[0] = top->items[end];
+        top->items[end] = temp;
+        sift_down(top->items, end, 0);
+    }
+    return top->count;
+}
+
+/**
+ * Compare two words like strcasecmp, without needing NUL terminators.
+ *
+ * @base: the mapped dictionary.
+ * @a: the first word.
+ * @b: the second word.
+*/
+static int compare_views(const char* base, const WordView* a,
+        const WordView* b) {
+    int length = a->length < b->length ? a->length : b->length;
+
+    for (int i = 0; i < length; i++) {
+        unsigned char x = base[a->offset + i];
+        unsigned char y = base[b->offset + i];
+        if (x >= 'A' && x <= 'Z') {
+            x += 'a' - 'A';
+        }
+        if (y >= 'A' && y <= 'Z') {
+            y += 'a' - 'A';
+        }
+        if (x != y) {
+            return x - y;
+        }
+    }
+    return a->length - b->length;
+}
+
+/**
+ * Order two words by where they are in the dictionary.
+ *
+ * @base: unused, to share merge_sort with compare_views.
+ * @a: the first word.
+ * @b: the second word.
+*/
+static int compare_offsets(const char* base, const WordView* a,
+        const WordView* b) {
+    return (a->offset > b->offset) - (a->offset < b->offset);
+}
+
+/**
+ * A stable bottom up merge sort. It takes its scratch space from the
+ * arena, so unlike qsort it never calls malloc.
+ *
+ * @views: the words to be sorted.
+ * @count: the number of words.
+ * @base: the mapped dictionary the views point into.
+ * @arena: the arena for scratch space.
+ * @compare: the order.
+*/
+static void merge_sort(WordView* views, int count, const char* base,
+        Arena* arena, int (*compare)(const char*, const WordView*,
+        const WordView*)) {
+    WordView* from = views;
+    WordView* to = (WordView*) arena_alloc(arena, sizeof(WordView) * count);
+
+    for (int width = 1; width < count; width *= 2) {
+        for (int left = 0; left < count; left += 2 * width) {
+            int middle = left + width < count ? left + width : count;
+            int right = left + 2 * width < count ? left + 2 * width : count;
+            int i = left;
+            int j = middle;
+
+            for (int k = left; k < right; k++) {
+                if (i < middle && (j >= right
+                        || compare(base, &from[i], &from[j]) <= 0)) {
+                    to[k] = from[i++];
+                } else {
+                    to[k] = from[j++];
+                }
+            }
+        }
+        WordView* temp = from;
+        from = to;
+        to = temp;
+    }
+    if (from != views) {
+        memcpy(views, from, sizeof(WordView) * count);
+    }
+}
+
+/**
+ * Sort words case insensitively, like strcasecmp.
+ *
+ * @views: the words to be sorted.
+ * @count: the number of words.
+ * @base: the mapped dictionary the views point into.
+ * @arena: the arena for scratch space.
+*/
+void sort_views(WordView* views, int count, const char* base, Arena* arena) {
+    merge_sort(views, count, base, arena, compare_views);
+}
+
+/**
+ * Put words back in dictionary order.
+ *
+ * @views: the words to be sorted.
+ * @count: the number of words.
+ * @arena: the arena for scratch space.
+*/
+void sort_views_by_offset(WordView* views, int count, Arena* arena) {
+    merge_sort(views, count, NULL, arena, compare_offsets);
+}
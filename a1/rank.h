@@ -0,0 +1,40 @@
+#ifndef RANK_H
+#define RANK_H
+
+#include "pattern.h"
+
+/* a matched word, as a view into the mapped dictionary */
+typedef struct {
+    long offset; /* where the word starts */
+    int length; /* bytes in the word, its weight not included */
+} WordView;
+
+/* one candidate for the top K output */
+typedef struct {
+    WordView view; /* the word without its weight */
+    long long weight; /* weight from a "word<TAB>weight" line, 0 if none */
+    long index; /* where the line starts, earlier lines win ties */
+} Ranked;
+
+/* a bounded min-heap keeping the K best words seen so far */
+typedef struct {
+    Ranked* items; /* heap array, the worst kept word is items[0] */
+    int count; /* number of words kept */
+    int capacity; /* allocated items */
+    int limit; /* K */
+    Arena* arena; /* where the heap array lives */
+} TopK;
+
+int split_weight(const char* line, int length, long long* weight);
+
+TopK* topk_create(int limit, Arena* arena);
+
+void topk_offer(TopK* top, WordView view, long long weight, long index);
+
+int topk_finish(TopK* top);
+
+void sort_views(WordView* views, int count, const char* base, Arena* arena);
+
+void sort_views_by_offset(WordView* views, int count, Arena* arena);
+
+#endif
@@ -1,14 +1,35 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
-
-#define EXACT 1
-#define PREFIX 2
-#define ANYWHERE 3
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "pattern.h"
+#include "rank.h"
+#include "arena.h"
+#include "index.h"
+
+/* what one query has found so far */
+typedef struct {
+    int ifPrinted; /* a flag to check if there is any output */
+    WordView* matches; /* matched words waiting to be sorted */
+    int matchCount; /* number of words in matches */
+    int matchCapacity; /* allocated size of matches */
+    int outOfOrder; /* 1 if matches must be put back in dictionary order */
+    TopK* top; /* best K matches in top K mode */
+} Query;
 
 /* show if sort mode on */
 int sortStatus;
+/* show if top K mode on */
+int topStatus;
+/* K for top K mode */
+int topLimit;
+/* show if batch mode on, patterns are read from stdin */
+int batchStatus;
+/* show if UTF-8 mode on, letters outside ASCII can match */
+int utf8Status;
 /* show if have search mode */
 int optionStatus;
 /* show if have pattern */
@@ -19,68 +40,103 @@ int optMode;
 char* filename;
 /* collect pattern */
 char* pattern;
-/* collect printed strings */
-char** wordsToSort;
-
-/** 
+/* the dictionary, mapped into memory */
+const char* dictionary;
+/* the number of bytes in dictionary */
+size_t dictionarySize;
+/* modification time of the dictionary, to spot a stale index */
+long dictionaryMtime;
+/* collect index path */
+char* indexPath;
+/* the index of the dictionary, NULL to scan the dictionary itself */
+const IndexHeader* dictIndex;
+/* allocations living as long as the program: arguments and dictionary */
+Arena programArena;
+/* allocations of one query, reset before the next query */
+Arena queryArena;
+
+/**
  * Show errors and exit.
 */
 void arg_error() {
     fprintf(stderr, "Usage: search [-exact|-prefix|-anywhere] "
-            "[-sort] pattern [filename]\n");
+            "[-sort] [-top K] [-batch] [-utf8] [-index indexfile] "
+            "pattern [filename]\n");
     exit(1);
 }
 
-/** 
+/**
  * Handle some default setting.
 */
 void handle_default() {
     // mode default
     if (optMode == 0) {
         optMode = EXACT;
-    }  
+    }
+
+    // in batch mode the only argument is the dictionary path
+    if (batchStatus == 1) {
+        if (patternStatus == 2) {
+            arg_error();
+        }
+        filename = pattern;
+        pattern = NULL;
+    }
 
     // check if pattern collect the dictionary path
-    if (patternStatus == 1 && filename == NULL) {
+    if (batchStatus == 0 && patternStatus == 1 && filename == NULL) {
         FILE* fp = fopen(pattern, "r");
         if (fp != NULL) {
             arg_error();
         }
-    } 
+    }
 
     // default filename path
     if (filename == NULL) {
-        filename = malloc(sizeof(char) * strlen("/usr/share/dict/words"));
-        strcpy(filename, "/usr/share/dict/words");
+        filename = arena_strdup(&programArena, "/usr/share/dict/words");
+    }
+}
+
+/**
+ * Check if the pattern satisfied requirement, if not then send error.
+ * Return 1 if the pattern is valid, 0 otherwise.
+ *
+ * @str: the str to be checked if satisfied requirement.
+*/
+int check_pattern(const char* str) {
+    int valid = pattern_valid(str, utf8Status);
+
+    // check if pattern only contain letters and question marks
+    if (valid == PATTERN_BAD_CHAR) {
+        fprintf(stderr, "search: pattern should only contain "
+                "question marks and letters\n");
+        return 0;
+    } else if (valid == PATTERN_BAD_SET) {
+        fprintf(stderr, "search: pattern has a malformed [...] set\n");
+        return 0;
     }
+    return 1;
 }
 
-/** 
+/**
  * Collect pattern and check if satisfied requirement,
  * if not then send error and exit.
- * 
+ *
  * @str: the str to be checked if satisfied requirement,
  * if it is, add it to pattern.
 */
 void add_pattern(char* str) {
-    for (int j = 0; j < strlen(str); j++) {
-        // check if pattern only contain characters and '?'
-        if ((str[j] >= 'a' && str[j] <= 'z') 
-                || (str[j] >= 'A' && str[j] <= 'Z') || str[j] == '?') {
-
-            *(pattern + j) = str[j];
-        } else {
-            fprintf(stderr, "search: pattern should only contain "
-                    "question marks and letters\n");
-            exit(1);
-        }
+    // in batch mode this is the dictionary path, not a pattern
+    if (batchStatus == 0 && !check_pattern(str)) {
+        exit(1);
     }
+    pattern = arena_strdup(&programArena, str);
 }
 
-/** 
+/**
  * Collect pattern and check if satisfied requirement,
  * if not then send error and exit.
- * 
+ *
  * @str: the str to be checked if satisfied requirement,
  * if it is, add it to pattern.
 */
@@ -88,26 +144,22 @@ void handle_pat_path(char* str) {
     // add dictionary path
     if (patternStatus != 0) {
         if (patternStatus == 1) {
-            filename = malloc(sizeof(char) * strlen(str));
-            for (int a = 0; a < strlen(str); a++) {
-                *(filename + a) = str[a];
-            }
+            filename = arena_strdup(&programArena, str);
             patternStatus = 2;
         } else {
             arg_error();
         }
     } else {
         // add pattern
-        pattern = malloc(sizeof(char) * strlen(str));
         add_pattern(str);
         patternStatus = 1;
     }
 }
 
-/** 
+/**
  * Check if the program have any output,
  * if not then exit with 1. otherwhis exit with 0.
- * 
+ *
  * @ifPrinted: the pointer to ifPrinted, show if there is any output.
 */
 void check_have_output(int* ifPrinted) {
@@ -117,353 +169,242 @@ void check_have_output(int* ifPrinted) {
     exit(0);
 }
 
-/** 
- * Setting all pattern to lowercase and find all question marks in pattern.
- * record there index and counts.
- * 
- * @qMarks: the pointer to qMarks, contain the index of all question marks.
- * @qCount: the pointer to qCount, indicate the number of questions.
+/**
+ * Printing a word straight from the mapped dictionary.
+ *
+ * @view: the word to be printed.
 */
-void handle_alpha_qmarks(int* qMarks, int* qCount) {
-    for (int i = 0; i < strlen(pattern); i++) {
-        if (pattern[i] == '?') {
-            qMarks[*qCount] = i;
-            (*qCount)++;
-        }
-        pattern[i] = (char)tolower((int)pattern[i]);
-    }
+void print_view(WordView view) {
+    fwrite(dictionary + view.offset, 1, view.length, stdout);
+    putchar('\n');
 }
 
-/** 
- * Change the str argv to lower case.
- * 
- * @str: a string with only characters.
+/**
+ * Printing the top K words best first, or alphabetically in sort mode.
+ *
+ * @top: the top K collector filled by the search.
 */
-void to_lower_case(char* str) {
-    for (int i = 0; i < strlen(str); i++) {
-        // turn all characters into lower case except '?'
-        if (isalpha(str[i])) {
-            str[i] = (char)tolower((int)str[i]);
-        }
-    }
-}
+void print_top(TopK* top) {
+    int count = topk_finish(top);
 
-/** 
- * Check if the index argv inputed have question mark on it.
- * if have return 1, otherwise return 0.
- * 
- * @index: the pointer to index, which is the index of the buffer
- * @qMarks: the pointer to qMarks, contain the index of all question marks.
- * @qCount: the pointer to qCount, indicate the number of questions.
-*/
-int if_contain_qindex(int* index, int* qMarks, int* qCount) {
-    for (int i = 0; i < *qCount; i++) {
-        if (*index == qMarks[i]) {
-            return 1;
+    if (sortStatus == 1) {
+        WordView* views =
+                (WordView*) arena_alloc(&queryArena, sizeof(WordView) * count);
+        for (int i = 0; i < count; i++) {
+            views[i] = top->items[i].view;
         }
+        sort_views(views, count, dictionary, &queryArena);
+        for (int i = 0; i < count; i++) {
+            print_view(views[i]);
+        }
+        return;
     }
-    return 0;
-}
-
-/** 
- * Initializing sortarray and count the number of string be printed. 
- * 
- * @printStrNumIndex: the pointer to printStrNumIndex, 
- * the number of string be printed start with 0.
- * @buffer: the pointer to buffer, 
- * the string going to be printed in dictionary. 
-*/
-void sortarray_initial_and_copy(int* printStrNumIndex, char* buffer) {
-    if (*printStrNumIndex > 0) {
-        wordsToSort = 
-                realloc(wordsToSort, sizeof(char*) * (*printStrNumIndex + 1));
-        wordsToSort[*printStrNumIndex] = (char*) malloc(sizeof(char) * 41);
+    for (int i = 0; i < count; i++) {
+        print_view(top->items[i].view);
     }
-    strcpy(wordsToSort[*printStrNumIndex], buffer);
-    *printStrNumIndex += 1;
 }
 
-/** 
- * Sorting the strings in wordsToSort.
- * 
- * @printStrNumIndex: the pointer to printStrNumIndex, 
- * the number of string be printed start with 0.
+/**
+ * Record a matching word: keep it for top K, keep it for sorting,
+ * or print it straight away.
+ *
+ * @query: the query.
+ * @view: the word.
+ * @weight: the word's weight.
 */
-void sort_function(int* printStrNumIndex) {
-    char temp[41];
-    
-    // sorting
-    for (int i = 0; i <= *printStrNumIndex; i++) {
-        for (int j = i + 1; j <= *printStrNumIndex; j++) {
-
-            if (strcasecmp(wordsToSort[i], wordsToSort[j]) > 0) {
-                memset(temp, '\0', 41);
-                strcpy(temp, wordsToSort[i]);
-                memset(wordsToSort[i], '\0', 41); 
-                strcpy(wordsToSort[i], wordsToSort[j]);
-                memset(wordsToSort[j], '\0', 41); 
-                strcpy(wordsToSort[j], temp);
-            }
+void add_match(Query* query, WordView view, long long weight) {
+    query->ifPrinted = 1;
+
+    if (topStatus == 1) {
+        // only the best K are kept, nothing is printed until the end
+        topk_offer(query->top, view, weight, view.offset);
+    } else if (sortStatus == 1 || query->outOfOrder) {
+        if (query->matchCount == query->matchCapacity) {
+            int capacity = query->matchCapacity == 0 ? 256
+                    : query->matchCapacity * 2;
+            query->matches = (WordView*) arena_grow(&queryArena,
+                    query->matches, sizeof(WordView) * query->matchCapacity,
+                    sizeof(WordView) * capacity);
+            query->matchCapacity = capacity;
         }
+        query->matches[query->matchCount++] = view;
+    } else {
+        print_view(view);
     }
-
-    // printing
-    for (int a = 0; a <= *printStrNumIndex; a++) {
-        printf("%s\n", wordsToSort[a]);
-    }  
 }
 
-/** 
- * Deciding if print the word directly or put it in wordToSort
- * 
- * @printStrNumIndex: the pointer to printStrNumIndex, 
- * the number of string be printed start with 0.
- * @buffer: the pointer to buffer, 
- * the string going to be printed in dictionary. 
- * @equalFlag: the pointer to equalFlag,
- * 1 indicates equal, 0 indicates not equal.
- * @ifPrinted: the pointer to ifPrinted,
- * 1 indicates printed, 0 indicates have not printed yet.
- * 
+/**
+ * Print whatever the query kept back until the end.
+ * Return 1 if anything was printed, 0 otherwise.
+ *
+ * @query: the finished query.
 */
-void if_printed_word(int* equalFlag, int* printStrNumIndex,
-        char* buffer, int* ifPrinted) {
-    if (*equalFlag) {
-        // check if need sort
-        if (sortStatus == 1) {
-            sortarray_initial_and_copy(printStrNumIndex, buffer);
-        } else {
-            printf("%s\n", buffer);
-        }
-        *ifPrinted = 1;  
+int finish_query(Query* query) {
+    if (topStatus == 1 && query->ifPrinted) {
+        print_top(query->top);
+        return 1;
     }
-    *equalFlag = 1;
-}
-
-/** 
- * Checking if sort mode on, if on, initializing wordsToSort.
-*/
-void check_sort_on() {
+    // sort printing
     if (sortStatus == 1) {
-        wordsToSort = (char**) malloc(sizeof(char*) * 1);
-        wordsToSort[0] = (char*) malloc(sizeof(char) * 41);
+        sort_views(query->matches, query->matchCount, dictionary,
+                &queryArena);
+    } else if (query->outOfOrder) {
+        sort_views_by_offset(query->matches, query->matchCount, &queryArena);
+    }
+    for (int i = 0; i < query->matchCount; i++) {
+        print_view(query->matches[i]);
     }
+    return query->ifPrinted;
 }
 
-/** 
- * Searching pattern in dictionary under EXACT MODE.
+/**
+ * Searching one pattern in the dictionary itself, line by line.
+ * Lines may carry a weight as "word<TAB>weight", only the word is
+ * matched.
+ *
+ * @dfa: the compiled pattern.
+ * @query: the query.
 */
-void search_exact() {
-    FILE* fp = fopen(filename, "r"); // open dictionary
-    char buffer[41]; // a string to contain each line in dictionary
-    char lowerCaseCopy[41]; // a string to put lowercase buffer
-    memset(buffer, '\0', 41); // initialize
-    memset(lowerCaseCopy, '\0', 41); // initialize
-    int ifPrinted = 0; // a flag to check if there is any output
-    int qMarks[40]; // a int array contain each '?' index in pattern
-    int qCount = 0; // number of '?' in pattern
-    int equalFlag = 1; // a flag to check if two strings are equal
-    int printStrNumIndex = 0; // the number of printed string start with 0
-
-    check_sort_on();
-    // get qmarks and qcount
-    handle_alpha_qmarks(qMarks, &qCount);
+void search_lines(Dfa* dfa, Query* query) {
+    const char* end = dictionary + dictionarySize; // end of dictionary
+    const char* line = dictionary; // the line being matched
+    long long weight; // weight of the word on this line
+    // a UTF-8 letter takes up to four bytes
+    int maxBytes = utf8Status ? 4 * MAX_WORD : MAX_WORD;
 
     // read dictionary
-    while (fgets(buffer, 41, fp) != NULL) {
-        if (buffer[strlen(buffer) - 1] == 10) {
-            buffer[strlen(buffer) - 1] = '\0';
+    while (line < end) {
+        const char* newline = memchr(line, '\n', end - line);
+        int length = (newline != NULL ? newline : end) - line;
+        WordView view;
+
+        view.offset = line - dictionary;
+        view.length = split_weight(line, length, &weight);
+        line += length + 1;
+        // longer words can not match
+        if (view.length > maxBytes) {
+            continue;
+        }
+        if (utf8Status ? dfa_match_utf8(dfa, dictionary + view.offset,
+                view.length) : dfa_match(dfa, dictionary + view.offset,
+                view.length)) {
+            add_match(query, view, weight);
         }
-        strcpy(lowerCaseCopy, buffer);
-        to_lower_case(lowerCaseCopy);
-
-        if (strlen(buffer) == strlen(pattern)) {
-            for (int i = 0; i < strlen(buffer); i++) {
-                // check if satisfy requirement
-                if (if_contain_qindex(&i, qMarks, &qCount)) {
-                    if (lowerCaseCopy[i] < 'a' || lowerCaseCopy[i] > 'z') {
-                        equalFlag = 0;
-                        break;
-                    } 
-                } else {
-                    if (lowerCaseCopy[i] != pattern[i]) {
-                        equalFlag = 0;
-                        break;
-                    }
-                }
-            }
-            // decide if print string directly or put it into array
-            if_printed_word(&equalFlag, &printStrNumIndex, buffer, &ifPrinted);
-        } 
-    }
-    // sort printing
-    if (sortStatus == 1 && ifPrinted) {
-        printStrNumIndex -= 1;
-        sort_function(&printStrNumIndex);
     }
-    // check if have any output
-    check_have_output(&ifPrinted); 
 }
 
-/** 
- * Searching pattern in dictionary under PREFIX MODE.
+/**
+ * Searching one pattern through the index. Only the buckets of the
+ * lengths the pattern can match are read, and their words are already
+ * lowercase letters. Matches from several buckets are put back in
+ * dictionary order at the end.
+ *
+ * @dfa: the compiled pattern.
+ * @query: the query.
 */
-void search_prefix() {
-    FILE* fp = fopen(filename, "r"); // open dictionary
-    char buffer[41]; // a string to contain each line in dictionary
-    char lowerCaseCopy[41]; // a string to put lowercase buffer
-    memset(buffer, '\0', 41); // initialize
-    memset(lowerCaseCopy, '\0', 41); // initialize
-    int ifPrinted = 0; // a flag to check if there is any output
-    int qMarks[40]; // a int array contain each '?' index in pattern
-    int qCount = 0; // number of '?' in pattern
-    int equalFlag = 1; // a flag to check if two strings are equal
-    int printStrNumIndex = 0; // the number of printed string start with 0
-    check_sort_on();
-    handle_alpha_qmarks(qMarks, &qCount); // get qmarks and qcount
-    
-    while (fgets(buffer, 41, fp) != NULL) { // read dictionary
-        if (buffer[strlen(buffer) - 1] == 10) {
-            buffer[strlen(buffer) - 1] = '\0';
-        }
-        strcpy(lowerCaseCopy, buffer);
-        to_lower_case(lowerCaseCopy);
-        
-        if (strlen(buffer) >= strlen(pattern)) {
-            for (int i = 0; i < strlen(buffer); i++) {
-                if (i < strlen(pattern)) { // check if satisfy requirement
-                    if (if_contain_qindex(&i, qMarks, &qCount)) {
-                        if (lowerCaseCopy[i] < 'a' || lowerCaseCopy[i] > 'z') {
-                            equalFlag = 0;
-                            break;
-                        } 
-                    } else {
-                        if (lowerCaseCopy[i] != pattern[i]) {
-                            equalFlag = 0;
-                            break;
-                        }
-                    }
-                } else {
-                    if (!isalpha(buffer[i])) {
-                        equalFlag = 0;
-                        break;
-                    }
-                }     
-            }
-            if_printed_word(&equalFlag, &printStrNumIndex, buffer, &ifPrinted);
-        } 
+void search_buckets(Dfa* dfa, Query* query) {
+    int minLength;
+    int maxLength;
+
+    dfa_length_range(dfa, &minLength, &maxLength);
+    if (minLength < 1) {
+        minLength = 1;
     }
-    if (sortStatus == 1 && ifPrinted) { // sort printing
-        printStrNumIndex -= 1;
-        sort_function(&printStrNumIndex);
+    query->outOfOrder = minLength < maxLength;
+
+    for (int length = minLength; length <= maxLength; length++) {
+        const IndexEntry* entries = index_entries(dictIndex, length);
+        const char* image = index_image(dictIndex, length);
+        uint64_t count = dictIndex->buckets[length].count;
+
+        for (uint64_t i = 0; i < count; i++) {
+            if (dfa_match(dfa, image + i * length, length)) {
+                WordView view;
+                view.offset = entries[i].offset;
+                view.length = length;
+                add_match(query, view, entries[i].weight);
+            }
+        }
     }
-    check_have_output(&ifPrinted);  // check if have any output
 }
 
-/** 
- * Moving the index in qMarks for ANYWHERE MODE
- * 
- * @qMarks: the pointer to qMarks, contain the index of all question marks.
- * @j: the pointer to j, which is the number of index moved.
- * @qCount: the pointer to qCount, indicate the number of questions.
- * @qMarksCopy: the pointer to qMarksCopy, a copy of qMarks
+/**
+ * Searching one pattern in dictionary. Every mode is handled by the
+ * same single pass, the anchoring lives in the DFA.
+ * Everything the query needs comes from queryArena, so once the arena
+ * has grown to fit a query no more heap calls are made.
+ * Return 1 if anything was printed, 0 otherwise.
+ *
+ * @text: a valid pattern.
 */
-void change_qmarks_index(int* qMarks, int* j, int* qCount, int* qMarksCopy) {
-    for (int i = 0; i < *qCount; i++) {
-        qMarksCopy[i] = qMarks[i] + *j;
+int search_dictionary(const char* text) {
+    Query query;
+
+    arena_reset(&queryArena);
+    memset(&query, 0, sizeof(Query));
+    Dfa* dfa = dfa_compile(text, optMode, utf8Status, &queryArena);
+    if (topStatus == 1) {
+        query.top = topk_create(topLimit, &queryArena);
+    }
+
+    if (dictIndex != NULL) {
+        search_buckets(dfa, &query);
+    } else {
+        search_lines(dfa, &query);
     }
+    return finish_query(&query);
 }
 
-/** 
- * Searching pattern in dictionary under ANYWHERE MODE.
+/**
+ * Running every pattern read from stdin, one per line, against the
+ * dictionary. Each query's output ends with an empty line.
+ * Return 1 if any query printed something, 0 otherwise.
 */
-void search_anywhere() {
-    FILE* fp = fopen(filename, "r"); // open dictionary
-    char buffer[41]; // a string to contain each line in dictionary
-    char lowerCaseCopy[41]; // a string to put lowercase buffer
-    memset(buffer, '\0', 41); // initialize
-    memset(lowerCaseCopy, '\0', 41); // initialize
-    int ifPrinted = 0; // a flag to check if there is any output
-    int qMarks[40]; // a int array contain each '?' index in pattern
-    int qMarksCopy[40]; // a copy of qMarks
-    int qCount = 0; // number of '?' in pattern
-    int equalFlag = 1; // a flag to check if two strings are equal
-    int strPrinted = 0; // a flag to check if this string has printed before
-    int printStrNumIndex = 0; // the number of printed string start with 0
-
-    check_sort_on();
-
-    // get qmarks and qcount
-    handle_alpha_qmarks(qMarks, &qCount);
-
-    // read file
-    while (fgets(buffer, 41, fp) != NULL) {
-        if (buffer[strlen(buffer) - 1] == 10) {
-            buffer[strlen(buffer) - 1] = '\0';
+int search_batch() {
+    char* buffer = NULL; // one pattern per line
+    size_t bufferSize = 0; // allocated size of buffer
+    ssize_t length;
+    int ifPrinted = 0;
+
+    while ((length = getline(&buffer, &bufferSize, stdin)) != -1) {
+        if (length > 0 && buffer[length - 1] == '\n') {
+            buffer[length - 1] = '\0';
         }
-        strcpy(lowerCaseCopy, buffer);
-        to_lower_case(lowerCaseCopy);
-        // reset strPrinted, because here enter a new line in file
-        strPrinted = 0;
-
-        // moving index
-        for (int j = 0; j <= (strlen(buffer) - strlen(pattern)); j++) {
-            change_qmarks_index(qMarks, &j, &qCount, qMarksCopy);
-            if (strPrinted) {
-                break;
-            }
-            if (strlen(pattern) > strlen(buffer)) {
-                break;
-            }
-            // read buffer
-            for (int i = 0; i < strlen(buffer); i++) {
-                if (j <= i && i < (strlen(pattern) + j)) {
-                    if (if_contain_qindex(&i, qMarksCopy, &qCount)) {
-                        if (lowerCaseCopy[i] < 'a' || lowerCaseCopy[i] > 'z') {
-                            equalFlag = 0;
-                            break;
-                        } 
-                    } else {
-                        if (lowerCaseCopy[i] != pattern[i - j]) {
-                            equalFlag = 0;
-                            break;
-                        }
-                    }
-                } else {
-                    if (!isalpha(buffer[i])) {
-                        equalFlag = 0;
-                        break;
-                    }
-                }     
-            }
-
-            // decide if print string directly or put it into array
-            if (equalFlag) {
-                if (sortStatus == 1) {
-                    sortarray_initial_and_copy(&printStrNumIndex, buffer);
-                } else {
-                    printf("%s\n", buffer);
-                }
-                strPrinted = 1;
-                ifPrinted = 1;
-            }
-            equalFlag = 1;
+        if (check_pattern(buffer)) {
+            ifPrinted |= search_dictionary(buffer);
         }
+        putchar('\n');
     }
-    // sort printing
-    if (sortStatus == 1 && ifPrinted) {
-        printStrNumIndex -= 1;
-        sort_function(&printStrNumIndex);
-    }
+    return ifPrinted;
+}
 
-    // check if have any output
-    check_have_output(&ifPrinted);    
+/**
+ * Collect K for "-top K" from the next argument, it must be
+ * a positive number and -top may only be given once.
+ *
+ * @argc: the number of argvs.
+ * @argv: the arguments inputed in cmd line.
+ * @i: the pointer to i, the index of "-top", moved past K.
+*/
+void handle_top(int argc, char** argv, int* i) {
+    char* end;
+
+    if (topStatus != 0 || *i + 1 >= argc) {
+        arg_error();
+    }
+    long limit = strtol(argv[*i + 1], &end, 10);
+    if (*end != '\0' || limit <= 0 || limit > 1000000) {
+        arg_error();
+    }
+    topStatus = 1;
+    topLimit = (int)limit;
+    *i += 1;
 }
 
-/** 
+/**
  * Checking if the arguments input satisfy the requirements,
  * if not sent error message and exit by 1.
- * 
+ *
  * @argc: the number of argvs.
  * @argv: the arguments inputed in cmd line.
 */
@@ -473,6 +414,21 @@ void arg_checking(int argc, char** argv) {
         arg_error();
     }
 
+    // batch and UTF-8 mode change how the positional arguments are read
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-batch") == 0) {
+            if (batchStatus != 0) {
+                arg_error();
+            }
+            batchStatus = 1;
+        } else if (strcmp(argv[i], "-utf8") == 0) {
+            if (utf8Status != 0) {
+                arg_error();
+            }
+            utf8Status = 1;
+        }
+    }
+
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-exact") == 0) {
             if (optionStatus != 0) {
@@ -497,6 +453,16 @@ void arg_checking(int argc, char** argv) {
                 arg_error();
             }
             sortStatus = 1;
+        } else if (strcmp(argv[i], "-top") == 0) {
+            handle_top(argc, argv, &i);
+        } else if (strcmp(argv[i], "-batch") == 0
+                || strcmp(argv[i], "-utf8") == 0) {
+            continue;
+        } else if (strcmp(argv[i], "-index") == 0) {
+            if (indexPath != NULL || i + 1 >= argc) {
+                arg_error();
+            }
+            indexPath = arena_strdup(&programArena, argv[++i]);
         } else if (argv[i][0] != '-') { // check if it is a pattern or path
             handle_pat_path(argv[i]);
         } else {
@@ -504,40 +470,92 @@ void arg_checking(int argc, char** argv) {
         }
     }
 
-    if (pattern == NULL) {
+    if (pattern == NULL && batchStatus == 0) {
         arg_error();
     }
 
     handle_default();
 }
 
-/** 
+/**
+ * Mapping the dictionary into memory. Files that can not be mapped,
+ * like pipes, are read into the program arena instead.
+ * Return 0 on success, -1 if the file can not be opened.
+*/
+int load_dictionary() {
+    struct stat info;
+    int fd = open(filename, O_RDONLY);
+
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+        dictionarySize = info.st_size;
+        dictionaryMtime = info.st_mtime;
+        dictionary = "";
+        if (dictionarySize > 0) {
+            dictionary = mmap(NULL, dictionarySize, PROT_READ, MAP_PRIVATE,
+                    fd, 0);
+        }
+        if (dictionary != MAP_FAILED) {
+            close(fd);
+            return 0;
+        }
+    }
+
+    // not a regular file, read it whole
+    size_t capacity = 0;
+    ssize_t got = 0;
+    char* data = NULL;
+    dictionarySize = 0;
+    do {
+        dictionarySize += got;
+        if (dictionarySize == capacity) {
+            size_t bigger = capacity == 0 ? ARENA_CHUNK : capacity * 2;
+            data = (char*) arena_grow(&programArena, data, capacity, bigger);
+            capacity = bigger;
+        }
+    } while ((got = read(fd, data + dictionarySize,
+            capacity - dictionarySize)) > 0);
+    dictionary = data;
+    close(fd);
+    return 0;
+}
+
+/**
  * Checking if filename path valid and choose search mode.
 */
 void search_func() {
-    FILE* fp = fopen(filename, "r");
+    int ifPrinted;
 
-    if (fp == NULL) {
+    if (load_dictionary() < 0) {
         fprintf(stderr, "search: file \"%s\" can not be opened\n", filename);
         exit(1);
     }
 
-    if (optMode == EXACT) {
-        search_exact();
-    } 
-    
-    if (optMode == PREFIX) {
-        search_prefix();
-    } 
-    
-    if (optMode == ANYWHERE) {
-        search_anywhere();
+    // a missing or stale index only costs speed
+    if (indexPath != NULL && utf8Status == 1) {
+        fprintf(stderr, "search: index \"%s\" only holds ASCII words, "
+                "searching the dictionary\n", indexPath);
+    } else if (indexPath != NULL) {
+        dictIndex = index_load(indexPath, dictionarySize, dictionaryMtime);
+        if (dictIndex == NULL) {
+            fprintf(stderr, "search: index \"%s\" can not be used, "
+                    "searching the dictionary\n", indexPath);
+        }
     }
 
+    if (batchStatus == 1) {
+        ifPrinted = search_batch();
+    } else {
+        ifPrinted = search_dictionary(pattern);
+    }
+    // check if have any output
+    check_have_output(&ifPrinted);
 }
 
 int main(int argc, char** argv) {
-    // argument checking 
+    // argument checking
     arg_checking(argc, argv);
 
     // search keyword
@@ -0,0 +1,176 @@
+#include <stdint.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "utf8.h"
+
+/* a run of code points that fold by adding delta */
+typedef struct {
+    int first; /* first code point of the run */
+    int last; /* last code point of the run */
+    int stride; /* 1 for every code point, 2 for every other one */
+    int delta; /* added to fold a code point of the run */
+} FoldRange;
+
+/*
+ * Simple case folding for the Latin, Greek and Cyrillic blocks, taken
+ * from Unicode's CaseFolding.txt (status C and S). Runs that alternate
+ * upper and lower case use stride 2 starting on the upper case letter.
+ */
+static const FoldRange foldTable[] = {
+    {0x0041, 0x005A, 1, 32}, {0x00B5, 0x00B5, 1, 775},
+    {0x00C0, 0x00D6, 1, 32}, {0x00D8, 0x00DE, 1, 32},
+    {0x0100, 0x012E, 2, 1}, {0x0132, 0x0136, 2, 1},
+    {0x0139, 0x0147, 2, 1}, {0x014A, 0x0176, 2, 1},
+    {0x0178, 0x0178, 1, -121}, {0x0179, 0x017D, 2, 1},
+    {0x017F, 0x017F, 1, -268}, {0x01CD, 0x01DB, 2, 1},
+    {0x01DE, 0x01EE, 2, 1}, {0x01F8, 0x021E, 2, 1},
+    {0x0222, 0x0232, 2, 1}, {0x0386, 0x0386, 1, 38},
+    {0x0388, 0x038A, 1, 37}, {0x038C, 0x038C, 1, 64},
+    {0x038E, 0x038F, 1, 63}, {0x0391, 0x03A1, 1, 32},
+    {0x03A3, 0x03AB, 1, 32}, {0x03C2, 0x03C2, 1, 1},
+    {0x0400, 0x040F, 1, 80}, {0x0410, 0x042F, 1, 32},
+    {0x0460, 0x0480, 2, 1}, {0x048A, 0x04BE, 2, 1},
+    {0x04C0, 0x04C0, 1, 15}, {0x04C1, 0x04CD, 2, 1},
+    {0x04D0, 0x052E, 2, 1}, {0x1E00, 0x1E94, 2, 1},
+    {0x1E9E, 0x1E9E, 1, -7615}, {0x1EA0, 0x1EFE, 2, 1},
+};
+
+/* the code points counted as letters besides 'a'..'z' and 'A'..'Z' */
+static const int letterRanges[][2] = {
+    {0x00B5, 0x00B5}, {0x00C0, 0x00D6}, {0x00D8, 0x00F6},
+    {0x00F8, 0x02AF}, {0x0386, 0x0386}, {0x0388, 0x038A},
+    {0x038C, 0x038C}, {0x038E, 0x03A1}, {0x03A3, 0x03FF},
+    {0x0400, 0x0481}, {0x048A, 0x052F}, {0x1E00, 0x1EFF},
+};
+
+/**
+ * Return 1 if the bytes are all ASCII. Sixteen bytes are tested at a
+ * time with SSE2 where it is available and eight at a time otherwise,
+ * so English words get to the byte matcher for almost nothing.
+ *
+ * @str: the bytes.
+ * @length: the number of bytes.
+*/
+int utf8_is_ascii(const char* str, int length) {
+    int i = 0;
+
+#ifdef __SSE2__
+    for (; i + 16 <= length; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*)(str + i));
+        if (_mm_movemask_epi8(block) != 0) {
+            return 0;
+        }
+    }
+#endif
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, str + i, 8);
+        if (word & 0x8080808080808080ULL) {
+            return 0;
+        }
+    }
+    for (; i < length; i++) {
+        if (str[i] & 0x80) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Decode the code point at the start of str. Return the number of
+ * bytes it takes, or -1 for a malformed, overlong or truncated
+ * sequence.
+ *
+ * @str: the bytes.
+ * @length: the number of bytes available.
+ * @codePoint: the pointer to codePoint, set to the decoded value.
+*/
+int utf8_decode(const char* str, int length, int* codePoint) {
+    const unsigned char* s = (const unsigned char*)str;
+    int size;
+    int value;
+
+    if (s[0] < 0x80) {
+        *codePoint = s[0];
+        return 1;
+    } else if ((s[0] & 0xE0) == 0xC0) {
+        size = 2;
+        value = s[0] & 0x1F;
+    } else if ((s[0] & 0xF0) == 0xE0) {
+        size = 3;
+        value = s[0] & 0x0F;
+    } else if ((s[0] & 0xF8) == 0xF0) {
+        size = 4;
+        value = s[0] & 0x07;
+    } else {
+        return -1;
+    }
+    if (size > length) {
+        return -1;
+    }
+    for (int i = 1; i < size; i++) {
+        if ((s[i] & 0xC0) != 0x80) {
+            return -1;
+        }
+        value = (value << 6) | (s[i] & 0x3F);
+    }
+    // reject overlong forms, surrogates and values past U+10FFFF
+    if ((size == 2 && value < 0x80) || (size == 3 && value < 0x800)
+            || (size == 4 && value < 0x10000) || value > 0x10FFFF
+            || (value >= 0xD800 && value <= 0xDFFF)) {
+        return -1;
+    }
+    *codePoint = value;
+    return size;
+}
+
+/**
+ * Return the simple case fold of a code point, or the code point
+ * itself if it has none.
+ *
+ * @codePoint: the code point.
+*/
+int utf8_fold(int codePoint) {
+    int low = 0;
+    int high = sizeof(foldTable) / sizeof(foldTable[0]) - 1;
+
+    // the ranges are sorted and do not overlap
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        const FoldRange* range = &foldTable[middle];
+        if (codePoint < range->first) {
+            high = middle - 1;
+        } else if (codePoint > range->last) {
+            low = middle + 1;
+        } else {
+            if ((codePoint - range->first) % range->stride == 0) {
+                return codePoint + range->delta;
+            }
+            return codePoint;
+        }
+    }
+    return codePoint;
+}
+
+/**
+ * Return 1 if a code point is a letter search can match.
+ *
+ * @codePoint: the code point.
+*/
+int utf8_is_letter(int codePoint) {
+    if (codePoint < 0x80) {
+        return (codePoint >= 'a' && codePoint <= 'z')
+                || (codePoint >= 'A' && codePoint <= 'Z');
+    }
+    for (int i = 0; i < sizeof(letterRanges) / sizeof(letterRanges[0]);
+            i++) {
+        if (codePoint >= letterRanges[i][0]
+                && codePoint <= letterRanges[i][1]) {
+            return 1;
+        }
+    }
+    return 0;
+}
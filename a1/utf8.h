@@ -0,0 +1,12 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+int utf8_is_ascii(const char* str, int length);
+
+int utf8_decode(const char* str, int length, int* codePoint);
+
+int utf8_fold(int codePoint);
+
+int utf8_is_letter(int codePoint);
+
+#endif
@@ -0,0 +1,45 @@
+#!/bin/sh
+# Benchmark the chat server. Rooms of 10, 100 and 1000 clientbots, and
+# one from swarmgen of 2000 clientbots run 100 to a child, play ROUNDS
+# rounds recorded with -record, then replaybot -stats reports the
+# rounds/sec, messages/sec and turn latencies of each trace. Extra server
+# options can be given in BENCH_FLAGS, e.g. BENCH_FLAGS="-concurrent".
+set -e
+cd "$(dirname "$0")"
+ROUNDS=${ROUNDS:-20}
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+# two descriptors per child stay open in the server
+ulimit -n 8192 2>/dev/null || true
+
+# one client says "ping" every turn, every tenth bot answers it
+i=0
+while [ $i -lt "$ROUNDS" ]; do
+    printf 'CHAT:ping\nDONE:\n'
+    i=$((i + 1))
+done > "$dir/pinger.txt"
+printf 'ping:pong\n' > "$dir/answer.txt"
+printf 'zzzz:never\n' > "$dir/quiet.txt"
+
+for bots in 10 100 1000; do
+    echo "./client:$dir/pinger.txt" > "$dir/room"
+    i=0
+    while [ $i -lt $bots ]; do
+        if [ $((i % 10)) -eq 0 ]; then
+            echo "./clientbot:$dir/answer.txt"
+        else
+            echo "./clientbot:$dir/quiet.txt"
+        fi
+        i=$((i + 1))
+    done >> "$dir/room"
+    echo "== $bots clientbots"
+    ./server $BENCH_FLAGS -rounds "$ROUNDS" -record "$dir/trace" \
+            "$dir/room" > /dev/null
+    ./replaybot -stats "$dir/trace"
+done
+
+./swarmgen -bots 2000 -swarm 100 -rounds "$ROUNDS" "$dir/swarm" > /dev/null
+echo "== 2000 clientbots in swarms of 100"
+./server $BENCH_FLAGS -rounds "$ROUNDS" -record "$dir/trace" \
+        "$dir/swarm/room" > /dev/null
+./replaybot -stats "$dir/trace"
@@ -0,0 +1,268 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "chatlog.h"
+
+/******************************************************************************
+* Function Name  : chunk_create()
+* Description    : Allocate an empty chunk
+* Input          : None
+* Return         : The chunk
+******************************************************************************/
+static LogChunk* chunk_create() {
+    LogChunk* chunk = (LogChunk*)malloc(sizeof(LogChunk));
+
+    chunk->next = NULL;
+    chunk->capacity = LOG_CHUNK + 1024;
+    chunk->data = (char*)malloc(chunk->capacity);
+    chunk->length = 0;
+    return chunk;
+}
+
+/******************************************************************************
+* Function Name  : open_file(ChatLog* log)
+* Description    : Open the log file for appending and note its size
+* Input          : ChatLog* log;
+* Return         : 0 on success, -1 if it cannot be opened
+******************************************************************************/
+static int open_file(ChatLog* log) {
+    struct stat status;
+
+    log->fd = open(log->path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+            0644);
+    if (log->fd < 0) {
+        return -1;
+    }
+    log->size = fstat(log->fd, &status) == 0 ? status.st_size : 0;
+    return 0;
+}
+
+/******************************************************************************
+* Function Name  : write_all(ChatLog* log, const char* data, int length)
+* Description    : Write bytes to the log, records that cannot be written
+*                  are lost
+* Input          : ChatLog* log;
+*                  const char* data;
+*                  int length;
+* Return         : None
+******************************************************************************/
+static void write_all(ChatLog* log, const char* data, int length) {
+    int written = 0;
+
+    while (written < length) {
+        ssize_t count = write(log->fd, data + written, length - written);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            break;
+        }
+        written += count;
+    }
+    log->size += written;
+}
+
+/******************************************************************************
+* Function Name  : write_chunk(ChatLog* log, LogChunk* chunk)
+* Description    : Write a chunk out. A log file is filled with the whole
+*                  records that fit, then moved to path.1, replacing the
+*                  one before, and a new file started. Only a record
+*                  longer than the size makes a file pass it
+* Input          : ChatLog* log;
+*                  LogChunk* chunk;
+* Return         : None
+******************************************************************************/
+static void write_chunk(ChatLog* log, LogChunk* chunk) {
+    char* data = chunk->data;
+    int length = chunk->length;
+
+    while (log->path != NULL && log->maxSize > 0
+            && log->size + length > log->maxSize) {
+        // the records that still fit, up to the last newline in reach
+        int room = log->maxSize - log->size;
+        int fit = 0;
+        for (int i = 0; i < room; i++) {
+            if (data[i] == '\n') {
+                fit = i + 1;
+            }
+        }
+        if (fit == 0 && log->size == 0) {
+            // a record longer than a whole file gets one to itself
+            fit = (char*)memchr(data, '\n', length) - data + 1;
+        }
+        write_all(log, data, fit);
+        data += fit;
+        length -= fit;
+        if (length == 0) {
+            return;
+        }
+        char rotated[strlen(log->path) + 3];
+        sprintf(rotated, "%s.1", log->path);
+        close(log->fd);
+        rename(log->path, rotated);
+        if (open_file(log) < 0) {
+            return;
+        }
+    }
+    write_all(log, data, length);
+}
+
+/******************************************************************************
+* Function Name  : writer_main(void* data)
+* Description    : The writer thread, write the chunks handed over in order
+*                  and keep them for reuse, until the log is closed
+* Input          : void* data; the ChatLog
+* Return         : NULL
+******************************************************************************/
+static void* writer_main(void* data) {
+    ChatLog* log = (ChatLog*)data;
+    LogChunk* chunk;
+
+    pthread_mutex_lock(&log->lock);
+    while (1) {
+        while (log->head == NULL && !log->closing) {
+            pthread_cond_wait(&log->wake, &log->lock);
+        }
+        if (log->head == NULL) {
+            break;
+        }
+        chunk = log->head;
+        log->head = chunk->next;
+        if (log->head == NULL) {
+            log->tail = NULL;
+        }
+        // the server's thread only waits for the lock, never the write
+        pthread_mutex_unlock(&log->lock);
+        write_chunk(log, chunk);
+        pthread_mutex_lock(&log->lock);
+        chunk->length = 0;
+        chunk->next = log->spare;
+        log->spare = chunk;
+    }
+    pthread_mutex_unlock(&log->lock);
+    return NULL;
+}
+
+/******************************************************************************
+* Function Name  : chat_log_open(ChatLog* log, char* path, long maxSize)
+* Description    : Start a log and its writer thread. The thread takes the
+*                  calling thread's signal mask
+* Input          : ChatLog* log;
+*                  char* path; the log file, NULL for stdout
+*                  long maxSize; size the file is rotated at, 0 for never
+* Return         : 0 on success, -1 if the file cannot be opened
+******************************************************************************/
+int chat_log_open(ChatLog* log, char* path, long maxSize) {
+    memset(log, 0, sizeof(ChatLog));
+    log->path = path;
+    log->maxSize = maxSize;
+    log->fd = STDOUT_FILENO;
+    if (path != NULL && open_file(log) < 0) {
+        return -1;
+    }
+    log->current = chunk_create();
+    pthread_mutex_init(&log->lock, NULL);
+    pthread_cond_init(&log->wake, NULL);
+    pthread_create(&log->writer, NULL, writer_main, log);
+    return 0;
+}
+
+/******************************************************************************
+* Function Name  : chat_log_printf(ChatLog* log, const char* format, ...)
+* Description    : Add a record to the current chunk, which is handed over
+*                  once it is full
+* Input          : ChatLog* log;
+*                  const char* format;
+*                  ...; as for printf
+* Return         : None
+******************************************************************************/
+void chat_log_printf(ChatLog* log, const char* format, ...) {
+    LogChunk* chunk = log->current;
+    va_list args;
+    int length;
+
+    va_start(args, format);
+    length = vsnprintf(chunk->data + chunk->length,
+            chunk->capacity - chunk->length, format, args);
+    va_end(args);
+    if (chunk->length + length >= chunk->capacity) {
+        // too long for the room left, grow the chunk and format again
+        chunk->capacity = chunk->length + length + 1;
+        chunk->data = (char*)realloc(chunk->data, chunk->capacity);
+        va_start(args, format);
+        vsnprintf(chunk->data + chunk->length,
+                chunk->capacity - chunk->length, format, args);
+        va_end(args);
+    }
+    chunk->length += length;
+    if (chunk->length >= LOG_CHUNK) {
+        chat_log_flush(log);
+    }
+}
+
+/******************************************************************************
+* Function Name  : chat_log_flush(ChatLog* log)
+* Description    : Hand the current chunk to the writer and carry on in a
+*                  spare one, the records are written in the background
+* Input          : ChatLog* log;
+* Return         : None
+******************************************************************************/
+void chat_log_flush(ChatLog* log) {
+    LogChunk* chunk = log->current;
+
+    if (chunk->length == 0) {
+        return;
+    }
+    pthread_mutex_lock(&log->lock);
+    if (log->tail == NULL) {
+        log->head = chunk;
+    } else {
+        log->tail->next = chunk;
+    }
+    log->tail = chunk;
+    log->current = log->spare;
+    if (log->current != NULL) {
+        log->spare = log->current->next;
+        log->current->next = NULL;
+    }
+    pthread_cond_signal(&log->wake);
+    pthread_mutex_unlock(&log->lock);
+    if (log->current == NULL) {
+        log->current = chunk_create();
+    }
+}
+
+/******************************************************************************
+* Function Name  : chat_log_close(ChatLog* log)
+* Description    : Hand over what is left, wait for the writer to write
+*                  everything and free the log
+* Input          : ChatLog* log;
+* Return         : None
+******************************************************************************/
+void chat_log_close(ChatLog* log) {
+    LogChunk* chunk;
+
+    chat_log_flush(log);
+    pthread_mutex_lock(&log->lock);
+    log->closing = 1;
+    pthread_cond_signal(&log->wake);
+    pthread_mutex_unlock(&log->lock);
+    pthread_join(log->writer, NULL);
+
+    log->current->next = log->spare;
+    for (chunk = log->current; chunk != NULL; chunk = log->current) {
+        log->current = chunk->next;
+        free(chunk->data);
+        free(chunk);
+    }
+    pthread_mutex_destroy(&log->lock);
+    pthread_cond_destroy(&log->wake);
+    if (log->path != NULL) {
+        close(log->fd);
+    }
+}
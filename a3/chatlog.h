@@ -0,0 +1,45 @@
+#ifndef CHATLOG_H
+#define CHATLOG_H
+
+#include <pthread.h>
+
+/* records are handed to the writer once a chunk holds this many bytes,
+ * even before the end of the round */
+#define LOG_CHUNK (64 * 1024)
+
+/* formatted records waiting to be written */
+typedef struct LogChunk {
+    struct LogChunk* next; /* the chunk handed over after it */
+    char* data; /* the records, each ending in a newline */
+    int length; /* bytes used in data */
+    int capacity; /* size of data */
+} LogChunk;
+
+/* the chat's event log. Records are formatted into a chunk by the
+ * server's thread and written out by a thread of its own, to stdout or
+ * to an append-only file rotated once it reaches a size */
+typedef struct {
+    LogChunk* current; /* chunk records are added to */
+    LogChunk* head; /* chunks handed over, oldest first */
+    LogChunk* tail; /* the last chunk handed over */
+    LogChunk* spare; /* written chunks kept for reuse */
+    pthread_mutex_t lock; /* guards head, tail, spare and closing */
+    pthread_cond_t wake; /* signals the writer */
+    pthread_t writer; /* the writing thread */
+    int closing; /* the writer ends once the chunks are written */
+    int fd; /* where records are written */
+    char* path; /* the log file, NULL when writing to stdout */
+    long maxSize; /* size the file is rotated at, 0 for never */
+    long size; /* bytes in the file */
+} ChatLog;
+
+int chat_log_open(ChatLog* log, char* path, long maxSize);
+
+void chat_log_printf(ChatLog* log, const char* format, ...)
+        __attribute__((format(printf, 2, 3)));
+
+void chat_log_flush(ChatLog* log);
+
+void chat_log_close(ChatLog* log);
+
+#endif
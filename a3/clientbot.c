@@ -1,421 +1,737 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <ctype.h>
-#include "function.h"
-
-/* A linked list structure */
-typedef struct Node {
-    char* stimulus; /* stimulus */
-    char* response; /* response */
-    struct Node* next; /* Pointer point to the next Node */
-} Dictionary;
-
-/******************************************************************************
-* Function Name  : print_head(Dictionary* head)
-* Description    : Print the linked list node by node with 
-*                  stiumulus and response
-* Input          : Dictionary* head;
-* Return         : None
-******************************************************************************/
-void print_head(Dictionary* head) {
-    Dictionary* current = head;
-    int i = 0;
-
-    while (current != NULL) {
-        printf("%dstimulus: %s\n", i, current->stimulus);
-        printf("%dresponse: %s\n", i, current->response);
-        current = current->next;
-        i++;
-    }
-}
-
-/******************************************************************************
-* Function Name  : print_reply(Dictionary* reply)
-* Description    : Print the linked list node by node with  
-*                  all response clientbot need to reply
-* Input          : Dictionary* reply;
-* Return         : None
-******************************************************************************/
-void print_reply(Dictionary* reply) {
-    Dictionary* current = NULL;
-    current = (Dictionary*) calloc(1, sizeof(Dictionary));
-    current = reply;
-
-    while (current != NULL) {
-        if (current->response != NULL) {
-            printf("CHAT:%s\n", current->response);
-            fflush(stdout);
-        }
-        current = current->next;
-    }
-}
-
-/******************************************************************************
-* Function Name  : add_node(Dictionary* head, char* stimulus, char* response)
-* Description    : Add node to the linked list with parameters
-*                  stimulus and response
-* Input          : Dictionary* head;
-*                  char* stimulus; 
-*                  char* response;
-* Return         : None
-******************************************************************************/
-void add_node(Dictionary* head, char* stimulus, char* response) {
-    Dictionary* current = head;
-
-    while (current->next != NULL) {
-        current = current->next;
-    }
-    
-    current->next = (Dictionary*) malloc(sizeof(Dictionary));
-    current->next->response = 
-            (char*)malloc(sizeof(char) * (strlen(response) + 1));
-    current->next->stimulus = 
-            (char*)malloc(sizeof(char) * (strlen(stimulus) + 1));
-    memset(current->next->response, '\0', (strlen(response) + 1));
-    memset(current->next->stimulus, '\0', (strlen(stimulus) + 1));
-    stpcpy(current->next->stimulus, stimulus);
-    stpcpy(current->next->response, response);
-    current->next->next = NULL;
-}
-
-/******************************************************************************
-* Function Name  : add_head(Dictionary* head, char* stimulus, char* response)
-* Description    : Add head node with parameters stimulus and response
-* Input          : Dictionary* head;
-*                  char* stimulus; 
-*                  char* response;
-* Return         : None
-******************************************************************************/
-void add_head(Dictionary* head, char* stimulus, char* response) {
-    head->response = (char*)malloc(sizeof(char) * (strlen(response) + 1));
-    head->stimulus = (char*)malloc(sizeof(char) * (strlen(stimulus) + 1));
-    memset(head->response, '\0', (strlen(response) + 1));
-    memset(head->stimulus, '\0', (strlen(stimulus) + 1));
-    stpcpy(head->stimulus, stimulus);
-    stpcpy(head->response, response);
-    head->next = NULL;
-}
-
-/******************************************************************************
-* Function Name  : free_linked_list(Dictionary* head)
-* Description    : Free a linked list  
-* Input          : Dictionary* head;
-* Return         : None
-******************************************************************************/
-void free_linked_list(Dictionary* head) {
-    Dictionary* current = head;
-    Dictionary* temp = NULL;
-    // head = head->next;
-    while (current != NULL) {
-        temp = current->next;
-        free(current);
-        current = temp;
-    }
-}
-
-/******************************************************************************
-* Function Name  : to_lower_case(char* string)
-* Description    : replace all characters in the string to lower case
-* Input          : char* string;
-* Return         : None
-******************************************************************************/
-void to_lower_case(char* string) {
-    for (int i = 0; i < strlen(string); i++) {
-        // turn all characters into lower case except '?'
-        if (isalpha(string[i])) {
-            string[i] = (char)tolower((int)string[i]);
-        }
-    }
-}
-
-/******************************************************************************
-* Function Name  : args_error()
-* Description    : Report client usage error with error message
-*                  "Usage: clientbot responsefile" with exit code 1
-* Input          : None
-* Return         : None
-******************************************************************************/
-void args_error() {
-    fprintf(stderr, "Usage: clientbot responsefile\n");
-    exit(1);
-}
-
-/******************************************************************************
-* Function Name  : arg_checking(int argc, char** argv)
-* Description    : Check if the arguments input in command line is correct
-* Input          : int argc;
-*                  char** argv;
-* Return         : None
-******************************************************************************/
-void arg_checking(int argc, char** argv) {
-    FILE* fp = fopen(argv[1], "r");
-
-    if (argc != 2 || fp == NULL) {
-        args_error();
-    }
-}
-
-/******************************************************************************
-* Function Name  : name_reply(int* nameTakenNum, char** name) 
-* Description    : According to the nameTakenNum, reply clientbot 
-*                  name to server 
-* Input          : int* nameTakenNum;
-*                  char** name;
-* Return         : None
-******************************************************************************/
-void name_reply(int* nameTakenNum, char** name) {
-    int numLength = 0;
-
-    if (*nameTakenNum == -1) {
-        printf("NAME:clientbot\n");
-        fflush(stdout);
-        strcpy(*name, "clientbot");
-    } else {
-        printf("NAME:clientbot%d\n", *nameTakenNum);
-        fflush(stdout);
-        int_length(nameTakenNum, &numLength);
-        free(*name);
-        *name = (char*)malloc(sizeof(char) * (numLength + 7));
-        sprintf(*name, "clientbot%d", *nameTakenNum);
-    }
-}
-
-/******************************************************************************
-* Function Name  : collect_stimulus_response
-*                  (char* buffer, int* ifhead, Dictionary* head)
-* Description    : Collect stimulus and response and add them to linked list
-* Input          : char* buffer;
-*                  int* ifhead;
-*                  Dictionary* head;
-* Return         : None
-******************************************************************************/
-void collect_stimulus_response(char* buffer, int* ifhead, Dictionary* head) {
-    char* response = (char*)malloc(sizeof(char) * (strlen(buffer)));
-    char* stimulus = (char*)malloc(sizeof(char) * (strlen(buffer)));
-    memset(response, '\0', strlen(buffer));
-    memset(stimulus, '\0', strlen(buffer));
-
-    if (check_contain_colon(buffer)) {
-        sscanf(buffer, "%[^:]:%[^\n]", stimulus, response);
-        if ((*ifhead) == 0) {
-            add_head(head, stimulus, response);
-        } else {
-            add_node(head, stimulus, response);
-        }
-        (*ifhead)++;
-    }
-    
-}
-
-/******************************************************************************
-* Function Name  : read_script(FILE* fp, Dictionary* head)
-* Description    : Read the file run by clientbot and accoding to 
-*                  the content of each line in the file if line is valid,
-*                  collect the stimulus and response
-* Input          : FILE* fp;
-*                  Dictionary* head;
-* Return         : None
-******************************************************************************/
-void read_script(FILE* fp, Dictionary* head) {
-    char* buffer = (char*)malloc(sizeof(char));
-    read_file_dynamic(&buffer, fp);
-    int ifhead = 0;
-
-    while (!feof(fp)) {
-        if (strncmp(buffer, "#", 1) != 0) {
-            collect_stimulus_response(buffer, &ifhead, head);
-        }
-        free(buffer);
-        buffer = malloc(sizeof(char) + 1);
-        read_file_dynamic(&buffer, fp);
-    }
-    collect_stimulus_response(buffer, &ifhead, head);
-}
-
-/******************************************************************************
-* Function Name  : check_contain_stimulus(char* message, Dictionary* head,
-*                  Dictionary* reply, int* ifhead)
-* Description    : Check if the message receive from server contain   
-*                  stimulus in head linked list, if contain and the 
-*                  message is not sent by current clientbot 
-8                  then store it to reply linked list
-* Input          : char* message;
-*                  Dictionary* head;
-*                  Dictionary* reply;
-*                  int* ifhead;
-* Return         : None
-******************************************************************************/
-void check_contain_stimulus(char* message, Dictionary* head, Dictionary* reply,
-        int* ifhead) {
-    char* msgLowerCase = (char*)malloc(sizeof(char) * (strlen(message) + 1));
-    memset(msgLowerCase, '\0', (strlen(message) + 1));
-    char* currentLowerCase;
-    int equalFlag = 1;
-    Dictionary* current = head;
-    //change all characters in message to lower case
-    strcpy(msgLowerCase, message);
-    to_lower_case(msgLowerCase);
-
-    while (current != NULL) {
-        //change all characters in current stimulus to lower case
-        currentLowerCase = 
-                (char*)malloc(sizeof(char) * (strlen(current->stimulus) + 1));
-        memset(currentLowerCase, '\0', (strlen(current->stimulus) + 1));
-        strcpy(currentLowerCase, current->stimulus);
-        to_lower_case(currentLowerCase);
-        //check if message contain stimulus
-        for (int j = 0; j <= 
-                (strlen(msgLowerCase) - strlen(currentLowerCase)); j++) {
-            if (strlen(currentLowerCase) > strlen(msgLowerCase)) {
-                break;
-            }
-
-            for (int i = 0; i < strlen(msgLowerCase); i++) {
-                if (j <= i && i < (strlen(currentLowerCase) + j)) {
-                    if (msgLowerCase[i] != currentLowerCase[i - j]) {
-                        equalFlag = 0;
-                        break;
-                    }
-                }    
-            }
-            if (equalFlag) {
-                if ((*ifhead) == 0) {
-                    add_head(reply, current->stimulus, current->response);
-                } else {
-                    add_node(reply, current->stimulus, current->response);
-                }
-                (*ifhead)++;
-            }
-            equalFlag = 1;
-        }
-        current = current->next;
-        free(currentLowerCase);
-    }
-}
-
-/******************************************************************************
-* Function Name  : check_contain_two_colon(char* buffer) 
-* Description    : Check if there is two colons in the buffer. 
-* Input          : char* buffer;
-* Return         : Return 1 if have two colons
-*                  Return 0 if do not have colon
-******************************************************************************/
-int check_contain_two_colon(char* buffer) {
-    int haveColon = 0;
-    for (int i = 0; i < strlen(buffer); i++) {
-        if (buffer[i] == 58) {
-            haveColon++;
-            
-        }
-    }
-    
-    if (haveColon == 2) {
-        return 1;
-    }
-    return 0;
-}
-
-/******************************************************************************
-* Function Name  : handle_msg_cmd(char* buffer, Dictionary* head, 
-*                  Dictionary* reply, char* myname, int* ifhead)
-* Description    : Handle "MSG:" command from server, if the message 
-*                  contain stimulus in head linked list if contain 
-*                  and the message is not sent by current clientbot 
-*                  then store it to reply linked list
-* Input          : char* buffer;
-*                  Dictionary* head;
-*                  Dictionary* reply;
-*                  char* myname;
-*                  int* ifhead;
-* Output         : None
-* Return         : None
-******************************************************************************/
-void handle_msg_cmd(char* buffer, Dictionary* head, Dictionary* reply, 
-        char* myname, int* ifhead) {
-    char cmd[4];
-    memset(cmd, '\0', 4);
-    char name[strlen(buffer)];
-    memset(name, '\0', strlen(buffer));
-    char message[strlen(buffer)];
-    memset(message, '\0', strlen(buffer));
-
-    if (check_contain_two_colon(buffer)) {
-        sscanf(buffer, "%[^:]:%[^:]:%[^\n]\n", cmd, name, message);
-        fprintf(stderr, "(%s) %s\n", name, message);
-
-        if (strcmp(myname, name) != 0) {
-            check_contain_stimulus(message, head, reply, ifhead);
-        }
-    }
-    
-    
-}
-
-/******************************************************************************
-* Function Name  : handshaking(char** argv)
-* Description    : Read messages send from server, accoding to 
-*                  different command make corresponding actions
-* Input          : char** argv;
-* Return         : None
-******************************************************************************/
-void handshaking(char** argv) {
-    char* buffer = (char*)malloc(sizeof(char));
-    char* name = (char*)malloc(sizeof(char) * 10);
-    memset(name, '\0', 10);
-    int nameTakenNum = -1;
-    FILE* fp = fopen(argv[1], "r");
-    Dictionary* head = NULL; //linked list store all stimules and response
-    head = (Dictionary*) calloc(1, sizeof(Dictionary));
-    Dictionary* reply = NULL; // linked list store all response to reply
-    reply = (Dictionary*) calloc(1, sizeof(Dictionary));  
-    int ifhead = 0;
-    read_script(fp, head);
-    
-    while (1) {
-        read_stdin_dynamic(&buffer);
-
-        if (strcmp(buffer, "WHO:") == 0) {
-            //send client name to server
-            name_reply(&nameTakenNum, &name);
-        } else if (strcmp(buffer, "NAME_TAKEN:") == 0) {
-            //change client name according to nameTakenNum
-            nameTakenNum++;
-        } else if (strcmp(buffer, "YT:") == 0) {
-            //send the responses collect from the received message
-            print_reply(reply);
-            printf("DONE:\n");
-            fflush(stdout);
-            ifhead = 0;
-            free_linked_list(reply);
-            reply = NULL;
-            reply = (Dictionary*) calloc(1, sizeof(Dictionary));
-        } else if (strncmp(buffer, "MSG:", 4) == 0) {
-            //collect response
-            handle_msg_cmd(buffer, head, reply, name, &ifhead);            
-        } else if (strncmp(buffer, "LEFT:", 5) == 0) {
-            //print LEFT:client name to stderr
-            handle_left_cmd(buffer);
-        } else if (strcmp(buffer, "KICK:") == 0) {
-            //current client is kicked by server
-            client_kicked();
-        } else {
-            communication_error();
-        }
-
-        free(buffer);
-        buffer = (char*)malloc(sizeof(char));
-        memset(buffer, '\0', 1);
-    }
-
-}
-
-int main(int argc, char** argv) {
-    // argument checking 
-    arg_checking(argc, argv);
-    
-    // handshaking
-    handshaking(argv);
-
-    return 0;
-}
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "function.h"
+#include "matcher.h"
+
+/* the stimulus and response pairs of a script, in script order */
+typedef struct {
+    char** stimuli; /* stimulus of each pair */
+    char** responses; /* response of each pair */
+    int count; /* number of pairs */
+    int capacity; /* room in stimuli and responses */
+    Matcher matcher; /* the stimuli compiled for scanning messages */
+} Script;
+
+/* first bytes of a compiled script image, the digit is the format version */
+#define IMAGE_MAGIC "CHATBOT1"
+
+/*
+ * Header of a compiled script image. It is followed by the sections
+ * below, in native byte order, each padded to a multiple of 4 bytes:
+ *   classOf        256 bytes
+ *   next           stateCount * classCount ints
+ *   output         stateCount ints
+ *   outputNext     stimulusCount ints
+ *   strings        2 * stimulusCount offsets into text, stimulus then
+ *                  response of each pair
+ *   text           textLength bytes of NUL terminated strings
+ * Nothing in the image is a pointer, so it can be mapped anywhere.
+ */
+typedef struct {
+    char magic[8]; /* IMAGE_MAGIC, not NUL terminated */
+    uint32_t checksum; /* FNV-1a of everything after the header */
+    uint32_t size; /* size of the whole image */
+    int32_t classCount; /* the matcher's classCount */
+    int32_t stateCount; /* the matcher's stateCount */
+    int32_t stimulusCount; /* number of pairs */
+    int32_t textLength; /* bytes in the text section */
+} ImageHeader;
+
+/* one response owed at the next turn */
+typedef struct {
+    int stimulus; /* index of the pair whose stimulus was found */
+    int order; /* when the occurrence was found */
+} Reply;
+
+/* the responses owed at the next turn, in the order they are sent */
+typedef struct {
+    Reply* replies; /* the responses */
+    int count; /* number of responses */
+    int capacity; /* room in replies */
+} ReplyList;
+
+/* one logical bot. A child started from a config entry with "swarm=K"
+ * runs K of them, the lines for and from each carrying its lane */
+typedef struct {
+    char prefix[16]; /* "lane|" in front of its lines, empty for a lone bot */
+    char* name; /* its name, empty until the server asks for it */
+    int nameTakenNum; /* NAME_TAKEN: received, less one */
+    ReplyList reply; /* responses to send at its next turn */
+    int live; /* still in the chat */
+} Bot;
+
+/* the bots run by this child, by lane */
+typedef struct {
+    Bot* bots; /* the bots */
+    int count; /* lanes seen */
+    int live; /* bots still in the chat */
+    ReplyList found; /* responses owed for the message being handled */
+} Swarm;
+
+/******************************************************************************
+* Function Name  : print_head(Script* script)
+* Description    : Print the script pair by pair with 
+*                  stiumulus and response
+* Input          : Script* script;
+* Return         : None
+******************************************************************************/
+void print_head(Script* script) {
+    for (int i = 0; i < script->count; i++) {
+        printf("%dstimulus: %s\n", i, script->stimuli[i]);
+        printf("%dresponse: %s\n", i, script->responses[i]);
+    }
+}
+
+/******************************************************************************
+* Function Name  : print_reply(Bot* bot, Script* script)
+* Description    : Send all responses a bot needs to reply, in order,
+*                  and empty its list
+* Input          : Bot* bot;
+*                  Script* script;
+* Return         : None
+******************************************************************************/
+void print_reply(Bot* bot, Script* script) {
+    ReplyList* reply = &bot->reply;
+
+    for (int i = 0; i < reply->count; i++) {
+        send_text("%sCHAT:%s\n", bot->prefix,
+                script->responses[reply->replies[i].stimulus]);
+    }
+    reply->count = 0;
+}
+
+/******************************************************************************
+* Function Name  : add_pair(Script* script, char* stimulus, char* response)
+* Description    : Add a stimulus and response pair to the end of the
+*                  script, which takes ownership of both strings
+* Input          : Script* script;
+*                  char* stimulus; 
+*                  char* response;
+* Return         : None
+******************************************************************************/
+void add_pair(Script* script, char* stimulus, char* response) {
+    if (script->count == script->capacity) {
+        script->capacity = script->capacity == 0 ? 16 : script->capacity * 2;
+        script->stimuli = (char**)realloc(script->stimuli,
+                sizeof(char*) * script->capacity);
+        script->responses = (char**)realloc(script->responses,
+                sizeof(char*) * script->capacity);
+    }
+    script->stimuli[script->count] = stimulus;
+    script->responses[script->count] = response;
+    script->count++;
+}
+
+/******************************************************************************
+* Function Name  : args_error()
+* Description    : Report client usage error with error message
+*                  "Usage: clientbot [-compile] responsefile [imagefile]"
+*                  with exit code 1
+* Input          : None
+* Return         : None
+******************************************************************************/
+void args_error() {
+    fprintf(stderr, "Usage: clientbot [-compile] responsefile [imagefile]\n");
+    exit(1);
+}
+
+/******************************************************************************
+* Function Name  : arg_checking(int argc, char** argv)
+* Description    : Check if the arguments input in command line is correct,
+*                  either "responsefile" to chat or "-compile responsefile
+*                  imagefile" to write a compiled image of the script
+* Input          : int argc;
+*                  char** argv;
+* Return         : 1 for -compile, 0 otherwise
+******************************************************************************/
+int arg_checking(int argc, char** argv) {
+    int compile = argc == 4 && strcmp(argv[1], "-compile") == 0;
+    FILE* fp;
+
+    if ((argc != 2 && !compile)
+            || (fp = fopen(argv[compile ? 2 : 1], "r")) == NULL) {
+        args_error();
+    }
+    fclose(fp);
+    return compile;
+}
+
+/******************************************************************************
+* Function Name  : name_reply(Bot* bot) 
+* Description    : According to the bot's nameTakenNum, reply its name
+*                  to server. The first reply lets the server pick a free
+*                  name made from it. A lone bot asks for binary frames
+*                  before it if the server allows them, a swarm's lanes
+*                  share one stream of lines
+* Input          : Bot* bot;
+* Return         : None
+******************************************************************************/
+void name_reply(Bot* bot) {
+    int numLength = 0;
+
+    if (bot->prefix[0] == '\0') {
+        offer_binary();
+    }
+    if (bot->nameTakenNum == -1) {
+        send_text("%sNAME_ANY:clientbot\n", bot->prefix);
+        strcpy(bot->name, "clientbot");
+    } else {
+        send_text("%sNAME:clientbot%d\n", bot->prefix, bot->nameTakenNum);
+        int_length(&bot->nameTakenNum, &numLength);
+        free(bot->name);
+        bot->name = (char*)malloc(sizeof(char) * (numLength + 10));
+        sprintf(bot->name, "clientbot%d", bot->nameTakenNum);
+    }
+}
+
+/******************************************************************************
+* Function Name  : collect_stimulus_response(char* buffer, Script* script)
+* Description    : Collect stimulus and response and add them to the script
+* Input          : char* buffer;
+*                  Script* script;
+* Return         : None
+******************************************************************************/
+void collect_stimulus_response(char* buffer, Script* script) {
+    char* response = (char*)malloc(sizeof(char) * (strlen(buffer)));
+    char* stimulus = (char*)malloc(sizeof(char) * (strlen(buffer)));
+    memset(response, '\0', strlen(buffer));
+    memset(stimulus, '\0', strlen(buffer));
+
+    if (check_contain_colon(buffer)) {
+        sscanf(buffer, "%[^:]:%[^\n]", stimulus, response);
+        add_pair(script, stimulus, response);
+    } else {
+        free(response);
+        free(stimulus);
+    }
+}
+
+/******************************************************************************
+* Function Name  : read_script(LineReader* script, Script* pairs)
+* Description    : Read the file run by clientbot and accoding to 
+*                  the content of each line in the file if line is valid,
+*                  collect the stimulus and response, then compile the
+*                  stimuli for matching
+* Input          : LineReader* script;
+*                  Script* pairs;
+* Return         : None
+******************************************************************************/
+void read_script(LineReader* script, Script* pairs) {
+    char* buffer;
+
+    while ((buffer = read_line(script)) != NULL) {
+        if (strncmp(buffer, "#", 1) != 0) {
+            collect_stimulus_response(buffer, pairs);
+        }
+    }
+    matcher_build(&pairs->matcher, pairs->stimuli, pairs->count);
+}
+
+/******************************************************************************
+* Function Name  : image_checksum(const char* data, size_t length)
+* Description    : FNV-1a hash of the bytes of an image
+* Input          : const char* data;
+*                  size_t length;
+* Return         : The hash
+******************************************************************************/
+uint32_t image_checksum(const char* data, size_t length) {
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/******************************************************************************
+* Function Name  : image_layout(const ImageHeader* header, size_t* offsets)
+* Description    : Work out where each section of an image starts
+* Input          : const ImageHeader* header;
+*                  size_t* offsets; set to the six section offsets
+* Return         : The size of the image
+******************************************************************************/
+size_t image_layout(const ImageHeader* header, size_t* offsets) {
+    size_t sizes[6];
+    size_t at = sizeof(ImageHeader);
+
+    sizes[0] = 256;
+    sizes[1] = sizeof(int) * (size_t)header->stateCount * header->classCount;
+    sizes[2] = sizeof(int) * (size_t)header->stateCount;
+    sizes[3] = sizeof(int) * (size_t)header->stimulusCount;
+    sizes[4] = sizeof(uint32_t) * 2 * (size_t)header->stimulusCount;
+    sizes[5] = header->textLength;
+    for (int i = 0; i < 6; i++) {
+        offsets[i] = at;
+        at = (at + sizes[i] + 3) & ~(size_t)3;
+    }
+    return at;
+}
+
+/******************************************************************************
+* Function Name  : write_image(Script* script, char* imagePath)
+* Description    : Write the script and its compiled matcher to imagePath
+*                  as an image clientbot can map instead of parsing
+* Input          : Script* script;
+*                  char* imagePath;
+* Return         : 0 on success, -1 if the image could not be written
+******************************************************************************/
+int write_image(Script* script, char* imagePath) {
+    ImageHeader header;
+    size_t offsets[6];
+    Matcher* matcher = &script->matcher;
+    int textLength = 0;
+    FILE* fp;
+
+    for (int i = 0; i < script->count; i++) {
+        textLength += strlen(script->stimuli[i]) + 1;
+        textLength += strlen(script->responses[i]) + 1;
+    }
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+    header.classCount = matcher->classCount;
+    header.stateCount = matcher->stateCount;
+    header.stimulusCount = script->count;
+    header.textLength = textLength;
+    header.size = image_layout(&header, offsets);
+
+    char* image = (char*)calloc(1, header.size);
+    uint32_t* strings = (uint32_t*)(image + offsets[4]);
+    char* text = image + offsets[5];
+    int at = 0;
+    memcpy(image + offsets[0], matcher->classOf, 256);
+    memcpy(image + offsets[1], matcher->next,
+            sizeof(int) * matcher->stateCount * matcher->classCount);
+    memcpy(image + offsets[2], matcher->output,
+            sizeof(int) * matcher->stateCount);
+    memcpy(image + offsets[3], matcher->outputNext,
+            sizeof(int) * script->count);
+    for (int i = 0; i < script->count; i++) {
+        strings[2 * i] = at;
+        at = stpcpy(text + at, script->stimuli[i]) - text + 1;
+        strings[2 * i + 1] = at;
+        at = stpcpy(text + at, script->responses[i]) - text + 1;
+    }
+    header.checksum = image_checksum(image + sizeof(header),
+            header.size - sizeof(header));
+    memcpy(image, &header, sizeof(header));
+
+    int written = (fp = fopen(imagePath, "w")) != NULL
+            && fwrite(image, 1, header.size, fp) == header.size;
+    if (fp != NULL && fclose(fp) != 0) {
+        written = 0;
+    }
+    free(image);
+    return written ? 0 : -1;
+}
+
+/******************************************************************************
+* Function Name  : image_valid(const char* image, size_t length)
+* Description    : Check a mapped image is whole and consistent, so that
+*                  every index in it stays in bounds
+* Input          : const char* image;
+*                  size_t length;
+* Return         : 1 if the image can be used, 0 if not
+******************************************************************************/
+int image_valid(const char* image, size_t length) {
+    const ImageHeader* header = (const ImageHeader*)image;
+    size_t offsets[6];
+
+    if (header->classCount < 1 || header->classCount > 256
+            || header->stateCount < 1 || header->stimulusCount < 0
+            || header->textLength < 0
+            || header->size != length
+            || image_layout(header, offsets) != length
+            || image_checksum(image + sizeof(ImageHeader),
+            length - sizeof(ImageHeader)) != header->checksum) {
+        return 0;
+    }
+    const unsigned char* classOf = (const unsigned char*)image + offsets[0];
+    const int* next = (const int*)(image + offsets[1]);
+    const int* output = (const int*)(image + offsets[2]);
+    const int* outputNext = (const int*)(image + offsets[3]);
+    const uint32_t* strings = (const uint32_t*)(image + offsets[4]);
+    for (int i = 0; i < 256; i++) {
+        if (classOf[i] >= header->classCount) {
+            return 0;
+        }
+    }
+    for (size_t i = 0; i < (size_t)header->stateCount * header->classCount;
+            i++) {
+        if (next[i] < 0 || next[i] >= header->stateCount) {
+            return 0;
+        }
+    }
+    for (int i = 0; i < header->stateCount; i++) {
+        if (output[i] < -1 || output[i] >= header->stimulusCount) {
+            return 0;
+        }
+    }
+    for (int i = 0; i < header->stimulusCount; i++) {
+        if (outputNext[i] < -1 || outputNext[i] >= header->stimulusCount
+                || strings[2 * i] >= header->textLength
+                || strings[2 * i + 1] >= header->textLength) {
+            return 0;
+        }
+    }
+    // every string ends inside the text
+    return header->textLength == 0
+            || image[offsets[5] + header->textLength - 1] == '\0';
+}
+
+/******************************************************************************
+* Function Name  : load_image(int fd, Script* script)
+* Description    : Map a compiled script image and point the script and its
+*                  matcher into it, nothing is parsed or copied
+* Input          : int fd;
+*                  Script* script;
+* Return         : 1 if fd held a compiled image, 0 if it is a text script.
+*                  An image that fails to validate is a usage error
+******************************************************************************/
+int load_image(int fd, Script* script) {
+    ImageHeader header;
+    struct stat info;
+    size_t offsets[6];
+    char* image;
+
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header)
+            || memcmp(header.magic, IMAGE_MAGIC, sizeof(header.magic)) != 0) {
+        return 0;
+    }
+    if (fstat(fd, &info) < 0 || (image = (char*)mmap(NULL, info.st_size,
+            PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+        args_error();
+    }
+    if (!image_valid(image, info.st_size)) {
+        fprintf(stderr, "clientbot: corrupt script image\n");
+        args_error();
+    }
+    image_layout(&header, offsets);
+    memcpy(script->matcher.classOf, image + offsets[0], 256);
+    script->matcher.classCount = header.classCount;
+    script->matcher.stateCount = header.stateCount;
+    script->matcher.stimulusCount = header.stimulusCount;
+    script->matcher.next = (int*)(image + offsets[1]);
+    script->matcher.output = (int*)(image + offsets[2]);
+    script->matcher.outputNext = (int*)(image + offsets[3]);
+
+    const uint32_t* strings = (const uint32_t*)(image + offsets[4]);
+    script->count = script->capacity = header.stimulusCount;
+    script->stimuli = (char**)malloc(sizeof(char*) * (script->count + 1));
+    script->responses = (char**)malloc(sizeof(char*) * (script->count + 1));
+    for (int i = 0; i < script->count; i++) {
+        script->stimuli[i] = image + offsets[5] + strings[2 * i];
+        script->responses[i] = image + offsets[5] + strings[2 * i + 1];
+    }
+    return 1;
+}
+
+/******************************************************************************
+* Function Name  : add_reply(int stimulus, void* data)
+* Description    : Matcher handler, owe the response of a stimulus found
+*                  in a message
+* Input          : int stimulus;
+*                  void* data;
+* Return         : None
+******************************************************************************/
+void add_reply(int stimulus, void* data) {
+    ReplyList* reply = (ReplyList*)data;
+
+    if (reply->count == reply->capacity) {
+        reply->capacity = reply->capacity == 0 ? 16 : reply->capacity * 2;
+        reply->replies = (Reply*)realloc(reply->replies,
+                sizeof(Reply) * reply->capacity);
+    }
+    reply->replies[reply->count].stimulus = stimulus;
+    reply->replies[reply->count].order = reply->count;
+    reply->count++;
+}
+
+/******************************************************************************
+* Function Name  : compare_reply(const void* first, const void* second)
+* Description    : qsort comparator putting replies in script order, and
+*                  occurrences of one stimulus in the order found
+* Input          : const void* first;
+*                  const void* second;
+* Return         : Negative, zero or positive as first sorts before,
+*                  with or after second
+******************************************************************************/
+int compare_reply(const void* first, const void* second) {
+    const Reply* a = (const Reply*)first;
+    const Reply* b = (const Reply*)second;
+
+    if (a->stimulus != b->stimulus) {
+        return a->stimulus - b->stimulus;
+    }
+    return a->order - b->order;
+}
+
+/******************************************************************************
+* Function Name  : append_replies(ReplyList* reply, ReplyList* found)
+* Description    : Owe a bot the responses found in a message
+* Input          : ReplyList* reply;
+*                  ReplyList* found;
+* Return         : None
+******************************************************************************/
+void append_replies(ReplyList* reply, ReplyList* found) {
+    if (reply->count + found->count > reply->capacity) {
+        while (reply->count + found->count > reply->capacity) {
+            reply->capacity = reply->capacity == 0 ?
+                    16 : reply->capacity * 2;
+        }
+        reply->replies = (Reply*)realloc(reply->replies,
+                sizeof(Reply) * reply->capacity);
+    }
+    memcpy(reply->replies + reply->count, found->replies,
+            sizeof(Reply) * found->count);
+    reply->count += found->count;
+}
+
+/******************************************************************************
+* Function Name  : check_contain_stimulus(char* message, Script* script,
+*                  ReplyList* reply)
+* Description    : Scan the message receive from server once for every
+*                  stimulus of the script, ignoring case, and add a reply
+*                  for each occurrence. The replies of one message go out
+*                  in script order, each stimulus once per occurrence
+* Input          : char* message;
+*                  Script* script;
+*                  ReplyList* reply;
+* Return         : None
+******************************************************************************/
+void check_contain_stimulus(char* message, Script* script, ReplyList* reply) {
+    int start = reply->count;
+
+    matcher_scan(&script->matcher, message, add_reply, reply);
+    // occurrences are found by where they end
+    if (reply->count - start > 1) {
+        qsort(reply->replies + start, reply->count - start, sizeof(Reply),
+                compare_reply);
+    }
+}
+
+/******************************************************************************
+* Function Name  : handle_msg_cmd(Message* message, Script* script, 
+*                  Swarm* swarm)
+* Description    : Handle "MSG:" command from server, the message is
+*                  scanned once for the stimuli in the script and the
+*                  responses added to the reply of every bot that did
+*                  not send it. Lines without exactly two colons are
+*                  ignored
+* Input          : Message* message;
+*                  Script* script;
+*                  Swarm* swarm;
+* Output         : None
+* Return         : None
+******************************************************************************/
+void handle_msg_cmd(Message* message, Script* script, Swarm* swarm) {
+    char* name = message->field1;
+    char* text;
+
+    if (message->colons != 2) {
+        return;
+    }
+    text = second_field(message);
+    //there is no text without a name
+    if (*name == '\0') {
+        text = "";
+    }
+    fprintf(stderr, "(%s) %s\n", name, text);
+
+    swarm->found.count = 0;
+    check_contain_stimulus(text, script, &swarm->found);
+    for (int i = 0; i < swarm->count && swarm->found.count > 0; i++) {
+        Bot* bot = &swarm->bots[i];
+        if (bot->live && strcmp(bot->name, name) != 0) {
+            append_replies(&bot->reply, &swarm->found);
+        }
+    }
+}
+
+/******************************************************************************
+* Function Name  : compile_script(char* scriptPath, char* imagePath)
+* Description    : Read a text script and write its compiled image
+* Input          : char* scriptPath;
+*                  char* imagePath;
+* Return         : The exit status, 0 once the image is written
+******************************************************************************/
+int compile_script(char* scriptPath, char* imagePath) {
+    LineReader script;
+    Script pairs;
+    int status = 0;
+
+    memset(&pairs, 0, sizeof(pairs));
+    line_reader_init(&script, open(scriptPath, O_RDONLY));
+    read_script(&script, &pairs);
+    if (write_image(&pairs, imagePath) < 0) {
+        perror(imagePath);
+        status = 1;
+    }
+    close(script.fd);
+    free(script.buffer);
+    for (int i = 0; i < pairs.count; i++) {
+        free(pairs.stimuli[i]);
+        free(pairs.responses[i]);
+    }
+    free(pairs.stimuli);
+    free(pairs.responses);
+    matcher_free(&pairs.matcher);
+    return status;
+}
+
+/******************************************************************************
+* Function Name  : find_bot(Swarm* swarm, int lane)
+* Description    : Find the bot of a lane, starting it (and any lanes
+*                  before) the first time the lane is seen. Lane -1 is the
+*                  lone bot of a child that is not a swarm
+* Input          : Swarm* swarm;
+*                  int lane;
+* Return         : The bot
+******************************************************************************/
+Bot* find_bot(Swarm* swarm, int lane) {
+    int prefixed = lane >= 0;
+
+    if (!prefixed) {
+        lane = 0;
+    }
+    while (swarm->count <= lane) {
+        swarm->bots = (Bot*)realloc(swarm->bots,
+                sizeof(Bot) * (swarm->count + 1));
+        Bot* bot = &swarm->bots[swarm->count];
+        memset(bot, 0, sizeof(Bot));
+        if (prefixed) {
+            sprintf(bot->prefix, "%d|", swarm->count);
+        }
+        bot->name = (char*)malloc(sizeof(char) * 10);
+        memset(bot->name, '\0', 10);
+        bot->nameTakenNum = -1;
+        bot->live = 1;
+        swarm->count++;
+        swarm->live++;
+    }
+    return &swarm->bots[lane];
+}
+
+/******************************************************************************
+* Function Name  : leave_bot(Swarm* swarm, Bot* bot, int kicked)
+* Description    : Stop a bot that was kicked, or whose lane was closed by
+*                  the server. The child exits as "Kicked" once its last
+*                  bot is, a closed lane just waits for the server to
+*                  close its pipes
+* Input          : Swarm* swarm;
+*                  Bot* bot;
+*                  int kicked;
+* Return         : None
+******************************************************************************/
+void leave_bot(Swarm* swarm, Bot* bot, int kicked) {
+    if (!bot->live) {
+        return;
+    }
+    bot->live = 0;
+    bot->reply.count = 0;
+    if (--swarm->live == 0 && kicked) {
+        client_kicked();
+    }
+}
+
+/******************************************************************************
+* Function Name  : handshaking(char** argv)
+* Description    : Load the script, mapping it if it is a compiled image,
+*                  then read messages send from server, accoding to 
+*                  different command make corresponding actions. Lines
+*                  with "lane|" in front are for one bot of a swarm,
+*                  broadcasts are handled once for all of them
+* Input          : char** argv;
+* Return         : None
+******************************************************************************/
+void handshaking(char** argv) {
+    int lane;
+    Bot* bot;
+    Message message;
+    LineReader script;
+    Script pairs; //all stimulus and response pairs
+    memset(&pairs, 0, sizeof(pairs));
+    Swarm swarm; //the bots, a lone one unless run as a swarm
+    memset(&swarm, 0, sizeof(swarm));
+    line_reader_init(&script, open(argv[1], O_RDONLY));
+    if (!load_image(script.fd, &pairs)) {
+        read_script(&script, &pairs);
+    }
+    close(script.fd);
+    free(script.buffer);
+    transport_init();
+    
+    while (1) {
+        if (!receive_message(&message, &lane)) {
+            //server has gone
+            communication_error();
+        }
+        if (message.command == CMD_MSG) {
+            //collect response
+            handle_msg_cmd(&message, &pairs, &swarm);
+            continue;
+        } else if (message.command == CMD_LEFT) {
+            //print LEFT:client name to stderr
+            handle_left_cmd(&message);
+            continue;
+        }
+
+        bot = find_bot(&swarm, lane);
+        if (!bot->live) {
+            //lines for a bot that has left are dropped
+            continue;
+        } else if (message.head == message.end && lane >= 0) {
+            //the server has closed the lane
+            leave_bot(&swarm, bot, 0);
+            continue;
+        } else if (message.colons != 1 || (*message.field1 != '\0'
+                && message.command != CMD_NAME_ASSIGNED)) {
+            //the other commands have nothing after the colon
+            communication_error();
+        }
+        switch (message.command) {
+        case CMD_WHO:
+            //send client name to server
+            name_reply(bot);
+            break;
+        case CMD_NAME_TAKEN:
+            //change client name according to nameTakenNum
+            bot->nameTakenNum++;
+            break;
+        case CMD_NAME_ASSIGNED:
+            //the server picked the name, its own messages are known by it
+            free(bot->name);
+            bot->name = strdup(message.field1);
+            break;
+        case CMD_YT:
+            //send the responses collect from the received message
+            print_reply(bot, &pairs);
+            send_text("%sDONE:\n", bot->prefix);
+            break;
+        case CMD_KICK:
+            //current client is kicked by server
+            leave_bot(&swarm, bot, 1);
+            break;
+        default:
+            communication_error();
+        }
+    }
+
+}
+
+int main(int argc, char** argv) {
+    // argument checking 
+    if (arg_checking(argc, argv)) {
+        return compile_script(argv[2], argv[3]);
+    }
+    
+    // handshaking
+    handshaking(argv);
+
+    return 0;
+}
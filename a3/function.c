@@ -1,152 +1,1002 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include "function.h"
-
-/******************************************************************************
-* Function Name  : communication_error() 
-* Description    : Report communication error and sent message 
-*                  "Communications error" to stderr, exit program with code 2
-* Input          : None
-* Return         : None
-******************************************************************************/
-void communication_error() {
-    fprintf(stderr, "Communications error\n");
-    exit(2);
-}
-
-/******************************************************************************
-* Function Name  : client_kicked() 
-* Description    : The client is kicked by server and send message 
-*                  "Kicked" to stderr, exit program with code 3
-* Input          : None
-* Return         : None
-******************************************************************************/
-void client_kicked() {
-    fprintf(stderr, "Kicked\n");
-    exit(3);
-}
-
-/******************************************************************************
-* Function Name  : int_length(int* nameTakenNum, int* numLength) 
-* Description    : Caculate the nameTakeNum length, and assigned to numLength 
-* Input          : int* nameTakenNum;
-*                  int* numLength;
-* Return         : None
-******************************************************************************/
-void int_length(int* nameTakenNum, int* numLength) {
-    int num = *nameTakenNum;
-
-    do {
-        num = num / 10;
-        (*numLength)++;
-    } while (num != 0);
-}
-
-/******************************************************************************
-* Function Name  : check_contain_colon(char* buffer) 
-* Description    : Check if there is a colon  in the buffer. 
-* Input          : char* buffer;
-* Return         : Return 1 if have colon
-*                  Return 0 if do not have colon
-******************************************************************************/
-int check_contain_colon(char* buffer) {
-    int haveColon = 0;
-    for (int i = 0; i < strlen(buffer); i++) {
-        if (buffer[i] == 58) {
-            haveColon++;
-            
-        }
-    }
-    
-    if (haveColon == 1) {
-        return 1;
-    }
-
-    return 0;
-}
-
-/******************************************************************************
-* Function Name  : read_stdin_dynamic(char** buffer) 
-* Description    : Read stdin and store content in buffer dynamicly
-* Input          : char** buffer;
-* Return         : None
-******************************************************************************/
-void read_stdin_dynamic(char** buffer) {
-    char c;
-    int shiftIndex = 0;
-
-    while ((c = fgetc(stdin)) != EOF) {
-        if (c == 10) {
-            (*buffer)[shiftIndex] = '\0';
-            break;
-        }
-        (*buffer)[shiftIndex] = c;
-        shiftIndex++;
-        *buffer = (char*)realloc(*buffer, sizeof(char) * (shiftIndex + 1));
-    }
-}
-
-/******************************************************************************
-* Function Name  : read_file_dynamic(char** buffer, FILE* fp)
-* Description    : Read file line by line and store content 
-*                  in buffer dynamicly 
-* Input          : char** buffer;
-*                  FILE* fp;
-* Return         : None
-******************************************************************************/
-void read_file_dynamic(char** buffer, FILE* fp) {
-    char c;
-    int shiftIndex = 0;
-
-    while (1) {
-        if ((c = fgetc(fp)) == EOF) {
-            (*buffer)[shiftIndex] = '\0';
-            break;
-        }
-
-        if (c == 10) {
-            (*buffer)[shiftIndex] = '\0';
-            break;
-        }
-        (*buffer)[shiftIndex] = c;
-        shiftIndex++;
-        *buffer = (char*)realloc(*buffer, sizeof(char) * (shiftIndex + 1));
-    }
-}
-
-/******************************************************************************
-* Function Name  : handle_left_cmd(char* buffer)
-* Description    : Handle "LEFT:" command from server, and send this
-*                  text to stderr with a specific format
-* Input          : char* buffer;
-* Return         : None
-******************************************************************************/
-void handle_left_cmd(char* buffer) {
-    char cmd[5];
-    memset(cmd, '\0', 5);
-    char name[strlen(buffer)];
-    memset(name, '\0', 5);
-    // const char s[2] = ":";
-    // char *token;
-    // int part = 1;
-
-    sscanf(buffer, "%[^:]:%[^\n]\n", cmd, name);
-    // token = strtok(buffer, s);
-
-    // while( token != NULL ) {
-    //     if (part == 1) {
-    //         strcpy(cmd, token);
-    //     } 
-
-    //     if (part == 2) {
-    //         strcpy(name, token);
-    //     }
-    //     part++;
-    
-    //     token = strtok(NULL, s);
-    // }
-
-    fprintf(stderr, "(%s has left the chat)\n", name);
-}
-
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include "function.h"
+#include "varint.h"
+
+/* the shared memory link to the server, NULL when talking over
+ * stdin and stdout */
+static SharedLink* serverLink;
+
+/* eventfd the server wakes this process with */
+static int wakeFd;
+
+/* eventfd this process wakes the server with */
+static int notifyFd;
+
+/* lines from the server */
+static LineReader serverInput;
+
+/* the server has closed this process's stdin */
+static int serverGone;
+
+/* where send_text formats a line */
+static char* sendBuffer;
+static int sendCapacity;
+
+/* this process has asked for binary frames, they are sent and read once
+ * serverInput.binary is set by the server's answer */
+static int binaryOffered;
+
+/* where send_text encodes its lines as frames */
+static char* frameBuffer;
+static int frameCapacity;
+
+/* the text of each command, by CMD_* */
+static const char* commandNames[] = {"", "WHO", "NAME", "NAME_TAKEN", "YT",
+        "CHAT", "KICK", "DONE", "QUIT", "MSG", "LEFT", "NAME_ANY",
+        "NAME_ASSIGNED", "BIN"};
+
+/******************************************************************************
+* Function Name  : communication_error() 
+* Description    : Report communication error and sent message 
+*                  "Communications error" to stderr, exit program with code 2
+* Input          : None
+* Return         : None
+******************************************************************************/
+void communication_error() {
+    fprintf(stderr, "Communications error\n");
+    exit(2);
+}
+
+/******************************************************************************
+* Function Name  : client_kicked() 
+* Description    : The client is kicked by server and send message 
+*                  "Kicked" to stderr, exit program with code 3
+* Input          : None
+* Return         : None
+******************************************************************************/
+void client_kicked() {
+    fprintf(stderr, "Kicked\n");
+    exit(3);
+}
+
+/******************************************************************************
+* Function Name  : int_length(int* nameTakenNum, int* numLength) 
+* Description    : Caculate the nameTakeNum length, and assigned to numLength 
+* Input          : int* nameTakenNum;
+*                  int* numLength;
+* Return         : None
+******************************************************************************/
+void int_length(int* nameTakenNum, int* numLength) {
+    int num = *nameTakenNum;
+
+    do {
+        num = num / 10;
+        (*numLength)++;
+    } while (num != 0);
+}
+
+/******************************************************************************
+* Function Name  : check_contain_colon(char* buffer) 
+* Description    : Check if there is exactly one colon in the buffer. 
+* Input          : char* buffer;
+* Return         : Return 1 if have one colon
+*                  Return 0 if have none or more
+******************************************************************************/
+int check_contain_colon(char* buffer) {
+    char* colon = strchr(buffer, ':');
+
+    return colon != NULL && strchr(colon + 1, ':') == NULL;
+}
+
+/******************************************************************************
+* Function Name  : command_of(const char* head, int length)
+* Description    : Look up the command named by the text before a colon,
+*                  picked by its first byte then checked in full
+* Input          : const char* head;
+*                  int length;
+* Return         : The CMD_* value, CMD_NONE if it names none
+******************************************************************************/
+static int command_of(const char* head, int length) {
+    const char* name;
+    int command;
+
+    switch (head[0]) {
+    case 'B':
+        name = "BIN";
+        command = CMD_BIN;
+        break;
+    case 'C':
+        name = "CHAT";
+        command = CMD_CHAT;
+        break;
+    case 'D':
+        name = "DONE";
+        command = CMD_DONE;
+        break;
+    case 'K':
+        name = "KICK";
+        command = CMD_KICK;
+        break;
+    case 'L':
+        name = "LEFT";
+        command = CMD_LEFT;
+        break;
+    case 'M':
+        name = "MSG";
+        command = CMD_MSG;
+        break;
+    case 'N':
+        switch (length) {
+        case 4:
+            name = "NAME";
+            command = CMD_NAME;
+            break;
+        case 8:
+            name = "NAME_ANY";
+            command = CMD_NAME_ANY;
+            break;
+        case 10:
+            name = "NAME_TAKEN";
+            command = CMD_NAME_TAKEN;
+            break;
+        default:
+            name = "NAME_ASSIGNED";
+            command = CMD_NAME_ASSIGNED;
+        }
+        break;
+    case 'Q':
+        name = "QUIT";
+        command = CMD_QUIT;
+        break;
+    case 'W':
+        name = "WHO";
+        command = CMD_WHO;
+        break;
+    case 'Y':
+        name = "YT";
+        command = CMD_YT;
+        break;
+    default:
+        return CMD_NONE;
+    }
+    if ((int)strlen(name) != length || memcmp(head, name, length) != 0) {
+        return CMD_NONE;
+    }
+    return command;
+}
+
+/******************************************************************************
+* Function Name  : split_message(char* line, int length, Message* message)
+* Description    : Split a line at its first colon, which is overwritten
+*                  with a NUL so head and field1 are both strings, look up
+*                  its command and count its colons, all in one pass. The
+*                  second colon is only noted, see second_field
+* Input          : char* line; NUL terminated at length
+*                  int length;
+*                  Message* message;
+* Return         : None
+******************************************************************************/
+void split_message(char* line, int length, Message* message) {
+    char* end = line + length;
+    char* colon = memchr(line, ':', length);
+
+    message->command = CMD_NONE;
+    message->colons = 0;
+    message->head = line;
+    message->field1 = end;
+    message->second = NULL;
+    message->end = end;
+    if (colon == NULL) {
+        return;
+    }
+    *colon = '\0';
+    message->command = command_of(line, colon - line);
+    message->field1 = colon + 1;
+    message->colons = 1;
+    for (colon++; (colon = memchr(colon, ':', end - colon)) != NULL;
+            colon++) {
+        if (++message->colons == 2) {
+            message->second = colon;
+        }
+    }
+}
+
+/******************************************************************************
+* Function Name  : second_field(Message* message)
+* Description    : Cut field1 at the second colon of the line, in place
+* Input          : Message* message;
+* Return         : The text after the second colon, empty if the line has
+*                  no second colon
+******************************************************************************/
+char* second_field(Message* message) {
+    if (message->second == NULL) {
+        return message->end;
+    }
+    *message->second = '\0';
+    return message->second + 1;
+}
+
+/******************************************************************************
+* Function Name  : take_lane(char** buffer, int* length)
+* Description    : Take the "lane|" off the front of a line from the server
+* Input          : char** buffer;
+*                  int* length;
+* Return         : The lane, -1 if the line has none
+******************************************************************************/
+int take_lane(char** buffer, int* length) {
+    char* text = *buffer;
+    int lane = 0;
+
+    for (; isdigit((unsigned char)*text) && lane < MAX_LANES; text++) {
+        lane = lane * 10 + (*text - '0');
+    }
+    if (text == *buffer || *text != '|') {
+        return -1;
+    }
+    if (lane >= MAX_LANES) {
+        communication_error();
+    }
+    *length -= text + 1 - *buffer;
+    *buffer = text + 1;
+    return lane;
+}
+
+/******************************************************************************
+* Function Name  : encode_fields(int command, const char** fields,
+*                  const int* lengths, int count, char* frame)
+* Description    : Encode a command and its fields as a binary frame
+* Input          : int command; CMD_*
+*                  const char** fields;
+*                  const int* lengths;
+*                  int count; fields, at most two
+*                  char* frame; room for the fields and FRAME_EXTRA bytes
+* Return         : The bytes of the frame
+******************************************************************************/
+int encode_fields(int command, const char** fields, const int* lengths,
+        int count, char* frame) {
+    int size = 1;
+    int offset;
+
+    for (int i = 0; i < count; i++) {
+        size += varint_size(lengths[i]) + lengths[i];
+    }
+    offset = put_varint((unsigned char*)frame, size);
+    frame[offset++] = (char)command;
+    for (int i = 0; i < count; i++) {
+        offset += put_varint((unsigned char*)frame + offset, lengths[i]);
+        memcpy(frame + offset, fields[i], lengths[i]);
+        offset += lengths[i];
+    }
+    return offset;
+}
+
+/******************************************************************************
+* Function Name  : encode_frame(const char* line, int length, char* frame)
+* Description    : Encode a protocol line as a binary frame, a trailing
+*                  newline is left out
+* Input          : const char* line;
+*                  int length;
+*                  char* frame; room for length + FRAME_EXTRA bytes
+* Return         : The bytes of the frame
+******************************************************************************/
+int encode_frame(const char* line, int length, char* frame) {
+    const char* fields[2];
+    const char* colon;
+    const char* second;
+    int lengths[2];
+    int command = CMD_NONE;
+    int count = 1;
+
+    if (length > 0 && line[length - 1] == '\n') {
+        length--;
+    }
+    colon = memchr(line, ':', length);
+    if (colon != NULL) {
+        command = command_of(line, colon - line);
+    }
+    fields[0] = command == CMD_NONE ? line : colon + 1;
+    lengths[0] = line + length - fields[0];
+    if (command == CMD_MSG
+            && (second = memchr(fields[0], ':', lengths[0])) != NULL) {
+        fields[1] = second + 1;
+        lengths[1] = line + length - fields[1];
+        lengths[0] = second - fields[0];
+        count = 2;
+    }
+    return encode_fields(command, fields, lengths, count, frame);
+}
+
+/******************************************************************************
+* Function Name  : bad_frame(LineReader* reader)
+* Description    : Give up on input that cannot be read as frames, nothing
+*                  after a broken frame can be made sense of so it is taken
+*                  as the end of input
+* Input          : LineReader* reader;
+* Return         : -1, as take_frame with no frame
+******************************************************************************/
+static int bad_frame(LineReader* reader) {
+    reader->start = reader->length;
+    reader->eof = 1;
+    return -1;
+}
+
+/******************************************************************************
+* Function Name  : take_frame(LineReader* reader, int* opcode, char** fields,
+*                  int* lengths)
+* Description    : Take the next whole frame in a reader's buffer. Each
+*                  field is moved down over the length in front of it, so
+*                  it can be ended with a NUL in place
+* Input          : LineReader* reader;
+*                  int* opcode;
+*                  char** fields; room for two, a frame without fields
+*                  gets an empty one
+*                  int* lengths;
+* Return         : The number of fields, -1 if no whole frame is ready
+******************************************************************************/
+static int take_frame(LineReader* reader, int* opcode, char** fields,
+        int* lengths) {
+    char* data = reader->buffer + reader->start;
+    size_t available = reader->length - reader->start;
+    size_t offset = 0;
+    int count = 0;
+    int status;
+    uint64_t size;
+    uint64_t fieldLength;
+    char* out;
+
+    status = get_varint((unsigned char*)data, available, &offset, &size);
+    if (status < 0 || (status > 0 && size > INT32_MAX)) {
+        return bad_frame(reader);
+    }
+    if (status == 0 || size > available - offset) {
+        return -1;
+    }
+    data += offset;
+    if (size == 0 || (unsigned char)data[0] > CMD_BIN) {
+        return bad_frame(reader);
+    }
+    *opcode = (unsigned char)data[0];
+    out = data;
+    for (offset = 1; offset < size; offset += fieldLength) {
+        if (count == 2
+                || get_varint((unsigned char*)data, size, &offset,
+                &fieldLength) <= 0
+                || fieldLength > size - offset) {
+            return bad_frame(reader);
+        }
+        memmove(out, data + offset, fieldLength);
+        out[fieldLength] = '\0';
+        fields[count] = out;
+        lengths[count++] = fieldLength;
+        out += fieldLength + 1;
+    }
+    if (count == 0) {
+        *out = '\0';
+        fields[0] = out;
+        lengths[0] = 0;
+    }
+    reader->start = data + size - reader->buffer;
+    return count;
+}
+
+/******************************************************************************
+* Function Name  : frame_next(LineReader* reader, Message* message)
+* Description    : Take the next whole frame from a binary reader as a
+*                  message, its command straight from the opcode. The
+*                  fields stay valid until the next fill
+* Input          : LineReader* reader;
+*                  Message* message;
+* Return         : 1 if a frame was taken, 0 if none is ready
+******************************************************************************/
+int frame_next(LineReader* reader, Message* message) {
+    char* fields[2];
+    int lengths[2];
+    int opcode;
+    int count = take_frame(reader, &opcode, fields, lengths);
+
+    if (count < 0) {
+        return 0;
+    }
+    if (opcode == CMD_NONE) {
+        split_message(fields[0], lengths[0], message);
+        return 1;
+    }
+    message->command = opcode;
+    message->colons = count;
+    message->head = (char*)commandNames[opcode];
+    message->field1 = fields[0];
+    message->second = count == 2 ? fields[1] - 1 : NULL;
+    message->end = count == 2 ? fields[1] + lengths[1]
+            : fields[0] + lengths[0];
+    return 1;
+}
+
+/******************************************************************************
+* Function Name  : line_clean(char* text, int length)
+* Description    : Make text fit in a line, in place. Newlines and NULs,
+*                  which a binary frame's fields may hold, become spaces
+* Input          : char* text;
+*                  int length;
+* Return         : None
+******************************************************************************/
+void line_clean(char* text, int length) {
+    for (int i = 0; i < length; i++) {
+        if (text[i] == '\n' || text[i] == '\0') {
+            text[i] = ' ';
+        }
+    }
+}
+
+/******************************************************************************
+* Function Name  : message_line(const Message* message, char* line)
+* Description    : Spell a message out as the line it stands for, without
+*                  its newline. Fields are cleaned up as line_clean does
+* Input          : const Message* message;
+*                  char* line; room for the line and a NUL, or NULL to
+*                  only count
+* Return         : The length of the line
+******************************************************************************/
+int message_line(const Message* message, char* line) {
+    int headLength = strlen(message->head);
+    int fieldLength = message->end - message->field1;
+
+    if (message->colons == 0) {
+        fieldLength = -1;
+    }
+    if (line == NULL) {
+        return headLength + 1 + fieldLength;
+    }
+    memcpy(line, message->head, headLength);
+    if (fieldLength >= 0) {
+        line[headLength] = ':';
+        memcpy(line + headLength + 1, message->field1, fieldLength);
+        if (message->second != NULL) {
+            line[headLength + 1 + (message->second - message->field1)] = ':';
+        }
+        line_clean(line + headLength + 1, fieldLength);
+    }
+    line[headLength + 1 + fieldLength] = '\0';
+    return headLength + 1 + fieldLength;
+}
+
+/******************************************************************************
+* Function Name  : line_reader_init(LineReader* reader, int fd)
+* Description    : Set up a line reader over a descriptor
+* Input          : LineReader* reader;
+*                  int fd;
+* Return         : None
+******************************************************************************/
+void line_reader_init(LineReader* reader, int fd) {
+    reader->fd = fd;
+    reader->ring = NULL;
+    reader->buffer = (char*)malloc(sizeof(char) * LINE_BUFFER);
+    reader->start = 0;
+    reader->length = 0;
+    reader->capacity = LINE_BUFFER;
+    reader->eof = 0;
+    reader->binary = 0;
+    reader->frameLine = NULL;
+    reader->frameLineCapacity = 0;
+}
+
+/******************************************************************************
+* Function Name  : line_reader_fill(LineReader* reader)
+* Description    : Read once from the descriptor (or ring) into the buffer.
+*                  Handled lines are dropped from the front first. A full
+*                  buffer only grows when it holds no whole line (or frame,
+*                  for a binary reader), else nothing is read until the
+*                  caller has taken some
+* Input          : LineReader* reader;
+* Return         : Number of bytes read, 0 at the end of input or -1 if a
+*                  non-blocking descriptor or a ring has nothing, or the
+*                  buffer is full of input to take
+******************************************************************************/
+int line_reader_fill(LineReader* reader) {
+    if (reader->start > 0) {
+        memmove(reader->buffer, reader->buffer + reader->start,
+                reader->length - reader->start);
+        reader->length -= reader->start;
+        reader->start = 0;
+    }
+    // one byte is kept spare to terminate a last unfinished line
+    if (reader->length + 1 >= reader->capacity) {
+        if (line_reader_ready(reader)) {
+            return -1;
+        }
+        reader->capacity *= 2;
+        reader->buffer = (char*)realloc(reader->buffer,
+                sizeof(char) * reader->capacity);
+    }
+
+    if (reader->ring != NULL) {
+        int count = ring_read(reader->ring, reader->buffer + reader->length,
+                reader->capacity - reader->length - 1);
+        reader->length += count;
+        return count > 0 ? count : -1;
+    }
+    while (1) {
+        ssize_t count = read(reader->fd, reader->buffer + reader->length,
+                reader->capacity - reader->length - 1);
+        if (count > 0) {
+            reader->length += count;
+            return count;
+        }
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return -1;
+        }
+        reader->eof = 1;
+        return 0;
+    }
+}
+
+/******************************************************************************
+* Function Name  : line_reader_next(LineReader* reader, int* length)
+* Description    : Take the next whole line already in the buffer. The line
+*                  is terminated in place and stays valid until the next
+*                  fill. At the end of input a last line without a newline
+*                  is returned too
+* Input          : LineReader* reader;
+*                  int* length; set to the line length if not NULL
+* Return         : The line without its newline, or NULL if none is ready
+******************************************************************************/
+char* line_reader_next(LineReader* reader, int* length) {
+    char* line = reader->buffer + reader->start;
+    int available = reader->length - reader->start;
+    char* newline = memchr(line, '\n', available);
+    int lineLength;
+
+    if (newline != NULL) {
+        lineLength = newline - line;
+        reader->start += lineLength + 1;
+    } else if (reader->eof && available > 0) {
+        lineLength = available;
+        reader->start = reader->length;
+    } else {
+        return NULL;
+    }
+    line[lineLength] = '\0';
+    if (length != NULL) {
+        *length = lineLength;
+    }
+    return line;
+}
+
+/******************************************************************************
+* Function Name  : line_reader_ready(LineReader* reader)
+* Description    : Check for a whole line, or a whole frame for a binary
+*                  reader, already in the buffer
+* Input          : LineReader* reader;
+* Return         : 1 if there is one to take, 0 otherwise
+******************************************************************************/
+int line_reader_ready(LineReader* reader) {
+    unsigned char* data = (unsigned char*)reader->buffer + reader->start;
+    size_t available = reader->length - reader->start;
+    size_t offset = 0;
+    uint64_t size;
+    int status;
+
+    if (!reader->binary) {
+        return memchr(data, '\n', available) != NULL;
+    }
+    status = get_varint(data, available, &offset, &size);
+    // a bad frame counts, taking it ends the input
+    return status < 0 || (status > 0
+            && (size > INT32_MAX || size <= available - offset));
+}
+
+/******************************************************************************
+* Function Name  : line_reader_push(LineReader* reader, const char* data,
+*                  int length)
+* Description    : Add a line to a reader that is fed by hand rather than
+*                  from a descriptor, its newline is added
+* Input          : LineReader* reader;
+*                  const char* data;
+*                  int length;
+* Return         : None
+******************************************************************************/
+void line_reader_push(LineReader* reader, const char* data, int length) {
+    if (reader->start > 0) {
+        memmove(reader->buffer, reader->buffer + reader->start,
+                reader->length - reader->start);
+        reader->length -= reader->start;
+        reader->start = 0;
+    }
+    // with the spare byte line_reader_fill keeps
+    while (reader->length + length + 2 > reader->capacity) {
+        reader->capacity *= 2;
+        reader->buffer = (char*)realloc(reader->buffer,
+                sizeof(char) * reader->capacity);
+    }
+    memcpy(reader->buffer + reader->length, data, length);
+    reader->buffer[reader->length + length] = '\n';
+    reader->length += length + 1;
+}
+
+/******************************************************************************
+* Function Name  : read_line(LineReader* reader)
+* Description    : Read the next line from a blocking descriptor
+* Input          : LineReader* reader;
+* Return         : The line (see line_reader_next), NULL at the end of input
+******************************************************************************/
+char* read_line(LineReader* reader) {
+    char* line;
+
+    while ((line = line_reader_next(reader, NULL)) == NULL && !reader->eof) {
+        line_reader_fill(reader);
+    }
+    return line;
+}
+
+/******************************************************************************
+* Function Name  : ring_space(Ring* ring)
+* Description    : Count the bytes that can be added to a ring
+* Input          : Ring* ring;
+* Return         : The free bytes
+******************************************************************************/
+int ring_space(Ring* ring) {
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    return RING_SIZE - (int)(tail - head);
+}
+
+/******************************************************************************
+* Function Name  : ring_write(Ring* ring, const char* data, int length)
+* Description    : Add as many bytes as fit to a ring, only the producer
+*                  side may call this
+* Input          : Ring* ring;
+*                  const char* data;
+*                  int length;
+* Return         : Number of bytes added
+******************************************************************************/
+int ring_write(Ring* ring, const char* data, int length) {
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint32_t tail = ring->tail;
+    int space = RING_SIZE - (int)(tail - head);
+    int offset = tail % RING_SIZE;
+    int first;
+
+    if (length > space) {
+        length = space;
+    }
+    first = length < RING_SIZE - offset ? length : RING_SIZE - offset;
+    memcpy(ring->data + offset, data, first);
+    memcpy(ring->data, data + first, length - first);
+    __atomic_store_n(&ring->tail, tail + length, __ATOMIC_SEQ_CST);
+    return length;
+}
+
+/******************************************************************************
+* Function Name  : ring_read(Ring* ring, char* data, int length)
+* Description    : Take up to length bytes from a ring, only the consumer
+*                  side may call this
+* Input          : Ring* ring;
+*                  char* data;
+*                  int length;
+* Return         : Number of bytes taken
+******************************************************************************/
+int ring_read(Ring* ring, char* data, int length) {
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    uint32_t head = ring->head;
+    int used = (int)(tail - head);
+    int offset = head % RING_SIZE;
+    int first;
+
+    if (length > used) {
+        length = used;
+    }
+    first = length < RING_SIZE - offset ? length : RING_SIZE - offset;
+    memcpy(data, ring->data + offset, first);
+    memcpy(data + first, ring->data, length - first);
+    __atomic_store_n(&ring->head, head + length, __ATOMIC_SEQ_CST);
+    return length;
+}
+
+/******************************************************************************
+* Function Name  : wake_fd(int fd)
+* Description    : Signal an eventfd
+* Input          : int fd;
+* Return         : None
+******************************************************************************/
+void wake_fd(int fd) {
+    uint64_t one = 1;
+    ssize_t written;
+
+    do {
+        written = write(fd, &one, sizeof(one));
+    } while (written < 0 && errno == EINTR);
+}
+
+/******************************************************************************
+* Function Name  : transport_init()
+* Description    : Connect to the server. If the server handed over a
+*                  shared memory link (CHAT_SHM=memfd,wakefd,notifyfd)
+*                  lines go through its rings, otherwise through
+*                  stdin and stdout
+* Input          : None
+* Return         : None
+******************************************************************************/
+void transport_init() {
+    char* shm = getenv(SHM_ENV);
+    int memFd;
+
+    line_reader_init(&serverInput, 0);
+    if (shm == NULL
+            || sscanf(shm, "%d,%d,%d", &memFd, &wakeFd, &notifyFd) != 3) {
+        return;
+    }
+    serverLink = (SharedLink*)mmap(NULL, sizeof(SharedLink),
+            PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0);
+    close(memFd);
+    if (serverLink == MAP_FAILED) {
+        serverLink = NULL;
+        return;
+    }
+    serverInput.ring = &serverLink->toChild;
+}
+
+/******************************************************************************
+* Function Name  : wait_for_server(Ring* ring, int forSpace)
+* Description    : Sleep until the server has put data in (or, forSpace,
+*                  taken data out of) a ring. Anything the server writes
+*                  on stdin is thrown away, stdin closing means the server
+*                  has gone
+* Input          : Ring* ring;
+*                  int forSpace;
+* Return         : None
+******************************************************************************/
+static void wait_for_server(Ring* ring, int forSpace) {
+    struct pollfd fds[2];
+    char scrap[512];
+    uint64_t count;
+
+    // say we sleep before looking again, so no wake up is lost
+    __atomic_store_n(&serverLink->childWaiting, 1, __ATOMIC_SEQ_CST);
+    if ((forSpace && ring_space(ring) > 0)
+            || (!forSpace && ring_space(ring) < RING_SIZE)) {
+        __atomic_store_n(&serverLink->childWaiting, 0, __ATOMIC_SEQ_CST);
+        return;
+    }
+    fds[0].fd = wakeFd;
+    fds[0].events = POLLIN;
+    fds[1].fd = 0;
+    fds[1].events = POLLIN;
+    if (poll(fds, 2, -1) < 0) {
+        return;
+    }
+    if (fds[0].revents & POLLIN) {
+        read(wakeFd, &count, sizeof(count));
+    }
+    if (fds[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+        if (read(0, scrap, sizeof(scrap)) <= 0) {
+            serverGone = 1;
+        }
+    }
+}
+
+/******************************************************************************
+* Function Name  : fill_input()
+* Description    : Wait for more input from the server and read it
+* Input          : None
+* Return         : 1 if there may be more to take, 0 once the server has
+*                  gone and everything it sent has been read
+******************************************************************************/
+static int fill_input() {
+    if (serverInput.eof) {
+        return 0;
+    }
+    if (serverLink == NULL) {
+        line_reader_fill(&serverInput);
+        return 1;
+    }
+    if (line_reader_fill(&serverInput) > 0) {
+        // the server may be waiting for the room just made
+        if (__atomic_exchange_n(&serverLink->serverWaiting, 0,
+                __ATOMIC_SEQ_CST)) {
+            wake_fd(notifyFd);
+        }
+        return 1;
+    }
+    if (serverGone) {
+        serverInput.eof = 1;
+        return 1;
+    }
+    wait_for_server(&serverLink->toChild, 0);
+    return 1;
+}
+
+/******************************************************************************
+* Function Name  : offer_binary()
+* Description    : Ask for binary frames if the server lets children
+*                  (BINARY_ENV is set), before the first name reply, and
+*                  wait for the answer. Nothing is sent until then, so the
+*                  server knows frames start after "BIN:". Any other line
+*                  means the server does not speak frames, it is left to
+*                  be read and lines are kept
+* Input          : None
+* Return         : None
+******************************************************************************/
+void offer_binary() {
+    char* line;
+    char* newline;
+
+    if (binaryOffered || getenv(BINARY_ENV) == NULL) {
+        return;
+    }
+    send_text("BIN:\n");
+    binaryOffered = 1;
+    do {
+        line = serverInput.buffer + serverInput.start;
+        newline = memchr(line, '\n', serverInput.length - serverInput.start);
+        if (newline != NULL) {
+            if (newline - line == 4 && memcmp(line, "BIN:", 4) == 0) {
+                serverInput.start += 5;
+                serverInput.binary = 1;
+            }
+            return;
+        }
+    } while (fill_input());
+}
+
+/******************************************************************************
+* Function Name  : receive_line(int* length)
+* Description    : Read the next line sent by the server, for a process
+*                  that never asks for binary frames
+* Input          : int* length; set to the line length if not NULL
+* Return         : The line, valid until the next call, NULL once the
+*                  server has gone
+******************************************************************************/
+char* receive_line(int* length) {
+    char* line;
+
+    while (1) {
+        line = line_reader_next(&serverInput, length);
+        if (line != NULL || !fill_input()) {
+            return line;
+        }
+    }
+}
+
+/******************************************************************************
+* Function Name  : receive_message(Message* message, int* lane)
+* Description    : Read the next message sent by the server. A line is
+*                  split in place, a frame gives its command without
+*                  looking at any text
+* Input          : Message* message; valid until the next call
+*                  int* lane; if not NULL, a "lane|" in front of a line is
+*                  taken off and its lane set here, -1 if it has none
+* Return         : 1, 0 once the server has gone
+******************************************************************************/
+int receive_message(Message* message, int* lane) {
+    char* line;
+    int length;
+
+    if (lane != NULL) {
+        *lane = -1;
+    }
+    while (1) {
+        if (serverInput.binary) {
+            if (frame_next(&serverInput, message)) {
+                return 1;
+            }
+        } else if ((line = line_reader_next(&serverInput, &length))
+                != NULL) {
+            if (lane != NULL) {
+                *lane = take_lane(&line, &length);
+            }
+            split_message(line, length, message);
+            return 1;
+        }
+        if (!fill_input()) {
+            return 0;
+        }
+    }
+}
+
+/******************************************************************************
+* Function Name  : encode_lines(const char* text, int length)
+* Description    : Encode each line of some text as a frame, into
+*                  frameBuffer
+* Input          : const char* text;
+*                  int length;
+* Return         : The bytes of the frames
+******************************************************************************/
+static int encode_lines(const char* text, int length) {
+    const char* end = text + length;
+    const char* newline;
+    int lineLength;
+    int used = 0;
+
+    while (text < end) {
+        newline = memchr(text, '\n', end - text);
+        lineLength = (newline == NULL ? end : newline + 1) - text;
+        if (used + lineLength + FRAME_EXTRA > frameCapacity) {
+            frameCapacity = (used + lineLength + FRAME_EXTRA) * 2;
+            frameBuffer = (char*)realloc(frameBuffer,
+                    sizeof(char) * frameCapacity);
+        }
+        used += encode_frame(text, lineLength, frameBuffer + used);
+        text += lineLength;
+    }
+    return used;
+}
+
+/******************************************************************************
+* Function Name  : send_text(const char* format, ...)
+* Description    : Send formatted text to the server straight away, as
+*                  frames once the server has agreed to binary frames
+* Input          : const char* format;
+*                  ...;
+* Return         : None
+******************************************************************************/
+void send_text(const char* format, ...) {
+    va_list args;
+    char* data;
+    int length;
+    int sent = 0;
+
+    va_start(args, format);
+    length = vsnprintf(sendBuffer, sendCapacity, format, args);
+    va_end(args);
+    if (length >= sendCapacity) {
+        sendCapacity = length + 1;
+        sendBuffer = (char*)realloc(sendBuffer, sizeof(char) * sendCapacity);
+        va_start(args, format);
+        vsnprintf(sendBuffer, sendCapacity, format, args);
+        va_end(args);
+    }
+    data = sendBuffer;
+    if (serverInput.binary) {
+        length = encode_lines(sendBuffer, length);
+        data = frameBuffer;
+    }
+
+    while (sent < length) {
+        int count;
+        if (serverLink == NULL) {
+            count = write(1, data + sent, length - sent);
+            if (count < 0 && errno != EINTR) {
+                communication_error();
+            }
+        } else {
+            count = ring_write(&serverLink->toServer, data + sent,
+                    length - sent);
+            if (count == 0) {
+                wake_fd(notifyFd);
+                wait_for_server(&serverLink->toServer, 1);
+                if (serverGone) {
+                    communication_error();
+                }
+            }
+        }
+        if (count > 0) {
+            sent += count;
+        }
+    }
+    if (serverLink != NULL) {
+        wake_fd(notifyFd);
+    }
+}
+
+/******************************************************************************
+* Function Name  : handle_left_cmd(Message* message)
+* Description    : Handle "LEFT:" command from server, and send this
+*                  text to stderr with a specific format
+* Input          : Message* message;
+* Return         : None
+******************************************************************************/
+void handle_left_cmd(Message* message) {
+    fprintf(stderr, "(%s has left the chat)\n", message->field1);
+}
+
@@ -1,13 +1,155 @@
-void communication_error();
-
-void client_kicked();
-
-void int_length(int* nameTakenNum, int* numLength);
-
-int check_contain_colon(char* buffer);
-
-void read_stdin_dynamic(char** buffer);
-
-void read_file_dynamic(char** buffer, FILE* fp);
-
-void handle_left_cmd(char* buffer);
\ No newline at end of file
+#ifndef FUNCTION_H
+#define FUNCTION_H
+
+#include <stdint.h>
+
+/* initial size of a line reader's buffer */
+#define LINE_BUFFER 16384
+
+/* bytes in each direction of a shared memory link */
+#define RING_SIZE 65536
+
+/* environment variable giving a child its shared memory link */
+#define SHM_ENV "CHAT_SHM"
+
+/* environment variable set when the server lets children ask for binary
+ * frames */
+#define BINARY_ENV "CHAT_BINARY"
+
+/* most lanes one child runs */
+#define MAX_LANES 1000000
+
+/* most bytes a binary frame adds to the line it carries */
+#define FRAME_EXTRA 16
+
+/* one direction of a shared memory link, a single producer single
+ * consumer byte ring with free running positions */
+typedef struct {
+    uint32_t head; /* bytes taken by the consumer */
+    char headPad[60]; /* keeps head and tail on their own cache lines */
+    uint32_t tail; /* bytes added by the producer */
+    char tailPad[60];
+    char data[RING_SIZE]; /* the bytes, at position % RING_SIZE */
+} Ring;
+
+/* the memory shared by the server and one child */
+typedef struct {
+    uint32_t childWaiting; /* the child sleeps until the server wakes it */
+    uint32_t serverWaiting; /* the server waits for room in toChild */
+    char pad[56];
+    Ring toChild; /* server to child lines */
+    Ring toServer; /* child to server lines */
+} SharedLink;
+
+/* the commands of the chat protocol, told apart by the text before the
+ * first colon of a line */
+#define CMD_NONE 0 /* no colon, or not a command */
+#define CMD_WHO 1
+#define CMD_NAME 2
+#define CMD_NAME_TAKEN 3
+#define CMD_YT 4
+#define CMD_CHAT 5
+#define CMD_KICK 6
+#define CMD_DONE 7
+#define CMD_QUIT 8
+#define CMD_MSG 9
+#define CMD_LEFT 10
+#define CMD_NAME_ANY 11 /* a name to make a free one from, the server
+                         * answers NAME_ASSIGNED: if it had to change it */
+#define CMD_NAME_ASSIGNED 12
+#define CMD_BIN 13 /* asks for binary frames, or from the server agrees */
+
+/* binary framing. A child asks with "BIN:" as its first line and sends
+ * nothing more until the server answers "BIN:". After the answer both
+ * sides send frames instead of lines. A frame is a varint (7 bits a
+ * byte, low bits first, the top bit set on all but the last byte)
+ * giving the length of the rest: a one byte opcode, the CMD_* of the
+ * line, then its fields, each a varint length and the bytes. MSG: has
+ * two fields, the sender and the text, the other commands one, what
+ * follows the colon. A CMD_NONE frame carries a whole line that is not
+ * a command. Fields may hold any byte, newlines too */
+
+/* a protocol line split in place at its first colon. The fields point
+ * into the line, nothing is copied */
+typedef struct {
+    int command; /* CMD_* of head */
+    int colons; /* colons in the whole line, for a frame its fields */
+    char* head; /* the text before the first colon, the whole line if
+                 * it has none */
+    char* field1; /* the text after the first colon, empty if none */
+    char* second; /* the second colon, NULL if the line has none */
+    char* end; /* the NUL ending the line */
+} Message;
+
+/* buffered reader splitting a descriptor's input into lines */
+typedef struct {
+    int fd; /* descriptor read from */
+    Ring* ring; /* read from this ring instead if not NULL */
+    char* buffer; /* bytes read but not yet taken as lines */
+    int start; /* first byte not yet taken */
+    int length; /* end of the bytes read */
+    int capacity; /* size of buffer */
+    int eof; /* the end of input has been read */
+    int binary; /* the input is binary frames, not lines */
+    char* frameLine; /* where a message is spelled out as a line */
+    int frameLineCapacity; /* size of frameLine */
+} LineReader;
+
+void communication_error();
+
+void client_kicked();
+
+void int_length(int* nameTakenNum, int* numLength);
+
+int check_contain_colon(char* buffer);
+
+void split_message(char* line, int length, Message* message);
+
+char* second_field(Message* message);
+
+int take_lane(char** buffer, int* length);
+
+int encode_fields(int command, const char** fields, const int* lengths,
+        int count, char* frame);
+
+int encode_frame(const char* line, int length, char* frame);
+
+int frame_next(LineReader* reader, Message* message);
+
+void line_clean(char* text, int length);
+
+int message_line(const Message* message, char* line);
+
+void line_reader_init(LineReader* reader, int fd);
+
+int line_reader_fill(LineReader* reader);
+
+char* line_reader_next(LineReader* reader, int* length);
+
+int line_reader_ready(LineReader* reader);
+
+void line_reader_push(LineReader* reader, const char* data, int length);
+
+char* read_line(LineReader* reader);
+
+int ring_space(Ring* ring);
+
+int ring_write(Ring* ring, const char* data, int length);
+
+int ring_read(Ring* ring, char* data, int length);
+
+void wake_fd(int fd);
+
+void transport_init();
+
+void offer_binary();
+
+char* receive_line(int* length);
+
+int receive_message(Message* message, int* lane);
+
+void send_text(const char* format, ...);
+
+void handle_left_cmd(Message* message);
+
+#endif
@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include "joining.h"
+
+/******************************************************************************
+* Function Name  : joining_init(Joining* joining)
+* Description    : Set up with no entries or joiners, nothing to watch
+* Input          : Joining* joining;
+* Return         : None
+******************************************************************************/
+void joining_init(Joining* joining) {
+    memset(joining, 0, sizeof(Joining));
+    joining->control.fd = -1;
+    joining->configWatch = -1;
+}
+
+/******************************************************************************
+* Function Name  : queue_entry(Joining* joining, char* line)
+* Description    : Keep a config entry that arrived while the chat runs,
+*                  comments are skipped
+* Input          : Joining* joining;
+*                  char* line;
+* Return         : None
+******************************************************************************/
+static void queue_entry(Joining* joining, char* line) {
+    if (strncmp(line, "#", 1) == 0) {
+        return;
+    }
+    if (joining->entryCount == joining->entryCapacity) {
+        joining->entryCapacity = joining->entryCapacity == 0 ?
+                16 : joining->entryCapacity * 2;
+        joining->entries = (char**)realloc(joining->entries,
+                sizeof(char*) * joining->entryCapacity);
+    }
+    joining->entries[joining->entryCount++] = strdup(line);
+}
+
+/******************************************************************************
+* Function Name  : control_readable(int fd, uint32_t events, void* data)
+* Description    : Reactor handler for the -control FIFO, each line written
+*                  to it is a config entry to join the chat
+* Input          : int fd;
+*                  uint32_t events;
+*                  void* data; the Joining
+* Return         : None
+******************************************************************************/
+static void control_readable(int fd, uint32_t events, void* data) {
+    Joining* joining = (Joining*)data;
+    char* line;
+
+    while (line_reader_fill(&joining->control) > 0) {
+        continue;
+    }
+    while ((line = line_reader_next(&joining->control, NULL)) != NULL) {
+        queue_entry(joining, line);
+    }
+}
+
+/******************************************************************************
+* Function Name  : read_new_entries(Joining* joining)
+* Description    : Read the config file again and take the lines added
+*                  after the ones already read as entries to join the chat.
+*                  A file cut shorter is read on from its new end
+* Input          : Joining* joining;
+* Return         : None
+******************************************************************************/
+static void read_new_entries(Joining* joining) {
+    char* buffer;
+    int lines = 0;
+    LineReader config;
+    int fd = open(joining->configPath, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+        return;
+    }
+    line_reader_init(&config, fd);
+    while ((buffer = read_line(&config)) != NULL) {
+        if (lines++ >= joining->configLines) {
+            queue_entry(joining, buffer);
+        }
+    }
+    close(fd);
+    free(config.buffer);
+    joining->configLines = lines;
+}
+
+/******************************************************************************
+* Function Name  : config_changed(int fd, uint32_t events, void* data)
+* Description    : Reactor handler for the -watch inotify descriptor. The
+*                  directory is watched rather than the file, so a config
+*                  saved by renaming a new file over it is seen as well
+* Input          : int fd;
+*                  uint32_t events;
+*                  void* data; the Joining
+* Return         : None
+******************************************************************************/
+static void config_changed(int fd, uint32_t events, void* data) {
+    Joining* joining = (Joining*)data;
+    char buffer[4096]
+            __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct inotify_event* event;
+    ssize_t count;
+    int changed = 0;
+
+    while ((count = read(fd, buffer, sizeof(buffer))) > 0) {
+        for (char* next = buffer; next < buffer + count;
+                next += sizeof(struct inotify_event) + event->len) {
+            event = (struct inotify_event*)next;
+            if (event->len > 0
+                    && strcmp(event->name, joining->configName) == 0) {
+                changed = 1;
+            }
+        }
+    }
+    if (changed) {
+        read_new_entries(joining);
+    }
+}
+
+/******************************************************************************
+* Function Name  : joining_open(Joining* joining, Reactor* reactor)
+* Description    : Open the -control FIFO, creating it if needed, and start
+*                  the -watch on the config file, both read by reactor. A
+*                  writer of the server's own keeps the FIFO from reading
+*                  end of file each time a writer closes it. The server
+*                  exits if either cannot be opened
+* Input          : Joining* joining;
+*                  Reactor* reactor;
+* Return         : None
+******************************************************************************/
+void joining_open(Joining* joining, Reactor* reactor) {
+    char* path = joining->configPath;
+    char* slash;
+    char* dir;
+
+    if (joining->controlPath != NULL) {
+        if (mkfifo(joining->controlPath, 0600) < 0 && errno != EEXIST) {
+            perror(joining->controlPath);
+            exit(1);
+        }
+        line_reader_init(&joining->control, open(joining->controlPath,
+                O_RDONLY | O_NONBLOCK | O_CLOEXEC));
+        if (joining->control.fd < 0 || open(joining->controlPath,
+                O_WRONLY | O_CLOEXEC) < 0) {
+            perror(joining->controlPath);
+            exit(1);
+        }
+        reactor_add(reactor, joining->control.fd, EPOLLIN, control_readable,
+                joining);
+    }
+    if (joining->watchMode) {
+        slash = strrchr(path, '/');
+        joining->configName = slash == NULL ? path : slash + 1;
+        dir = slash == NULL ? strdup(".") : slash == path ?
+                strdup("/") : strndup(path, slash - path);
+        joining->configWatch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (joining->configWatch < 0 || inotify_add_watch(
+                joining->configWatch, dir, IN_CLOSE_WRITE | IN_MOVED_TO)
+                < 0) {
+            perror(path);
+            exit(1);
+        }
+        free(dir);
+        reactor_add(reactor, joining->configWatch, EPOLLIN, config_changed,
+                joining);
+    }
+}
+
+/******************************************************************************
+* Function Name  : joining_enabled(Joining* joining)
+* Description    : Check whether clients may join the running chat, with
+*                  -control or -watch
+* Input          : Joining* joining;
+* Return         : 1 if they may, 0 otherwise
+******************************************************************************/
+int joining_enabled(Joining* joining) {
+    return joining->controlPath != NULL || joining->watchMode;
+}
+
+/******************************************************************************
+* Function Name  : joining_add(Joining* joining, int slot)
+* Description    : Add a client started while the chat runs to the ones
+*                  waiting to be let in
+* Input          : Joining* joining;
+*                  int slot;
+* Return         : None
+******************************************************************************/
+void joining_add(Joining* joining, int slot) {
+    if (joining->joinerCount == joining->joinerCapacity) {
+        joining->joinerCapacity = joining->joinerCapacity == 0 ?
+                16 : joining->joinerCapacity * 2;
+        joining->joiners = (int*)realloc(joining->joiners,
+                sizeof(int) * joining->joinerCapacity);
+    }
+    joining->joiners[joining->joinerCount++] = slot;
+}
+
+/******************************************************************************
+* Function Name  : joining_clear_entries(Joining* joining)
+* Description    : Drop the entries that arrived, once they are spawned
+* Input          : Joining* joining;
+* Return         : None
+******************************************************************************/
+void joining_clear_entries(Joining* joining) {
+    for (int i = 0; i < joining->entryCount; i++) {
+        free(joining->entries[i]);
+    }
+    joining->entryCount = 0;
+}
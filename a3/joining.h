@@ -0,0 +1,39 @@
+#ifndef JOINING_H
+#define JOINING_H
+
+#include "function.h"
+#include "reactor.h"
+
+/* clients joining the running chat. Config entries written to the
+ * -control FIFO, or added to the config file with -watch, wait for the
+ * next round boundary to be spawned, and the clients started from them
+ * wait there for a name to be let in */
+typedef struct {
+    char** entries; /* config entries that arrived, not yet spawned */
+    int entryCount; /* number of entries */
+    int entryCapacity; /* size of entries */
+    int* joiners; /* slots of the clients started, in the order they
+                   * were, waiting to be let in */
+    int joinerCount; /* number of joiners */
+    int joinerCapacity; /* size of joiners */
+    char* controlPath; /* with -control, the FIFO, NULL without */
+    LineReader control; /* lines read from the FIFO */
+    int watchMode; /* with -watch, lines added to the config file join */
+    int configWatch; /* inotify watch on the config file's directory, -1
+                      * without -watch */
+    char* configPath; /* the config file */
+    char* configName; /* the config file's name in its directory */
+    int configLines; /* lines of the config file already read */
+} Joining;
+
+void joining_init(Joining* joining);
+
+void joining_open(Joining* joining, Reactor* reactor);
+
+int joining_enabled(Joining* joining);
+
+void joining_add(Joining* joining, int slot);
+
+void joining_clear_entries(Joining* joining);
+
+#endif
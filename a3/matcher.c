@@ -0,0 +1,160 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "matcher.h"
+
+/******************************************************************************
+* Function Name  : matcher_classes(Matcher* matcher, char** stimuli,
+*                  int count)
+* Description    : Give every folded byte used by a stimulus its own input
+*                  class, both cases of a letter share one. The other bytes
+*                  all fall in class 0
+* Input          : Matcher* matcher;
+*                  char** stimuli;
+*                  int count;
+* Return         : None
+******************************************************************************/
+static void matcher_classes(Matcher* matcher, char** stimuli, int count) {
+    unsigned char folded[256];
+
+    memset(folded, 0, sizeof(folded));
+    matcher->classCount = 1;
+    for (int i = 0; i < count; i++) {
+        for (const char* c = stimuli[i]; *c != '\0'; c++) {
+            int lower = tolower((unsigned char)*c);
+            if (folded[lower] == 0) {
+                folded[lower] = matcher->classCount++;
+            }
+        }
+    }
+    for (int c = 0; c < 256; c++) {
+        matcher->classOf[c] = folded[tolower(c)];
+    }
+}
+
+/******************************************************************************
+* Function Name  : matcher_build(Matcher* matcher, char** stimuli, int count)
+* Description    : Compile the stimuli into a trie, then fill in the failure
+*                  transitions breadth first so every state has a move on
+*                  every class. A state's output chain lists the stimuli
+*                  ending there followed by those of its failure state
+* Input          : Matcher* matcher;
+*                  char** stimuli;
+*                  int count;
+* Return         : None
+******************************************************************************/
+void matcher_build(Matcher* matcher, char** stimuli, int count) {
+    int capacity = 1;
+    int* fail;
+    int* ownTail;
+    int* queue;
+    int queueHead = 0;
+    int queueTail = 0;
+
+    matcher_classes(matcher, stimuli, count);
+    for (int i = 0; i < count; i++) {
+        capacity += strlen(stimuli[i]);
+    }
+    int width = matcher->classCount;
+    // 0 doubles as "no edge" while building, no edge leads back to the root
+    matcher->next = (int*)calloc((size_t)capacity * width, sizeof(int));
+    matcher->output = (int*)malloc(sizeof(int) * capacity);
+    matcher->outputNext = (int*)malloc(sizeof(int) * (count + 1));
+    matcher->stimulusCount = count;
+    matcher->stateCount = 1;
+    fail = (int*)calloc(capacity, sizeof(int));
+    ownTail = (int*)malloc(sizeof(int) * capacity);
+    queue = (int*)malloc(sizeof(int) * capacity);
+    memset(matcher->output, -1, sizeof(int) * capacity);
+    memset(ownTail, -1, sizeof(int) * capacity);
+
+    for (int i = 0; i < count; i++) {
+        int state = 0;
+        for (const char* c = stimuli[i]; *c != '\0'; c++) {
+            int* edge = &matcher->next[state * width
+                    + matcher->classOf[(unsigned char)*c]];
+            if (*edge == 0) {
+                *edge = matcher->stateCount++;
+            }
+            state = *edge;
+        }
+        // stimuli ending in the same state keep script order
+        matcher->outputNext[i] = -1;
+        if (ownTail[state] < 0) {
+            matcher->output[state] = i;
+        } else {
+            matcher->outputNext[ownTail[state]] = i;
+        }
+        ownTail[state] = i;
+    }
+
+    queue[queueTail++] = 0;
+    while (queueHead < queueTail) {
+        int state = queue[queueHead++];
+        for (int c = 0; c < width; c++) {
+            int* edge = &matcher->next[state * width + c];
+            int fallback = state == 0 ? 0 : matcher->next[fail[state] * width
+                    + c];
+            if (*edge == 0) {
+                *edge = fallback;
+                continue;
+            }
+            int child = *edge;
+            fail[child] = fallback;
+            // the failure state is shallower, its chain is already final
+            if (ownTail[child] < 0) {
+                matcher->output[child] = matcher->output[fallback];
+            } else {
+                matcher->outputNext[ownTail[child]] =
+                        matcher->output[fallback];
+            }
+            queue[queueTail++] = child;
+        }
+    }
+    free(fail);
+    free(ownTail);
+    free(queue);
+}
+
+/******************************************************************************
+* Function Name  : matcher_scan(const Matcher* matcher, const char* text,
+*                  MatchHandler handler, void* data)
+* Description    : Scan text once, calling handler(stimulus, data) for every
+*                  occurrence of every stimulus, in the order the
+*                  occurrences end. Empty stimuli match before each byte
+*                  and at the end
+* Input          : const Matcher* matcher;
+*                  const char* text;
+*                  MatchHandler handler;
+*                  void* data;
+* Return         : None
+******************************************************************************/
+void matcher_scan(const Matcher* matcher, const char* text,
+        MatchHandler handler, void* data) {
+    int state = 0;
+
+    for (int i = matcher->output[0]; i >= 0; i = matcher->outputNext[i]) {
+        handler(i, data);
+    }
+    for (const unsigned char* c = (const unsigned char*)text; *c != '\0';
+            c++) {
+        state = matcher->next[state * matcher->classCount
+                + matcher->classOf[*c]];
+        for (int i = matcher->output[state]; i >= 0;
+                i = matcher->outputNext[i]) {
+            handler(i, data);
+        }
+    }
+}
+
+/******************************************************************************
+* Function Name  : matcher_free(Matcher* matcher)
+* Description    : Free the tables of a matcher
+* Input          : Matcher* matcher;
+* Return         : None
+******************************************************************************/
+void matcher_free(Matcher* matcher) {
+    free(matcher->next);
+    free(matcher->output);
+    free(matcher->outputNext);
+}
@@ -0,0 +1,25 @@
+#ifndef MATCHER_H
+#define MATCHER_H
+
+/* called for each stimulus found in a scanned text */
+typedef void (*MatchHandler)(int stimulus, void* data);
+
+/* stimuli compiled into an Aho-Corasick automaton over case folded bytes */
+typedef struct {
+    unsigned char classOf[256]; /* input class of each byte, 0 if unused */
+    int classCount; /* number of input classes, class 0 included */
+    int stateCount; /* number of states, state 0 is the root */
+    int* next; /* stateCount * classCount transitions */
+    int* output; /* per state, first stimulus matched on reaching it or -1 */
+    int* outputNext; /* per stimulus, next stimulus matched with it or -1 */
+    int stimulusCount; /* number of stimuli */
+} Matcher;
+
+void matcher_build(Matcher* matcher, char** stimuli, int count);
+
+void matcher_scan(const Matcher* matcher, const char* text,
+        MatchHandler handler, void* data);
+
+void matcher_free(Matcher* matcher);
+
+#endif
@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "reactor.h"
+
+/* most events handled by one call to reactor_run_once */
+#define MAX_EVENTS 64
+
+/******************************************************************************
+* Function Name  : reactor_init(Reactor* reactor)
+* Description    : Create the epoll instance of an empty reactor
+* Input          : Reactor* reactor;
+* Return         : None
+******************************************************************************/
+void reactor_init(Reactor* reactor) {
+    reactor->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    reactor->watches = NULL;
+    reactor->watchCount = 0;
+
+    if (reactor->epollFd < 0) {
+        perror("epoll_create1");
+        exit(4);
+    }
+}
+
+/******************************************************************************
+* Function Name  : reactor_add(Reactor* reactor, int fd, uint32_t events,
+*                  EventHandler handler, void* data)
+* Description    : Start watching fd, handler(fd, events, data) is called
+*                  whenever it is ready. Errors and hang ups are always
+*                  reported, even with no events asked for
+* Input          : Reactor* reactor;
+*                  int fd;
+*                  uint32_t events;
+*                  EventHandler handler;
+*                  void* data;
+* Return         : None
+******************************************************************************/
+void reactor_add(Reactor* reactor, int fd, uint32_t events,
+        EventHandler handler, void* data) {
+    struct epoll_event event;
+
+    if (fd >= reactor->watchCount) {
+        int count = reactor->watchCount == 0 ? 64 : reactor->watchCount;
+        while (count <= fd) {
+            count *= 2;
+        }
+        reactor->watches = (Watch*)realloc(reactor->watches,
+                sizeof(Watch) * count);
+        memset(reactor->watches + reactor->watchCount, 0,
+                sizeof(Watch) * (count - reactor->watchCount));
+        reactor->watchCount = count;
+    }
+    reactor->watches[fd].handler = handler;
+    reactor->watches[fd].data = data;
+    reactor->watches[fd].events = events;
+
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.fd = fd;
+    epoll_ctl(reactor->epollFd, EPOLL_CTL_ADD, fd, &event);
+}
+
+/******************************************************************************
+* Function Name  : reactor_modify(Reactor* reactor, int fd, uint32_t events)
+* Description    : Change the events watched on fd, if they changed
+* Input          : Reactor* reactor;
+*                  int fd;
+*                  uint32_t events;
+* Return         : None
+******************************************************************************/
+void reactor_modify(Reactor* reactor, int fd, uint32_t events) {
+    struct epoll_event event;
+
+    if (fd >= reactor->watchCount || reactor->watches[fd].handler == NULL
+            || reactor->watches[fd].events == events) {
+        return;
+    }
+    reactor->watches[fd].events = events;
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.fd = fd;
+    epoll_ctl(reactor->epollFd, EPOLL_CTL_MOD, fd, &event);
+}
+
+/******************************************************************************
+* Function Name  : reactor_remove(Reactor* reactor, int fd)
+* Description    : Stop watching fd, events already collected for it
+*                  are dropped
+* Input          : Reactor* reactor;
+*                  int fd;
+* Return         : None
+******************************************************************************/
+void reactor_remove(Reactor* reactor, int fd) {
+    if (fd < 0 || fd >= reactor->watchCount
+            || reactor->watches[fd].handler == NULL) {
+        return;
+    }
+    reactor->watches[fd].handler = NULL;
+    reactor->watches[fd].data = NULL;
+    epoll_ctl(reactor->epollFd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+/******************************************************************************
+* Function Name  : reactor_run_once(Reactor* reactor, int timeoutMs)
+* Description    : Wait up to timeoutMs (-1 for ever) for ready descriptors
+*                  and call their handlers
+* Input          : Reactor* reactor;
+*                  int timeoutMs;
+* Return         : The number of events handled
+******************************************************************************/
+int reactor_run_once(Reactor* reactor, int timeoutMs) {
+    struct epoll_event events[MAX_EVENTS];
+    int count = epoll_wait(reactor->epollFd, events, MAX_EVENTS, timeoutMs);
+
+    if (count < 0) {
+        if (errno != EINTR) {
+            perror("epoll_wait");
+            exit(4);
+        }
+        return 0;
+    }
+    for (int i = 0; i < count; i++) {
+        int fd = events[i].data.fd;
+        // an earlier handler may have stopped watching it
+        if (fd < reactor->watchCount && reactor->watches[fd].handler != NULL) {
+            reactor->watches[fd].handler(fd, events[i].events,
+                    reactor->watches[fd].data);
+        }
+    }
+    return count;
+}
+
+/******************************************************************************
+* Function Name  : set_nonblocking(int fd)
+* Description    : Put fd in non-blocking mode
+* Input          : int fd;
+* Return         : None
+******************************************************************************/
+void set_nonblocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
@@ -0,0 +1,37 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <stdint.h>
+#include <sys/epoll.h>
+
+/* called when a watched descriptor is ready */
+typedef void (*EventHandler)(int fd, uint32_t events, void* data);
+
+/* what is watched on one descriptor */
+typedef struct {
+    EventHandler handler; /* NULL if the descriptor is not watched */
+    void* data; /* passed back to handler */
+    uint32_t events; /* EPOLLIN / EPOLLOUT interest */
+} Watch;
+
+/* one epoll instance and the handlers of its descriptors */
+typedef struct {
+    int epollFd; /* the epoll instance */
+    Watch* watches; /* indexed by descriptor */
+    int watchCount; /* number of entries in watches */
+} Reactor;
+
+void reactor_init(Reactor* reactor);
+
+void reactor_add(Reactor* reactor, int fd, uint32_t events,
+        EventHandler handler, void* data);
+
+void reactor_modify(Reactor* reactor, int fd, uint32_t events);
+
+void reactor_remove(Reactor* reactor, int fd);
+
+int reactor_run_once(Reactor* reactor, int timeoutMs);
+
+void set_nonblocking(int fd);
+
+#endif
@@ -0,0 +1,349 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "registry.h"
+
+/* initial size of each registry array */
+#define REGISTRY_SIZE 64
+
+/* marks of the name hash table */
+#define NAME_EMPTY -1
+#define NAME_DELETED -2
+
+/******************************************************************************
+* Function Name  : hash_name(char* name)
+* Description    : FNV-1a hash of a client name
+* Input          : char* name;
+* Return         : The hash
+******************************************************************************/
+static uint32_t hash_name(char* name) {
+    uint32_t hash = 2166136261u;
+
+    for (; *name != '\0'; name++) {
+        hash = (hash ^ (unsigned char)*name) * 16777619u;
+    }
+    return hash;
+}
+
+/******************************************************************************
+* Function Name  : registry_init(Registry* registry)
+* Description    : Set up an empty registry
+* Input          : Registry* registry;
+* Return         : None
+******************************************************************************/
+void registry_init(Registry* registry) {
+    memset(registry, 0, sizeof(Registry));
+    registry->freeSlot = -1;
+    registry->nameCapacity = REGISTRY_SIZE;
+    registry->names = (int*)malloc(sizeof(int) * registry->nameCapacity);
+    memset(registry->names, 0xff, sizeof(int) * registry->nameCapacity);
+    registry->baseCapacity = REGISTRY_SIZE;
+    registry->bases = (NameBase*)calloc(registry->baseCapacity,
+            sizeof(NameBase));
+}
+
+/******************************************************************************
+* Function Name  : grow_order(Registry* registry)
+* Description    : Make room for one more entry in the turn order
+* Input          : Registry* registry;
+* Return         : None
+******************************************************************************/
+static void grow_order(Registry* registry) {
+    if (registry->orderCount == registry->orderCapacity) {
+        registry->orderCapacity = registry->orderCapacity == 0 ?
+                REGISTRY_SIZE : registry->orderCapacity * 2;
+        registry->order = (int*)realloc(registry->order,
+                sizeof(int) * registry->orderCapacity);
+    }
+}
+
+/******************************************************************************
+* Function Name  : registry_add(Registry* registry, char* run,
+*                  char* fileToRun)
+* Description    : Put a new client in a free slot, or a new one, and add
+*                  it at the end of the turn order. Client pointers taken
+*                  before may move when a new slot is needed
+* Input          : Registry* registry;
+*                  char* run;
+*                  char* fileToRun;
+* Return         : The client
+******************************************************************************/
+Client* registry_add(Registry* registry, char* run, char* fileToRun) {
+    int id;
+    Client* client;
+
+    if (registry->freeSlot >= 0) {
+        id = registry->freeSlot;
+        registry->freeSlot = registry->slots[id].nextFree;
+    } else {
+        if (registry->slotCount == registry->slotCapacity) {
+            registry->slotCapacity = registry->slotCapacity == 0 ?
+                    REGISTRY_SIZE : registry->slotCapacity * 2;
+            registry->slots = (Client*)realloc(registry->slots,
+                    sizeof(Client) * registry->slotCapacity);
+        }
+        id = registry->slotCount++;
+    }
+    grow_order(registry);
+
+    client = &registry->slots[id];
+    memset(client, 0, sizeof(Client));
+    client->id = id;
+    client->inUse = 1;
+    client->run = strdup(run);
+    client->fileToRun = strdup(fileToRun);
+    client->reader.fd = -1;
+    client->writeFd = -1;
+    client->wakeFd = -1;
+    client->notifyFd = -1;
+    client->host = -1;
+    client->relay = -1;
+    client->relayFd = -1;
+    client->position = registry->orderCount;
+    registry->order[registry->orderCount++] = id;
+    registry->members++;
+    return client;
+}
+
+/******************************************************************************
+* Function Name  : find_name_entry(Registry* registry, char* name)
+* Description    : Probe the name hash table for a name
+* Input          : Registry* registry;
+*                  char* name;
+* Return         : Index of the entry holding name, or -1
+******************************************************************************/
+static int find_name_entry(Registry* registry, char* name) {
+    int mask = registry->nameCapacity - 1;
+    int index = hash_name(name) & mask;
+
+    while (registry->names[index] != NAME_EMPTY) {
+        int id = registry->names[index];
+        if (id >= 0 && strcmp(registry->slots[id].clientName, name) == 0) {
+            return index;
+        }
+        index = (index + 1) & mask;
+    }
+    return -1;
+}
+
+/******************************************************************************
+* Function Name  : insert_name(Registry* registry, int id)
+* Description    : Add a slot's name to the hash table, which has room
+* Input          : Registry* registry;
+*                  int id;
+* Return         : None
+******************************************************************************/
+static void insert_name(Registry* registry, int id) {
+    int mask = registry->nameCapacity - 1;
+    int index = hash_name(registry->slots[id].clientName) & mask;
+
+    while (registry->names[index] >= 0) {
+        index = (index + 1) & mask;
+    }
+    if (registry->names[index] == NAME_EMPTY) {
+        registry->nameUsed++;
+    }
+    registry->names[index] = id;
+}
+
+/******************************************************************************
+* Function Name  : registry_name(Registry* registry, Client* client,
+*                  char* name)
+* Description    : Accept a name for a client and index it, the registry
+*                  takes over the allocated name
+* Input          : Registry* registry;
+*                  Client* client;
+*                  char* name;
+* Return         : None
+******************************************************************************/
+void registry_name(Registry* registry, Client* client, char* name) {
+    client->clientName = name;
+
+    // keep the table at most half full, deleted entries included
+    if ((registry->nameUsed + 1) * 2 > registry->nameCapacity) {
+        int* old = registry->names;
+        int oldCapacity = registry->nameCapacity;
+        while ((registry->members + 1) * 4 > registry->nameCapacity) {
+            registry->nameCapacity *= 2;
+        }
+        registry->names = (int*)malloc(sizeof(int) * registry->nameCapacity);
+        memset(registry->names, 0xff, sizeof(int) * registry->nameCapacity);
+        registry->nameUsed = 0;
+        for (int i = 0; i < oldCapacity; i++) {
+            if (old[i] >= 0) {
+                insert_name(registry, old[i]);
+            }
+        }
+        free(old);
+    }
+    insert_name(registry, client->id);
+}
+
+/******************************************************************************
+* Function Name  : registry_find(Registry* registry, char* name)
+* Description    : Look up the client in the chat with a name
+* Input          : Registry* registry;
+*                  char* name;
+* Return         : The client, or NULL if no client has the name
+******************************************************************************/
+Client* registry_find(Registry* registry, char* name) {
+    int index = find_name_entry(registry, name);
+
+    return index < 0 ? NULL : &registry->slots[registry->names[index]];
+}
+
+/******************************************************************************
+* Function Name  : find_base(Registry* registry, char* base)
+* Description    : Find the suffix counter of a base name, adding one
+*                  starting at 0 if there is none
+* Input          : Registry* registry;
+*                  char* base;
+* Return         : The entry
+******************************************************************************/
+static NameBase* find_base(Registry* registry, char* base) {
+    int mask = registry->baseCapacity - 1;
+    int index = hash_name(base) & mask;
+
+    while (registry->bases[index].base != NULL) {
+        if (strcmp(registry->bases[index].base, base) == 0) {
+            return &registry->bases[index];
+        }
+        index = (index + 1) & mask;
+    }
+    // keep the table at most half full
+    if ((registry->baseUsed + 1) * 2 > registry->baseCapacity) {
+        NameBase* old = registry->bases;
+        int oldCapacity = registry->baseCapacity;
+        registry->baseCapacity *= 2;
+        registry->bases = (NameBase*)calloc(registry->baseCapacity,
+                sizeof(NameBase));
+        mask = registry->baseCapacity - 1;
+        for (int i = 0; i < oldCapacity; i++) {
+            if (old[i].base != NULL) {
+                index = hash_name(old[i].base) & mask;
+                while (registry->bases[index].base != NULL) {
+                    index = (index + 1) & mask;
+                }
+                registry->bases[index] = old[i];
+            }
+        }
+        free(old);
+        index = hash_name(base) & mask;
+        while (registry->bases[index].base != NULL) {
+            index = (index + 1) & mask;
+        }
+    }
+    registry->baseUsed++;
+    registry->bases[index].base = strdup(base);
+    registry->bases[index].next = 0;
+    return &registry->bases[index];
+}
+
+/******************************************************************************
+* Function Name  : registry_free_name(Registry* registry, char* base)
+* Description    : Make a name no client in the chat has from a base name,
+*                  the base itself if it is free, or else the base with
+*                  the next suffix counting from 0 that is free. While no
+*                  client has left, this is the name a client asking base,
+*                  then base0, base1 and so on after each NAME_TAKEN: ends
+*                  up with, found without the round trips
+* Input          : Registry* registry;
+*                  char* base;
+* Return         : The name, allocated
+******************************************************************************/
+char* registry_free_name(Registry* registry, char* base) {
+    NameBase* entry;
+    char* name;
+
+    if (registry_find(registry, base) == NULL) {
+        return strdup(base);
+    }
+    entry = find_base(registry, base);
+    name = (char*)malloc(strlen(base) + 12);
+    do {
+        sprintf(name, "%s%d", base, entry->next++);
+    } while (registry_find(registry, name) != NULL);
+    return name;
+}
+
+/******************************************************************************
+* Function Name  : registry_unlink(Registry* registry, Client* client)
+* Description    : Take a client out of the turn order and free its name.
+*                  Its order entry is only marked, so positions stay put
+*                  until registry_compact
+* Input          : Registry* registry;
+*                  Client* client;
+* Return         : None
+******************************************************************************/
+void registry_unlink(Registry* registry, Client* client) {
+    if (client->position < 0) {
+        return;
+    }
+    if (client->clientName != NULL) {
+        int index = find_name_entry(registry, client->clientName);
+        if (index >= 0 && registry->names[index] == client->id) {
+            registry->names[index] = NAME_DELETED;
+        }
+    }
+    registry->order[client->position] = -1;
+    client->position = -1;
+    registry->members--;
+}
+
+/******************************************************************************
+* Function Name  : registry_link(Registry* registry, Client* client)
+* Description    : Put an unlinked client back at the end of the turn order
+* Input          : Registry* registry;
+*                  Client* client;
+* Return         : None
+******************************************************************************/
+void registry_link(Registry* registry, Client* client) {
+    grow_order(registry);
+    client->position = registry->orderCount;
+    registry->order[registry->orderCount++] = client->id;
+    registry->members++;
+}
+
+/******************************************************************************
+* Function Name  : registry_compact(Registry* registry)
+* Description    : Close the gaps left in the turn order by unlinked clients
+* Input          : Registry* registry;
+* Return         : None
+******************************************************************************/
+void registry_compact(Registry* registry) {
+    int kept = 0;
+
+    for (int i = 0; i < registry->orderCount; i++) {
+        int id = registry->order[i];
+        if (id >= 0) {
+            registry->slots[id].position = kept;
+            registry->order[kept++] = id;
+        }
+    }
+    registry->orderCount = kept;
+}
+
+/******************************************************************************
+* Function Name  : registry_release(Registry* registry, Client* client)
+* Description    : Free an unlinked client and put its slot on the free list
+* Input          : Registry* registry;
+*                  Client* client;
+* Return         : None
+******************************************************************************/
+void registry_release(Registry* registry, Client* client) {
+    free(client->run);
+    free(client->fileToRun);
+    free(client->clientName);
+    free(client->candidate);
+    free(client->reader.buffer);
+    free(client->reader.frameLine);
+    free(client->ringReader.buffer);
+    free(client->ringReader.frameLine);
+    free(client->queue);
+    free(client->batch);
+    free(client->lanes);
+    client->inUse = 0;
+    client->nextFree = registry->freeSlot;
+    registry->freeSlot = client->id;
+}
@@ -0,0 +1,154 @@
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include "function.h"
+
+/* an encoded message, shared by every queue it is waiting in */
+typedef struct {
+    int refs; /* number of queues (and owners) still holding it */
+    int length; /* number of bytes in data */
+    char data[]; /* the message, newline included, or its binary frame */
+} Frame;
+
+/* how a client given a shared memory link talks to the server */
+#define LINK_UNKNOWN 0 /* it has not answered yet */
+#define LINK_RING 1 /* it answered through the rings */
+#define LINK_PIPE 2 /* it answered on its stdout, the rings are unused */
+
+/* why a client's input is not being read, with READ_AHEAD bytes of it
+ * waiting to be handled */
+#define HOLD_NONE 0 /* it is read as it comes */
+#define HOLD_PIPE 1 /* EPOLLIN is off for its pipe */
+#define HOLD_HUNG_UP 2 /* its pipe hung up, it is out of the reactor */
+#define HOLD_RING 3 /* its ring is left unread */
+
+/* where a client's -concurrent turn stands */
+#define BATCH_OPEN 0 /* its lines are still being gathered */
+#define BATCH_DONE 1 /* it ended its turn */
+#define BATCH_MISSED 2 /* it ran past its deadline */
+
+/* buckets of a latency histogram. Bucket 0 counts times under a
+ * microsecond, bucket i those under 2^i microseconds not counted below,
+ * and the last one everything longer */
+#define LATENCY_BUCKETS 24
+
+/* how long a client took over its turns */
+typedef struct {
+    int turns; /* turns started */
+    int missed; /* turns that ran past their deadline */
+    int64_t totalNs; /* time from YT: to the end of each turn */
+    int64_t maxNs; /* longest turn */
+    int latency[LATENCY_BUCKETS]; /* histogram of the turns taken */
+} TurnStats;
+
+/* what a client has said and been sent */
+typedef struct {
+    long chats; /* CHAT: lines */
+    long kicks; /* KICK: lines */
+    long quits; /* QUIT: lines */
+    long bytesIn; /* bytes of the lines read from it */
+    long bytesOut; /* bytes of the lines sent to it, less broadcasts */
+    long broadcastBase; /* broadcast bytes sent before it joined */
+} Counters;
+
+/* the next suffix to try for names made from a base name */
+typedef struct {
+    char* base; /* the base name, NULL for an empty entry */
+    int next; /* suffix tried next */
+} NameBase;
+
+/* one client of the chat, kept in a slot of the registry */
+typedef struct {
+    int id; /* index of its slot */
+    int inUse; /* the slot holds a client */
+    int nextFree; /* next free slot while not in use */
+    int position; /* index in the turn order, -1 once unlinked */
+    char* run; /* a program path */
+    char* fileToRun; /* execute file path */
+    char* clientName; /* client name, NULL until accepted */
+    LineReader reader; /* lines read from the child, fd -1 once closed */
+    int writeFd; /* pipe write descriptor, -1 once closed */
+    Frame** queue; /* ring of frames waiting for the child's pipe */
+    int queueHead; /* index of the oldest frame in queue */
+    int queueCount; /* number of frames in queue */
+    int queueCapacity; /* size of queue */
+    int headSent; /* bytes of the oldest frame already written */
+    int pending; /* in the list of clients to flush */
+    int departed; /* left the chat, pipes are being closed */
+    char* candidate; /* name offered in reply to WHO:, not yet accepted */
+    int anyName; /* candidate came with NAME_ANY:, a free name made from
+                  * it is given instead of NAME_TAKEN: */
+    int binary; /* asked for binary frames, it is sent them */
+    SharedLink* link; /* shared memory rings, NULL without -shm */
+    int wakeFd; /* eventfd waking the child */
+    int notifyFd; /* eventfd the child wakes the server with */
+    int linkState; /* LINK_UNKNOWN, LINK_RING or LINK_PIPE */
+    LineReader ringReader; /* lines read from the link's toServer ring */
+    int hold; /* HOLD_NONE, or why its input is not being read */
+    int turnLimit; /* ms a turn may take, 0 for no limit */
+    int roundLimit; /* ms into the round its turn must end by, 0 for none */
+    int strikes; /* deadlines missed in a row */
+    int lateTurns; /* skipped turns whose lines are still to be dropped */
+    TurnStats stats; /* its turn latencies */
+    Counters counters; /* its message and byte counts */
+    char* batch; /* messages of its -concurrent turn, see BatchEntry */
+    int batchLength; /* bytes used in batch */
+    int batchCapacity; /* size of batch */
+    int batchState; /* BATCH_OPEN, BATCH_DONE or BATCH_MISSED */
+    int ready; /* in the list of clients with lines to gather */
+    int64_t deadline; /* when its -concurrent turn must end, 0 for never */
+    int host; /* slot of the swarm child it is a lane of, -1 if it has a
+               * child of its own */
+    int lane; /* its lane number in the host */
+    int* lanes; /* a swarm child's lane slots, -1 once a lane has left */
+    int laneCount; /* lanes the child was started with, 0 if not a swarm */
+    int lanesLive; /* lanes still in the chat */
+    int joining; /* started while the chat runs and not yet let in, for a
+                  * swarm child not yet sent broadcasts */
+    int relay; /* slot of the relay writing to its child, -1 if the
+                * server writes to it */
+    int relayIndex; /* number of its child in the relay, for a relay the
+                     * children handed to it so far */
+    int relayFd; /* for a relay, the socket its children's pipes are
+                  * passed over, -1 for a client */
+} Client;
+
+/* every client, in slots reused through a free list, with the turn
+ * order kept as a dense array of slot indices and the names accepted
+ * indexed by an open addressing hash table */
+typedef struct {
+    Client* slots; /* the clients */
+    int slotCount; /* slots ever used */
+    int slotCapacity; /* size of slots */
+    int freeSlot; /* first free slot, -1 if none */
+    int* order; /* slot indices in turn order, -1 for unlinked ones */
+    int orderCount; /* entries in order */
+    int orderCapacity; /* size of order */
+    int members; /* clients still linked in order */
+    int* names; /* hash of names to slot, -1 empty, -2 deleted */
+    int nameCapacity; /* size of names, a power of two */
+    int nameUsed; /* entries of names not empty */
+    NameBase* bases; /* hash of base names given suffixes */
+    int baseCapacity; /* size of bases, a power of two */
+    int baseUsed; /* entries of bases not empty */
+} Registry;
+
+void registry_init(Registry* registry);
+
+Client* registry_add(Registry* registry, char* run, char* fileToRun);
+
+void registry_unlink(Registry* registry, Client* client);
+
+void registry_link(Registry* registry, Client* client);
+
+void registry_compact(Registry* registry);
+
+void registry_name(Registry* registry, Client* client, char* name);
+
+Client* registry_find(Registry* registry, char* name);
+
+char* registry_free_name(Registry* registry, char* base);
+
+void registry_release(Registry* registry, Client* client);
+
+#endif
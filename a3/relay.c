@@ -0,0 +1,76 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include "relay.h"
+
+/******************************************************************************
+* Function Name  : relays_init(Relays* relays)
+* Description    : Set up with no relays
+* Input          : Relays* relays;
+* Return         : None
+******************************************************************************/
+void relays_init(Relays* relays) {
+    memset(relays, 0, sizeof(Relays));
+    relays->input.fd = -1;
+    relays->fds = -1;
+}
+
+/******************************************************************************
+* Function Name  : send_fd(int socket, int fd)
+* Description    : Pass a descriptor over a unix socket, with one byte
+* Input          : int socket;
+*                  int fd;
+* Return         : 0 on success, -1 if it could not be sent
+******************************************************************************/
+int send_fd(int socket, int fd) {
+    char byte = 0;
+    char control[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = {&byte, 1};
+    struct msghdr message;
+    struct cmsghdr* header;
+
+    memset(&message, 0, sizeof(message));
+    memset(control, 0, sizeof(control));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(header), &fd, sizeof(int));
+    return sendmsg(socket, &message, MSG_NOSIGNAL) == 1 ? 0 : -1;
+}
+
+/******************************************************************************
+* Function Name  : receive_fd(int socket)
+* Description    : Take a descriptor passed with send_fd
+* Input          : int socket;
+* Return         : The descriptor, -1 if none came
+******************************************************************************/
+int receive_fd(int socket) {
+    char byte;
+    char control[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = {&byte, 1};
+    struct msghdr message;
+    struct cmsghdr* header;
+    int fd = -1;
+
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    if (recvmsg(socket, &message, MSG_CMSG_CLOEXEC) != 1) {
+        return -1;
+    }
+    header = CMSG_FIRSTHDR(&message);
+    if (header != NULL && header->cmsg_level == SOL_SOCKET
+            && header->cmsg_type == SCM_RIGHTS) {
+        memcpy(&fd, CMSG_DATA(header), sizeof(int));
+    }
+    return fd;
+}
@@ -0,0 +1,24 @@
+#ifndef RELAY_H
+#define RELAY_H
+
+#include "function.h"
+
+/* with -relays K, K relay processes forked at the start write to the
+ * children, each broadcast goes once to each relay which fans it out.
+ * The server keeps the clients standing for the relays, a relay process
+ * the sockets the server reaches it through */
+typedef struct {
+    int* slots; /* slots of the clients standing for the relays */
+    int count; /* number of relays, 0 without -relays */
+    LineReader input; /* in a relay process, the lines from the server */
+    int fds; /* in a relay process, the socket the children's pipes
+              * arrive on, -1 in the server */
+} Relays;
+
+void relays_init(Relays* relays);
+
+int send_fd(int socket, int fd);
+
+int receive_fd(int socket);
+
+#endif
@@ -0,0 +1,325 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "function.h"
+#include "trace.h"
+
+/* nanoseconds in a millisecond */
+#define NS_PER_MS 1000000.0
+
+/* the records of the child a replaybot stands in for */
+typedef struct {
+    TraceRecord* records; /* its lines, in trace order */
+    int count; /* number of records */
+    int capacity; /* room in records */
+} Recording;
+
+/******************************************************************************
+* Function Name  : args_error()
+* Description    : Report replaybot usage error with exit code 1
+* Input          : None
+* Return         : None
+******************************************************************************/
+void args_error() {
+    fprintf(stderr, "Usage: replaybot trace@index[@real]\n"
+            "       replaybot -config [-realtime] trace\n"
+            "       replaybot -stats trace\n");
+    exit(1);
+}
+
+/******************************************************************************
+* Function Name  : open_trace(TraceReader* reader, char* path)
+* Description    : Map a trace or give up with a usage error
+* Input          : TraceReader* reader;
+*                  char* path;
+* Return         : None
+******************************************************************************/
+void open_trace(TraceReader* reader, char* path) {
+    if (trace_map(reader, path) < 0) {
+        fprintf(stderr, "replaybot: %s is not a trace\n", path);
+        args_error();
+    }
+}
+
+/******************************************************************************
+* Function Name  : now_ns()
+* Description    : Read the monotonic clock
+* Input          : None
+* Return         : The time in nanoseconds
+******************************************************************************/
+int64_t now_ns() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/******************************************************************************
+* Function Name  : sleep_until(int64_t when)
+* Description    : Sleep until a monotonic time
+* Input          : int64_t when;
+* Return         : None
+******************************************************************************/
+void sleep_until(int64_t when) {
+    struct timespec until;
+
+    until.tv_sec = when / 1000000000LL;
+    until.tv_nsec = when % 1000000000LL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL)
+            != 0) {
+        continue;
+    }
+}
+
+/******************************************************************************
+* Function Name  : print_config(char* self, char* path, int realtime)
+* Description    : Print a server config replaying every child started in
+*                  the trace, in the order they were started
+* Input          : char* self; how replaybot was run
+*                  char* path;
+*                  int realtime;
+* Return         : None
+******************************************************************************/
+void print_config(char* self, char* path, int realtime) {
+    TraceReader reader;
+    TraceRecord record;
+    int index = 0;
+
+    open_trace(&reader, path);
+    while (trace_next(&reader, &record) > 0) {
+        if (record.kind == TRACE_CLIENT) {
+            printf("%s:%s@%d%s\n", self, path, index++,
+                    realtime ? "@real" : "");
+        }
+    }
+    trace_unmap(&reader);
+}
+
+/******************************************************************************
+* Function Name  : compare_time(const void* first, const void* second)
+* Description    : qsort comparator for latencies
+* Input          : const void* first;
+*                  const void* second;
+* Return         : Negative, zero or positive as first sorts before,
+*                  with or after second
+******************************************************************************/
+int compare_time(const void* first, const void* second) {
+    int64_t a = *(const int64_t*)first;
+    int64_t b = *(const int64_t*)second;
+
+    return (a > b) - (a < b);
+}
+
+/******************************************************************************
+* Function Name  : print_stats(char* path)
+* Description    : Print the rounds, messages and turn latencies of a
+*                  trace. A turn runs from YT: to the line that ends it
+* Input          : char* path;
+* Return         : None
+******************************************************************************/
+void print_stats(char* path) {
+    TraceReader reader;
+    TraceRecord record;
+    int64_t* turnStart = NULL; // per slot, 0 when no turn is open
+    int* turns = NULL; // per slot, YT: lines sent
+    int slots = 0;
+    int64_t* latencies = NULL;
+    int latencyCount = 0;
+    int latencyCapacity = 0;
+    int clients = 0;
+    int rounds = 0;
+    long messages = 0;
+    int64_t first = 0;
+    int64_t last = 0;
+
+    open_trace(&reader, path);
+    while (trace_next(&reader, &record) > 0) {
+        last = record.time;
+        if (record.client >= slots) {
+            int count = slots == 0 ? 64 : slots;
+            while (count <= record.client) {
+                count *= 2;
+            }
+            turnStart = (int64_t*)realloc(turnStart,
+                    sizeof(int64_t) * count);
+            turns = (int*)realloc(turns, sizeof(int) * count);
+            memset(turnStart + slots, 0, sizeof(int64_t) * (count - slots));
+            memset(turns + slots, 0, sizeof(int) * (count - slots));
+            slots = count;
+        }
+        if (record.kind == TRACE_CLIENT) {
+            clients++;
+            turns[record.client] = 0;
+        } else if (record.kind == TRACE_BROADCAST) {
+            messages++;
+        } else if (record.kind == TRACE_TO_CHILD && record.length == 3
+                && memcmp(record.data, "YT:", 3) == 0) {
+            if (first == 0) {
+                first = record.time;
+            }
+            turnStart[record.client] = record.time;
+            if (++turns[record.client] > rounds) {
+                rounds = turns[record.client];
+            }
+        } else if (turnStart[record.client] != 0
+                && (record.kind == TRACE_GONE
+                || (record.kind == TRACE_FROM_CHILD
+                && (record.length < 5 || (memcmp(record.data, "CHAT:", 5)
+                != 0 && memcmp(record.data, "KICK:", 5) != 0))))) {
+            if (latencyCount == latencyCapacity) {
+                latencyCapacity = latencyCapacity == 0 ?
+                        1024 : latencyCapacity * 2;
+                latencies = (int64_t*)realloc(latencies,
+                        sizeof(int64_t) * latencyCapacity);
+            }
+            latencies[latencyCount++] = record.time
+                    - turnStart[record.client];
+            turnStart[record.client] = 0;
+        }
+    }
+    trace_unmap(&reader);
+
+    double seconds = first == 0 ? 0 : (last - first) / 1e9;
+    printf("clients: %d\n", clients);
+    printf("rounds: %d (%.1f rounds/sec)\n", rounds,
+            seconds > 0 ? rounds / seconds : 0);
+    printf("messages: %ld (%.1f messages/sec)\n", messages,
+            seconds > 0 ? messages / seconds : 0);
+    if (latencyCount > 0) {
+        qsort(latencies, latencyCount, sizeof(int64_t), compare_time);
+        printf("turn latency: p50 %.3f ms, p99 %.3f ms\n",
+                latencies[(latencyCount - 1) / 2] / NS_PER_MS,
+                latencies[(latencyCount - 1) * 99 / 100] / NS_PER_MS);
+    }
+    free(turnStart);
+    free(turns);
+    free(latencies);
+}
+
+/******************************************************************************
+* Function Name  : load_recording(TraceReader* reader, int index,
+*                  Recording* recording)
+* Description    : Collect the lines of the index'th child started in the
+*                  trace, up to the start of the next child in its slot
+* Input          : TraceReader* reader;
+*                  int index;
+*                  Recording* recording;
+* Return         : None
+******************************************************************************/
+void load_recording(TraceReader* reader, int index, Recording* recording) {
+    TraceRecord record;
+    int slot = -1;
+
+    while (trace_next(reader, &record) > 0) {
+        if (record.kind == TRACE_CLIENT) {
+            if (slot >= 0 && record.client == slot) {
+                break;
+            }
+            if (index-- == 0) {
+                slot = record.client;
+            }
+            continue;
+        }
+        if (record.client != slot || record.kind == TRACE_BROADCAST) {
+            continue;
+        }
+        if (recording->count == recording->capacity) {
+            recording->capacity = recording->capacity == 0 ?
+                    64 : recording->capacity * 2;
+            recording->records = (TraceRecord*)realloc(recording->records,
+                    sizeof(TraceRecord) * recording->capacity);
+        }
+        recording->records[recording->count++] = record;
+    }
+}
+
+/******************************************************************************
+* Function Name  : replay(char* argument)
+* Description    : Stand in for a recorded child. Each WHO:, NAME_TAKEN:
+*                  and YT: from the server is matched to the next one sent
+*                  to the child in the trace, and the lines the child
+*                  answered with are sent back, at once or, with "@real",
+*                  after the delay the child took. A config entry can
+*                  only hold one colon, so the fields are split by '@'
+* Input          : char* argument; "trace@index[@real]"
+* Return         : None
+******************************************************************************/
+void replay(char* argument) {
+    TraceReader reader;
+    Recording recording;
+    char* field;
+    char* line;
+    int realtime = 0;
+    int index;
+    int cursor = 0;
+    char rest;
+
+    // fields are taken off the end, the trace path may hold '@'
+    field = strrchr(argument, '@');
+    if (field != NULL && strcmp(field, "@real") == 0) {
+        realtime = 1;
+        *field = '\0';
+        field = strrchr(argument, '@');
+    }
+    if (field == NULL || sscanf(field + 1, "%d%c", &index, &rest) != 1
+            || index < 0) {
+        args_error();
+    }
+    *field = '\0';
+    open_trace(&reader, argument);
+    memset(&recording, 0, sizeof(recording));
+    load_recording(&reader, index, &recording);
+    transport_init();
+
+    while ((line = receive_line(NULL)) != NULL) {
+        if (strncmp(line, "MSG:", 4) == 0 || strncmp(line, "LEFT:", 5) == 0) {
+            continue;
+        }
+        if (strcmp(line, "KICK:") == 0) {
+            client_kicked();
+        }
+        while (cursor < recording.count
+                && (recording.records[cursor].kind != TRACE_TO_CHILD
+                || strlen(line) != recording.records[cursor].length
+                || memcmp(line, recording.records[cursor].data,
+                strlen(line)) != 0)) {
+            cursor++;
+        }
+        if (cursor == recording.count) {
+            // the room has gone somewhere the trace never went
+            send_text("QUIT:\n");
+            exit(0);
+        }
+        int64_t asked = recording.records[cursor++].time;
+        int64_t received = now_ns();
+        while (cursor < recording.count
+                && recording.records[cursor].kind != TRACE_TO_CHILD) {
+            TraceRecord* record = &recording.records[cursor++];
+            if (realtime) {
+                sleep_until(received + (record->time - asked));
+            }
+            if (record->kind == TRACE_GONE) {
+                exit(0);
+            }
+            send_text("%.*s\n", record->length, record->data);
+        }
+    }
+    communication_error();
+}
+
+int main(int argc, char** argv) {
+    if (argc == 2 && argv[1][0] != '-') {
+        replay(argv[1]);
+    } else if (argc == 3 && strcmp(argv[1], "-config") == 0) {
+        print_config(argv[0], argv[2], 0);
+    } else if (argc == 4 && strcmp(argv[1], "-config") == 0
+            && strcmp(argv[2], "-realtime") == 0) {
+        print_config(argv[0], argv[3], 1);
+    } else if (argc == 3 && strcmp(argv[1], "-stats") == 0) {
+        print_stats(argv[2]);
+    } else {
+        args_error();
+    }
+    return 0;
+}
@@ -1,533 +1,2998 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <ctype.h>
-#include <unistd.h>
-#include <fcntl.h>
-#include <signal.h>
-#include "function.h"
-
-/* A linked list structure */
-typedef struct Node {
-    char* run; /* a program path */
-    char* fileToRun; /* execute file path */
-    char* clientName; /* client name */
-    FILE* readFD; /* pipe read file pointer */
-    FILE* writeFD; /* pipe write file pointer */
-    struct Node* next; /* Pointer point to the next Node */
-} ClientList;
-
-/******************************************************************************
-* Function Name  : print_clients(ClientList* clients)
-* Description    : Print client one by one with client name and execute file
-* Input          : ClientList* clients;
-* Return         : None
-******************************************************************************/
-void print_clients(ClientList* clients) {
-    ClientList* current = clients;
-    int i = 0;
-
-    while (current != NULL) {
-        fprintf(stderr, "%dclientname: %s\n", i, current->run);
-        fprintf(stderr, "%dfileToRun: %s\n", i, current->fileToRun);
-        current = current->next;
-        i++;
-    }
-}
-
-/******************************************************************************
-* Function Name  : add_run_files(ClientList* clients, char* run, 
-*                  char* fileToRun) 
-* Description    : Add node to the linked list with parameters
-*                  run(a program path) and fileToRun
-* Input          : ClientList* clients;
-*                  char* run; 
-*                  char* fileToRun;
-* Return         : None
-******************************************************************************/
-void add_run_files(ClientList* clients, char* run, char* fileToRun) {
-    ClientList* current = clients;
-
-    while (current->next != NULL) {
-        current = current->next;
-    }
-    
-    current->next = (ClientList*) calloc(1, sizeof(ClientList));
-    current->next->fileToRun = 
-            (char*)malloc(sizeof(char) * (strlen(fileToRun) + 1));
-    current->next->run = (char*)malloc(sizeof(char) * (strlen(run) + 1));
-    memset(current->next->fileToRun, '\0', (strlen(fileToRun) + 1));
-    memset(current->next->run, '\0', (strlen(run) + 1));
-    stpcpy(current->next->run, run);
-    stpcpy(current->next->fileToRun, fileToRun);
-    current->next->next = NULL;
-}
-
-/******************************************************************************
-* Function Name  : remove_client_run(ClientList** clients, char* run)
-* Description    : Remove node from the linked list according to
-*                  run(which is a program path)
-* Input          : ClientList** clients;
-*                  char* run; 
-* Return         : None
-******************************************************************************/
-void remove_client_run(ClientList** clients, char* run) {
-    ClientList* current = *clients;
-    ClientList* tempNode = NULL;
-
-    if (current->next == NULL) {
-        return;
-    }
-    /* Search until the next one is the value "n" */
-    while (strcmp(current->next->run, run) != 0) {
-        current = current->next;
-    }
-    
-    tempNode = current->next;   /* get tempNode for free */
-    current->next = current->next->next;
-    tempNode = NULL;
-    free(tempNode);
-}
-
-/******************************************************************************
-* Function Name  : remove_client(ClientList** clients, char* clientName) 
-* Description    : Remove node from the linked list according to client name
-* Input          : ClientList** clients;
-*                  char* clientName; 
-* Return         : None
-******************************************************************************/
-void remove_client(ClientList** clients, char* clientName) {
-    ClientList* current = *clients;
-    ClientList* tempNode = NULL;
-
-    if (current->next == NULL) {
-        return;
-    }
-    /* Search until the next one is the value "n" */
-    while (strcmp(current->next->clientName, clientName) != 0) {
-        current = current->next;
-    }
-    
-    tempNode = current->next;   /* get tempNode for free */
-    current->next = current->next->next; 
-    tempNode = NULL;
-    free(tempNode);
-}
-
-/******************************************************************************
-* Function Name  : args_error()
-* Description    : Report client usage error with error message
-*                  "Usage: server configfile" with exit code 1
-* Input          : None
-* Return         : None
-******************************************************************************/
-void args_error() {
-    fprintf(stderr, "Usage: server configfile\n");
-    exit(1);
-}
-
-/******************************************************************************
-* Function Name  : arg_checking(int argc, char** argv)
-* Description    : Check if the arguments input in command line is correct
-* Input          : int argc;
-*                  char** argv;
-* Return         : None
-******************************************************************************/
-void arg_checking(int argc, char** argv) {
-    FILE* fp = fopen(argv[1], "r");
-
-    if (argc != 2 || fp == NULL) {
-        args_error();
-    }
-}
-
-/******************************************************************************
-* Function Name  : read_fdin_dynamic(char** buffer, FILE* readFD)
-* Description    : Read the pipe file pointer dynamicly and
-*                  store the content in the buffer 
-* Input          : char** buffer;
-*                  FILE* readFD;
-* Return         : None
-******************************************************************************/
-void read_fdin_dynamic(char** buffer, FILE* readFD) {
-    char c;
-    int shiftIndex = 0;
-
-    while ((c = fgetc(readFD)) != EOF) {
-        if (c == '\n') {
-            (*buffer)[shiftIndex] = '\0';
-            break;
-        }
-        (*buffer)[shiftIndex] = c;
-        shiftIndex++;
-        *buffer = (char*)realloc(*buffer, sizeof(char) * (shiftIndex + 1));
-    }
-}
-
-/******************************************************************************
-* Function Name  : collect_information(char* buffer, ClientList* clients)
-* Description    : Split the message store in buffer, get the information of
-*                  run and fileToRun and store these to the clients linked list
-* Input          : char* buffer;
-*                  ClientList* clients; 
-* Return         : None
-******************************************************************************/
-void collect_information(char* buffer, ClientList* clients) {
-    char* run = (char*)malloc(sizeof(char) * (strlen(buffer)));
-    char* fileToRun = (char*)malloc(sizeof(char) * (strlen(buffer)));
-    memset(run, '\0', strlen(buffer));
-    memset(fileToRun, '\0', strlen(buffer));
-
-    if (check_contain_colon(buffer)) {
-        sscanf(buffer, "%[^:]:%[^\n]", run, fileToRun);
-        add_run_files(clients, run, fileToRun);
-    }
-}
-
-/******************************************************************************
-* Function Name  : read_file(char* filePath, ClientList* clients)
-* Description    : Read the execute file ignore lines with "#"
-*                  or with no colon in the line, according to
-*                  the number of valid line creat client node
-*                  in the clients linked list stimulus and response
-* Input          : char* filePath;
-*                  ClientList* clients; 
-* Return         : None
-******************************************************************************/
-void read_file(char* filePath, ClientList* clients) {
-    ClientList* current = clients;
-    char* buffer = (char*)malloc(sizeof(char));
-    int validLine = 0;
-    FILE* fp = fopen(filePath, "r");
-    read_file_dynamic(&buffer, fp);
-
-    while (!feof(fp)) {
-        if (strncmp(buffer, "#", 1) != 0) {
-            collect_information(buffer, current);
-            validLine++;
-        }
-        free(buffer);
-        buffer = malloc(sizeof(char) + 1);
-        read_file_dynamic(&buffer, fp);
-    }
-
-    if (strncmp(buffer, "#", 1) != 0) {
-        collect_information(buffer, current);
-        validLine++;
-    }
-    
-    if (validLine == 0) {
-        exit(0);
-    }
-}
-
-/******************************************************************************
-* Function Name  : open_socket(ClientList* clients) 
-* Description    : Create child process according to the clients linked
-*                  list pipe between parent process and child process,
-*                  store the read and write file pointer to 
-*                  the clients linked list
-* Input          : ClientList* clients;
-* Return         : None
-******************************************************************************/
-void open_socket(ClientList* clients) {
-    ClientList* current = clients;
-    int fdOne[2]; //send msg to child
-    int fdTwo[2]; //receive msg from child
-
-    struct sigaction sa;
-    sa.sa_handler = SIG_IGN;
-    sa.sa_flags = SA_RESTART;
-    sigaction(SIGPIPE, &sa, 0);
-    sigaction(SIGCHLD, &sa, 0);
-
-    current = current->next;
-    while (current != NULL) {
-
-        pipe(fdOne); /* read from 0 write in 1 */
-        pipe(fdTwo);
-        pid_t pid = fork();
-
-        if (pid < 0) {
-            fprintf(stderr, "create process fail\n");
-
-        } else if (pid == 0) {
-            // child read from stdin
-            close(fdOne[1]);
-            dup2(fdOne[0], 0); // 0 -> stdin's file pointer
-            close(fdOne[0]);
-            // child write in stdout
-            close(fdTwo[0]);
-            dup2(fdTwo[1], 1); // 1 -> stdout's file pointer
-            close(fdTwo[1]);
-            
-            int fdError = open("/dev/null", O_WRONLY);
-            dup2(fdError, 2);
-            execlp(current->run, current->run, current->fileToRun, NULL);
-
-        } else {
-            // parent send msg to child on fdOne
-            close(fdOne[0]);
-            current->writeFD = fdopen(fdOne[1], "w");
-            // parent read msg from child on fdTwo
-            close(fdTwo[1]);
-            current->readFD = fdopen(fdTwo[0], "r");
-        }
-
-        current = current->next;
-    }
-}
-
-/******************************************************************************
-* Function Name  : check_name_taken(char* name, ClientList* clients)
-* Description    : Check if the name sent by client has taken,
-*                  if it has taken then return nameTaken = 1,
-*                  if not return 0
-* Input          : char* name;
-*                  ClientList* clients;
-* Return         : nameTaken;
-******************************************************************************/
-int check_name_taken(char* name, ClientList* clients) {
-    int nameTaken = 0;
-    ClientList* current = clients;
-    current = current->next;
-    while (current != NULL) {
-
-        if (current->clientName == NULL) {
-            break;
-        }
-
-        if (strcmp(current->clientName, name) == 0) {
-            nameTaken = 1;
-            break;
-        }
-
-        current = current->next;
-    }
-    return nameTaken;
-}
-
-/******************************************************************************
-* Function Name  : split_buffer(char* buffer, char** content) 
-* Description    : Split the text in buffer and store the useful
-*                  message which is after colon into content
-*                  stimulus and response
-* Input          : char* buffer;
-*                  char** content;
-* Return         : None
-******************************************************************************/
-void split_buffer(char* buffer, char** content) {
-    char* rubbish = (char*)malloc(sizeof(char) * (strlen(buffer) + 1));
-    *content = (char*)malloc(sizeof(char) * (strlen(buffer) + 1));
-    memset((*content), '\0', (strlen(buffer) + 1));
-    if (check_contain_colon(buffer)) {
-        
-        sscanf(buffer, "%[^:]:%[^\n]", rubbish, *content);
-    }   
-}
-
-/******************************************************************************
-* Function Name  : collect_client_name(ClientList* clients)
-* Description    : Ask each client name by sending "WHO:" and
-*                  check the name send back from client whether 
-*                  has taken or not, if not store client name
-*                  in the corresponding client node
-* Input          : ClientList* clients;
-* Return         : None
-******************************************************************************/
-void collect_client_name(ClientList* clients) {
-    ClientList* current = clients;
-    char* buffer;
-    char* name;
-    
-    current = current->next;
-    while (current != NULL) {
-        while (1) {
-            // ask client name by sending WHO:
-            buffer = (char*)malloc(sizeof(char));
-            fprintf(current->writeFD, "WHO:\n");
-            fflush(current->writeFD);
-            // receive client response
-            read_fdin_dynamic(&buffer, current->readFD);
-            split_buffer(buffer, &name);
-            // check if name has taken
-            if (strlen(name) == 0) {
-                break;
-            }
-            if (check_name_taken(name, clients) == 0) {
-                break;
-            }
-            fprintf(current->writeFD, "NAME_TAKEN:\n");
-            fflush(current->writeFD);
-            free(buffer);
-            free(name);
-        }
-        //handle command like cat, ls
-        if (strlen(name) == 0) {
-            remove_client_run(&clients, current->run);
-        } else {
-            //store name in client node
-            current->clientName = 
-                    (char*)malloc(sizeof(char) * (strlen(name) + 1));
-            strcpy(current->clientName, name);
-            printf("(%s has entered the chat)\n", current->clientName);
-            free(name);
-        }
-        
-        free(buffer);
-        current = current->next;
-    }
-}
-
-/******************************************************************************
-* Function Name  : kick_notification(ClientList* clients, char* kickName)
-* Description    : Send the "KICK:" message to the client who is 
-*                  kicked by other client
-* Input          : ClientList* clients;
-*                  char* kickName;
-* Return         : None
-******************************************************************************/
-void kick_notification(ClientList* clients, char* kickName) {
-    ClientList* current = clients;
-    current = current->next;
-
-    while (strcmp(current->clientName, kickName) != 0) {
-        current = current->next;
-    }
-
-    fprintf(current->writeFD, "KICK:\n");
-    fflush(current->writeFD);
-}
-
-/******************************************************************************
-* Function Name  : send_msg_to_clients(ClientList* clients, char* sender,
-*                  char* message)
-* Description    : Send broadcast message to all clients
-* Input          : ClientList* clients;
-*                  char* sender; 
-*                  char* message;
-* Return         : None
-******************************************************************************/
-void send_msg_to_clients(ClientList* clients, char* sender, char* message) {
-    ClientList* current = clients;
-    current = current->next;
-
-    char* wholeMsg = 
-            (char*)malloc(sizeof(char) * 
-            (strlen(sender) + strlen(message) + 7));
-
-    sprintf(wholeMsg, "MSG:%s:%s\n", sender, message);
-
-    while (current != NULL) {
-        fprintf(current->writeFD, wholeMsg);
-        fflush(current->writeFD);
-        current = current->next;
-    }
-}
-
-/******************************************************************************
-* Function Name  : take_action(ClientList* clients, ClientList* current)
-* Description    : Receive messages from clients and take corresponding actions
-* Input          : ClientList* clients;
-*                  ClientList* current;
-* Return         : None
-******************************************************************************/
-void take_action(ClientList* clients, ClientList* current){
-    char* buffer; //receive message send from client
-    char* message; //pure message without "CHAT:"
-    char* kickName; //name going to be kicked
-
-    while (1) {
-        buffer = (char*)malloc(sizeof(char));
-        memset(buffer, '\0', 1);
-        //reading pipe read port
-        read_fdin_dynamic(&buffer, current->readFD);
-        //remove error client or client executing command like cat, ls
-        if (strlen(buffer) == 0) {
-            printf("(%s has left the chat)\n", current->clientName);
-            remove_client(&clients, current->clientName);
-            break;
-        }
-        //handle CHAT:
-        if (strncmp(buffer, "CHAT:", 5) == 0) {
-            split_buffer(buffer, &message);
-            printf("(%s) %s\n", current->clientName, message);
-            send_msg_to_clients(clients, current->clientName, message);
-            free(message);
-        //handle KICK:
-        } else if (strncmp(buffer, "KICK:", 5) == 0) {
-            split_buffer(buffer, &kickName);
-            printf("(%s has left the chat)\n", kickName);
-            kick_notification(clients, kickName);
-            remove_client(&clients, kickName);
-            free(kickName);
-        //handle DONE:
-        } else if (strcmp(buffer, "DONE:") == 0) {
-            break;
-        //handle QUIT:
-        } else if (strcmp(buffer, "QUIT:") == 0) {
-            printf("(%s has left the chat)\n", current->clientName);
-            remove_client(&clients, current->clientName);
-            break;
-        //handle error client
-        } else {
-            printf("(%s has left the chat)\n", current->clientName);
-            remove_client(&clients, current->clientName);
-            break;
-        }
-        free(buffer);
-    }   
-}
-
-/******************************************************************************
-* Function Name  : chating_time(ClientList* clients)
-* Description    : Send "YT:" to each client
-* Input          : ClientList* clients;
-* Return         : None
-******************************************************************************/
-void chating_time(ClientList* clients) {
-    ClientList* current = clients;
-
-    while (1) {
-        current = current->next;
-
-        //send "YT:" to each client
-        while (current != NULL) {
-            fprintf(current->writeFD, "YT:\n");
-            fflush(current->writeFD);
-            
-            //take different action according to different response from client
-            take_action(clients, current);
-
-            current = current->next;
-        }
-    
-        current = clients;
-
-        //check if all client quit
-        if (clients->next == NULL) {
-            break;
-        }
-    }
-}
-
-int main(int argc, char** argv) {
-    ClientList* clients = NULL;
-    clients = (ClientList*) calloc(1, sizeof(ClientList));
-    
-    // argument checking 
-    arg_checking(argc, argv);
-    
-    // file reading and information collecting
-    read_file(argv[1], clients);
-
-    // create multi-progress
-    open_socket(clients);
-
-    // handshaking
-    collect_client_name(clients);
-    chating_time(clients);
-
-    //valgrind -s --track-origins=yes ./server config.txt
-    return 0;
-}
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <spawn.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <stdint.h>
+#include <time.h>
+#include "function.h"
+#include "reactor.h"
+#include "registry.h"
+#include "trace.h"
+#include "chatlog.h"
+#include "joining.h"
+#include "relay.h"
+#include "turntimer.h"
+
+/* initial number of frames a client's output queue holds */
+#define QUEUE_SIZE 16
+
+/* most frames handed to one writev */
+#define WRITE_BATCH 64
+
+/* size asked for the tee mode staging pipe */
+#define STAGE_SIZE (1024 * 1024)
+
+/* descriptors a child finds its shared memory link on */
+#define LINK_MEM_FD 3
+#define LINK_WAKE_FD 4
+#define LINK_NOTIFY_FD 5
+
+/* parent side link descriptors are moved at least this high, clear of
+ * the numbers above */
+#define LINK_FD_BASE 10
+
+/* what a child's environment adds to the server's, an index into
+ * childEnvironments */
+#define ENV_BINARY 1 /* BINARY_ENV, it may ask for binary frames */
+#define ENV_LINK 2 /* SHM_ENV, it has a shared memory link */
+
+/* unread bytes of a child's input past which the server stops reading
+ * it, once a whole line is among them, until some are handled */
+#define READ_AHEAD (64 * 1024)
+
+/* nanoseconds in a millisecond */
+#define NS_PER_MS 1000000LL
+
+/* what the slow client report and the counters keep of a client once
+ * it has left */
+typedef struct {
+    char* name; /* its name */
+    TurnStats stats; /* its turn latencies */
+    Counters counters; /* its counts, bytesOut including broadcasts */
+    int evicted; /* removed for missing deadlines */
+} LatencyRecord;
+
+/* a message kept in a client's -concurrent batch, followed by its bytes
+ * from field1 to the end and a NUL */
+typedef struct {
+    int command; /* CMD_* of the message */
+    int colons; /* colons of the message, -1 once the client has gone */
+    int length; /* bytes from field1 to the end */
+} BatchEntry;
+
+/* every client, in turn order */
+Registry registry;
+
+/* the event loop watching every child pipe */
+Reactor reactor;
+
+/* slots of the clients given frames since output was last flushed */
+int* pendingClients;
+int pendingCount;
+int pendingCapacity;
+
+/* clients with frames still queued */
+int queuedClients;
+
+/* fan broadcasts out with tee(2) from a staging pipe */
+int teeMode;
+
+/* the staging pipe, its size and the bytes staged in it */
+int stagePipe[2];
+int stageCapacity;
+int stageLength;
+
+/* the frames in the staging pipe */
+Frame** stageFrames;
+int stageCount;
+int stageFramesCapacity;
+
+/* where unclaimed staged bytes are spliced to */
+int devNull;
+
+/* offer children shared memory rings instead of pipes */
+int shmMode;
+
+/* let children ask for binary frames instead of lines */
+int binaryMode;
+
+/* the timer of the current turn */
+TurnTimer turnTimer;
+
+/* when the current round started */
+int64_t roundStart;
+
+/* play rounds with every turn taken at once, see concurrent_round */
+int concurrentMode;
+
+/* a -concurrent round is gathering turns */
+int gathering;
+
+/* slots of the clients with new lines to gather */
+int* readyClients;
+int readyCount;
+int readyCapacity;
+
+/* every line exchanged with the children goes to trace with -record */
+int recording;
+TraceWriter trace;
+
+/* rounds played before the server ends the chat, 0 for no limit */
+int maxRounds;
+
+/* slots of the swarm children, each hosting the lanes of one config
+ * entry with "swarm=K". They take no turns, so are not in the order */
+int* swarmHosts;
+int swarmHostCount;
+int swarmHostCapacity;
+
+/* with -relays, the relay processes writing to the children */
+Relays relays;
+
+/* how long the rounds took, kept like a client's turns */
+TurnStats roundStats;
+
+/* bytes of every broadcast so far, a client has been sent those since
+ * its broadcastBase */
+long broadcastBytes;
+
+/* signalfd taking SIGUSR1, which dumps the counters to stderr */
+int dumpSignal = -1;
+
+/* with -stats a snapshot of the counters is written to statsPath every
+ * statsInterval ms, when statsTimer fires */
+char* statsPath;
+int statsInterval = 1000;
+int statsTimer = -1;
+
+/* the config file, and the clients joining the running chat */
+Joining joining;
+
+/* how children are spawned, kept for the ones started at runtime */
+posix_spawnattr_t spawnAttributes;
+char** childEnvironments[(ENV_BINARY | ENV_LINK) + 1];
+
+/* what is said in the chat, written out by a thread of its own to
+ * stdout or with -log to logPath, rotated at logSize bytes */
+ChatLog chatLog;
+char* logPath;
+long logSize;
+
+/* latencies of the clients that have left */
+LatencyRecord* latencyRecords;
+int latencyCount;
+int latencyCapacity;
+
+/******************************************************************************
+* Function Name  : print_clients()
+* Description    : Print client one by one with client name and execute file
+* Input          : None
+* Return         : None
+******************************************************************************/
+void print_clients() {
+    for (int i = 0; i < registry.orderCount; i++) {
+        if (registry.order[i] < 0) {
+            continue;
+        }
+        Client* current = &registry.slots[registry.order[i]];
+        fprintf(stderr, "%dclientname: %s\n", i, current->run);
+        fprintf(stderr, "%dfileToRun: %s\n", i, current->fileToRun);
+    }
+}
+
+/******************************************************************************
+* Function Name  : now_ns()
+* Description    : Read the monotonic clock
+* Input          : None
+* Return         : The time in nanoseconds
+******************************************************************************/
+int64_t now_ns() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/******************************************************************************
+* Function Name  : record_line(Client* client, int kind, const char* line,
+*                  int length)
+* Description    : Count the bytes of a line exchanged with a child and add
+*                  it to the -record trace, a trailing newline is left out
+*                  of the trace
+* Input          : Client* client; NULL for broadcasts
+*                  int kind;
+*                  const char* line;
+*                  int length;
+* Return         : None
+******************************************************************************/
+void record_line(Client* client, int kind, const char* line, int length) {
+    if (length > 0 && line[length - 1] == '\n') {
+        length--;
+    }
+    if (kind == TRACE_TO_CHILD) {
+        client->counters.bytesOut += length + 1;
+    } else if (kind == TRACE_FROM_CHILD) {
+        client->counters.bytesIn += length + 1;
+    } else if (kind == TRACE_BROADCAST) {
+        broadcastBytes += length + 1;
+    }
+    if (!recording) {
+        return;
+    }
+    trace_write(&trace, now_ns(), client == NULL ? 0 : client->id, kind,
+            line, length);
+}
+
+/******************************************************************************
+* Function Name  : frame_create(int length)
+* Description    : Allocate a frame for a message of length bytes, owned
+*                  by the caller until it calls frame_release
+* Input          : int length;
+* Return         : The frame
+******************************************************************************/
+Frame* frame_create(int length) {
+    Frame* frame = (Frame*)malloc(sizeof(Frame) + length + 1);
+    frame->refs = 1;
+    frame->length = length;
+    return frame;
+}
+
+/******************************************************************************
+* Function Name  : frame_release(Frame* frame)
+* Description    : Drop one reference to a frame, freeing it with the last
+* Input          : Frame* frame;
+* Return         : None
+******************************************************************************/
+void frame_release(Frame* frame) {
+    frame->refs--;
+    if (frame->refs == 0) {
+        free(frame);
+    }
+}
+
+/******************************************************************************
+* Function Name  : binary_frame(const char* message, int length)
+* Description    : Encode a line as a binary frame, for a child that asked
+*                  for them
+* Input          : const char* message;
+*                  int length;
+* Return         : The frame, owned by the caller
+******************************************************************************/
+Frame* binary_frame(const char* message, int length) {
+    Frame* frame = frame_create(length + FRAME_EXTRA);
+
+    frame->length = encode_frame(message, length, frame->data);
+    return frame;
+}
+
+/******************************************************************************
+* Function Name  : msg_frame(const char* sender, const char* message,
+*                  int length)
+* Description    : Encode a broadcast as a binary frame, the message bytes
+*                  go out as they were sent
+* Input          : const char* sender;
+*                  const char* message;
+*                  int length;
+* Return         : The frame, owned by the caller
+******************************************************************************/
+Frame* msg_frame(const char* sender, const char* message, int length) {
+    const char* fields[2] = {sender, message};
+    int lengths[2] = {strlen(sender), length};
+    Frame* frame = frame_create(lengths[0] + length + FRAME_EXTRA);
+
+    frame->length = encode_fields(CMD_MSG, fields, lengths, 2, frame->data);
+    return frame;
+}
+
+/******************************************************************************
+* Function Name  : lane_frame(int lane, const char* message, int length)
+* Description    : Encode a line for one lane of a swarm child, which is the
+*                  line with "lane|" in front
+* Input          : int lane;
+*                  const char* message;
+*                  int length;
+* Return         : The frame, owned by the caller
+******************************************************************************/
+Frame* lane_frame(int lane, const char* message, int length) {
+    char prefix[16];
+    int prefixLength = sprintf(prefix, "%d|", lane);
+    Frame* frame = frame_create(prefixLength + length);
+
+    memcpy(frame->data, prefix, prefixLength);
+    memcpy(frame->data + prefixLength, message, length);
+    return frame;
+}
+
+/******************************************************************************
+* Function Name  : relay_frame(int index, const char* message, int length)
+* Description    : Encode a line for a relay, which is the line with
+*                  "index|" in front for one of its children or "*|" for
+*                  all of them. An empty line closes the child's pipe
+* Input          : int index; the child's number, -1 for all
+*                  const char* message;
+*                  int length;
+* Return         : The frame, owned by the caller
+******************************************************************************/
+Frame* relay_frame(int index, const char* message, int length) {
+    Frame* frame;
+
+    if (index >= 0) {
+        return lane_frame(index, message, length);
+    }
+    frame = frame_create(length + 2);
+    memcpy(frame->data, "*|", 2);
+    memcpy(frame->data + 2, message, length);
+    return frame;
+}
+
+/******************************************************************************
+* Function Name  : pop_frame(Client* client)
+* Description    : Drop the oldest frame of a client's queue
+* Input          : Client* client;
+* Return         : None
+******************************************************************************/
+void pop_frame(Client* client) {
+    frame_release(client->queue[client->queueHead]);
+    client->queueHead = (client->queueHead + 1) % client->queueCapacity;
+    client->queueCount--;
+    client->headSent = 0;
+    if (client->queueCount == 0) {
+        queuedClients--;
+    }
+}
+
+int take_name_reply(Client* current);
+
+/******************************************************************************
+* Function Name  : mark_ready(Client* client)
+* Description    : Note a client has new lines, or has gone, while a
+*                  -concurrent round is gathering its turn. A client
+*                  waiting to join has its answer to WHO: taken at once
+* Input          : Client* client;
+* Return         : None
+******************************************************************************/
+void mark_ready(Client* client) {
+    if (client->joining) {
+        take_name_reply(client);
+        return;
+    }
+    if (!gathering || client->ready || client->batchState != BATCH_OPEN) {
+        return;
+    }
+    if (readyCount == readyCapacity) {
+        readyCapacity = readyCapacity == 0 ? 64 : readyCapacity * 2;
+        readyClients = (int*)realloc(readyClients,
+                sizeof(int) * readyCapacity);
+    }
+    client->ready = 1;
+    readyClients[readyCount++] = client->id;
+}
+
+void queue_frame(Client* client, Frame* frame);
+
+/******************************************************************************
+* Function Name  : close_write_side(Client* client)
+* Description    : Stop writing to a client, anything still queued is dropped.
+*                  A client that has left the chat is released with it. A
+*                  relay closes its child's pipe once what it was sent
+*                  before has been written
+* Input          : Client* client;
+* Return         : None
+******************************************************************************/
+void close_write_side(Client* client) {
+    if (client->relay >= 0) {
+        Frame* frame = relay_frame(client->relayIndex, "\n", 1);
+        queue_frame(&registry.slots[client->relay], frame);
+        frame_release(frame);
+        client->relay = -1;
+    }
+    if (client->writeFd >= 0) {
+        reactor_remove(&reactor, client->writeFd);
+        close(client->writeFd);
+        client->writeFd = -1;
+        while (client->queueCount > 0) {
+            pop_frame(client);
+        }
+    }
+    if (client->departed && client->inUse) {
+        if (client->link != NULL) {
+            reactor_remove(&reactor, client->notifyFd);
+            close(client->notifyFd);
+            close(client->wakeFd);
+            munmap(client->link, sizeof(SharedLink));
+            client->link = NULL;
+        }
+        registry_release(&registry, client);
+    }
+}
+
+/******************************************************************************
+* Function Name  : input_waiting(LineReader* reader, int share)
+* Description    : Check whether a child's input waiting to be handled has
+*                  reached a share of the most it may hold, READ_AHEAD or
+*                  its buffer if that is smaller. A whole line or frame
+*                  must be among it, or it could never be handled
+* Input          : LineReader* reader;
+*                  int share; 1 for all of it, 2 for half
+* Return         : 1 if it has, 0 otherwise
+******************************************************************************/
+int input_waiting(LineReader* reader, int share) {
+    // line_reader_fill does not grow a buffer holding a whole line
+    int limit = reader->capacity - 1 < READ_AHEAD ?
+            reader->capacity - 1 : READ_AHEAD;
+
+    return reader->length - reader->start >= limit / share
+            && line_reader_ready(reader);
+}
+
+/******************************************************************************
+* Function Name  : read_ring(Client* client)
+* Description    : Read what a child has put in its shared memory ring, up
+*                  to READ_AHEAD. Once the child has gone and the ring is
+*                  empty the ring reader is at its end
+* Input          : Client* client;
+* Return         : 1 if anything was read, 0 otherwise
+******************************************************************************/
+int read_ring(Client* client) {
+    LineReader* ring = &client->ringReader;
+    int taken = 0;
+
+    while (!ring->eof) {
+        if (input_waiting(ring, 1)) {
+            client->hold = HOLD_RING;
+            break;
+        }
+        if (line_reader_fill(ring) > 0) {
+            taken = 1;
+            continue;
+        }
+        // the child is gone, what it left in the ring is all there is
+        if (client->reader.eof) {
+            ring->eof = 1;
+        }
+        break;
+    }
+    return taken;
+}
+
+/******************************************************************************
+* Function Name  : close_read_side(Client* client)
+* Description    : Stop reading from a client, bytes already read (and left
+*                  in its shared memory ring) are kept. The lanes of a
+*                  swarm child reach the end of their input with it
+* Input          : Client* client;
+* Return         : None
+******************************************************************************/
+void close_read_side(Client* client) {
+    client->reader.eof = 1;
+    if (client->link != NULL) {
+        read_ring(client);
+    }
+    for (int i = 0; i < client->laneCount; i++) {
+        if (client->lanes[i] >= 0) {
+            registry.slots[client->lanes[i]].reader.eof = 1;
+            mark_ready(&registry.slots[client->lanes[i]]);
+        }
+    }
+    // a held pipe is not read again
+    if (client->hold != HOLD_RING) {
+        client->hold = HOLD_NONE;
+    }
+    if (client->reader.fd < 0) {
+        return;
+    }
+    reactor_remove(&reactor, client->reader.fd);
+    close(client->reader.fd);
+    client->reader.fd = -1;
+}
+
+/******************************************************************************
+* Function Name  : wake_child(Client* client)
+* Description    : Wake a child sleeping on its shared memory link
+* Input          : Client* client;
+* Return         : None
+******************************************************************************/
+void wake_child(Client* client) {
+    if (__atomic_exchange_n(&client->link->childWaiting, 0,
+            __ATOMIC_SEQ_CST)) {
+        wake_fd(client->wakeFd);
+    }
+}
+
+/******************************************************************************
+* Function Name  : flush_ring(Client* client)
+* Description    : Copy as much of a client's queue as fits into its
+*                  toChild ring. If the ring fills up the child is asked
+*                  to wake the server once it has made room
+* Input          : Client* client;
+* Return         : None
+******************************************************************************/
+void flush_ring(Client* client) {
+    Ring* ring = &client->link->toChild;
+    int wrote = 0;
+
+    while (client->queueCount > 0) {
+        Frame* head = client->queue[client->queueHead];
+        int left = head->length - client->headSent;
+        int count = ring_write(ring, head->data + client->headSent, left);
+        wrote |= count > 0;
+        if (count < left) {
+            client->headSent += count;
+            __atomic_store_n(&client->link->serverWaiting, 1,
+                    __ATOMIC_SEQ_CST);
+            // it may have made room before it could see the request
+            if (ring_space(ring) == 0) {
+                break;
+            }
+            continue;
+        }
+        pop_frame(client);
+    }
+    if (wrote) {
+        wake_child(client);
+    }
+}
+
+/******************************************************************************
+* Function Name  : flush_output(Client* client)
+* Description    : Write as much of a client's queue as the pipe takes
+*                  without blocking, gathering up to WRITE_BATCH frames in
+*                  each writev, and watch for the pipe becoming writable
+*                  while anything is left. Clients talking through shared
+*                  memory get it copied into their ring instead
+* Input          : Client* client;
+* Return         : None
+******************************************************************************/
+void flush_output(Client* client) {
+    struct iovec iov[WRITE_BATCH];
+
+    if (client->linkState == LINK_RING) {
+        flush_ring(client);
+        if (client->queueCount == 0 && client->departed) {
+            close_write_side(client);
+        }
+        return;
+    }
+    while (client->queueCount > 0) {
+        int count = client->queueCount < WRITE_BATCH ?
+                client->queueCount : WRITE_BATCH;
+        for (int i = 0; i < count; i++) {
+            Frame* frame = client->queue[(client->queueHead + i)
+                    % client->queueCapacity];
+            iov[i].iov_base = frame->data;
+            iov[i].iov_len = frame->length;
+        }
+        iov[0].iov_base = (char*)iov[0].iov_base + client->headSent;
+        iov[0].iov_len -= client->headSent;
+
+        ssize_t written = writev(client->writeFd, iov, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            // the child is gone, nobody will read the rest
+            close_write_side(client);
+            return;
+        }
+        // drop the frames written in full, remember how far into the next
+        while (client->queueCount > 0) {
+            Frame* head = client->queue[client->queueHead];
+            if (written < head->length - client->headSent) {
+                client->headSent += written;
+                break;
+            }
+            written -= head->length - client->headSent;
+            pop_frame(client);
+        }
+    }
+
+    if (client->queueCount > 0) {
+        reactor_modify(&reactor, client->writeFd, EPOLLOUT);
+    } else if (client->departed) {
+        close_write_side(client);
+    } else {
+        reactor_modify(&reactor, client->writeFd, 0);
+    }
+}
+
+/******************************************************************************
+* Function Name  : queue_frame(Client* client, Frame* frame)
+* Description    : Add a frame to a client's queue, it is written at the
+*                  next flush. A relayed child's frame goes to its relay
+* Input          : Client* client;
+*                  Frame* frame;
+* Return         : None
+******************************************************************************/
+void queue_frame(Client* client, Frame* frame) {
+    if (client->relay >= 0) {
+        Frame* relayed = relay_frame(client->relayIndex, frame->data,
+                frame->length);
+        queue_frame(&registry.slots[client->relay], relayed);
+        frame_release(relayed);
+        return;
+    }
+    if (client->writeFd < 0) {
+        return;
+    }
+    if (client->queueCount == client->queueCapacity) {
+        int capacity = client->queueCapacity == 0 ?
+                QUEUE_SIZE : client->queueCapacity * 2;
+        Frame** queue = (Frame**)malloc(sizeof(Frame*) * capacity);
+        for (int i = 0; i < client->queueCount; i++) {
+            queue[i] = client->queue[(client->queueHead + i)
+                    % client->queueCapacity];
+        }
+        free(client->queue);
+        client->queue = queue;
+        client->queueHead = 0;
+        client->queueCapacity = capacity;
+    }
+    if (client->queueCount == 0) {
+        queuedClients++;
+    }
+    frame->refs++;
+    client->queue[(client->queueHead + client->queueCount)
+            % client->queueCapacity] = frame;
+    client->queueCount++;
+
+    if (!client->pending) {
+        if (pendingCount == pendingCapacity) {
+            pendingCapacity = pendingCapacity == 0 ? 64 : pendingCapacity * 2;
+            pendingClients = (int*)realloc(pendingClients,
+                    sizeof(int) * pendingCapacity);
+        }
+        pendingClients[pendingCount++] = client->id;
+        client->pending = 1;
+    }
+}
+
+/******************************************************************************
+* Function Name  : broadcast_receiver(int i)
+* Description    : Find the i'th child broadcasts are written to, counting
+*                  the turn order then the swarm hosts. A swarm child is
+*                  sent each broadcast once for all its lanes, relayed
+*                  children get it from their relay
+* Input          : int i; below registry.orderCount + swarmHostCount
+* Return         : The client, NULL if there is no child to write to there
+******************************************************************************/
+Client* broadcast_receiver(int i) {
+    int id = i < registry.orderCount ?
+            registry.order[i] : swarmHosts[i - registry.orderCount];
+    Client* client;
+
+    if (id < 0) {
+        return NULL;
+    }
+    client = &registry.slots[id];
+    if (client->host >= 0 || client->relay >= 0 || client->departed) {
+        return NULL;
+    }
+    return client;
+}
+
+/******************************************************************************
+* Function Name  : stage_init()
+* Description    : Create the staging pipe broadcasts are fanned out from
+*                  in tee mode, as large as the system allows
+* Input          : None
+* Return         : None
+******************************************************************************/
+void stage_init() {
+    if (pipe(stagePipe) < 0) {
+        teeMode = 0;
+        return;
+    }
+    set_nonblocking(stagePipe[1]);
+    fcntl(stagePipe[1], F_SETPIPE_SZ, STAGE_SIZE);
+    stageCapacity = fcntl(stagePipe[1], F_GETPIPE_SZ);
+    devNull = open("/dev/null", O_WRONLY);
+}
+
+/******************************************************************************
+* Function Name  : queue_staged(Client* client, int skip)
+* Description    : Queue the staged frames for a client, less the first
+*                  skip bytes which already reached its pipe
+* Input          : Client* client;
+*                  int skip;
+* Return         : None
+******************************************************************************/
+void queue_staged(Client* client, int skip) {
+    for (int i = 0; i < stageCount; i++) {
+        if (skip >= stageFrames[i]->length) {
+            skip -= stageFrames[i]->length;
+            continue;
+        }
+        queue_frame(client, stageFrames[i]);
+        if (client->queueCount == 1) {
+            client->headSent = skip;
+        }
+        skip = 0;
+    }
+}
+
+/******************************************************************************
+* Function Name  : stage_commit()
+* Description    : Fan the staged broadcasts out to every client. The bytes
+*                  are duplicated from the staging pipe into each client's
+*                  pipe with tee and moved into the last one with splice.
+*                  Clients with output already queued, or whose pipe will
+*                  not take it all, get the frames queued as usual
+* Input          : None
+* Return         : None
+******************************************************************************/
+void stage_commit() {
+    Client* current;
+    Client* last = NULL;
+
+    if (stageLength == 0) {
+        return;
+    }
+    for (int i = 0; i < registry.orderCount + swarmHostCount; i++) {
+        if ((current = broadcast_receiver(i)) == NULL) {
+            continue;
+        }
+        if (current->writeFd >= 0 && current->queueCount == 0
+                && current->linkState != LINK_RING) {
+            last = current;
+        }
+    }
+    for (int i = 0; i < registry.orderCount + swarmHostCount; i++) {
+        ssize_t copied = -1;
+
+        if ((current = broadcast_receiver(i)) == NULL
+                || current->writeFd < 0) {
+            continue;
+        }
+        if (current->queueCount == 0 && teeMode
+                && current->linkState != LINK_RING) {
+            if (current == last) {
+                copied = splice(stagePipe[0], NULL, current->writeFd, NULL,
+                        stageLength, SPLICE_F_NONBLOCK);
+            } else {
+                copied = tee(stagePipe[0], current->writeFd, stageLength,
+                        SPLICE_F_NONBLOCK);
+            }
+            if (copied < 0 && errno == EINVAL) {
+                // the kernel will not tee these, copy from now on
+                teeMode = 0;
+            }
+        }
+        if (copied < stageLength) {
+            queue_staged(current, copied < 0 ? 0 : copied);
+        }
+        if (current == last && copied > 0) {
+            stageLength -= copied;
+        }
+    }
+
+    // throw away whatever splice did not take
+    while (stageLength > 0) {
+        ssize_t count = splice(stagePipe[0], NULL, devNull, NULL,
+                stageLength, 0);
+        if (count <= 0) {
+            break;
+        }
+        stageLength -= count;
+    }
+    for (int i = 0; i < stageCount; i++) {
+        frame_release(stageFrames[i]);
+    }
+    stageCount = 0;
+    stageLength = 0;
+}
+
+/******************************************************************************
+* Function Name  : stage_frame(Frame* frame)
+* Description    : Write a broadcast into the staging pipe, to be fanned out
+*                  at the next flush. Frames that do not fit go to the
+*                  queues instead
+* Input          : Frame* frame;
+* Return         : None
+******************************************************************************/
+void stage_frame(Frame* frame) {
+    Client* receiver;
+
+    if (stageLength + frame->length > stageCapacity) {
+        stage_commit();
+    }
+    if (frame->length > stageCapacity || !teeMode
+            || write(stagePipe[1], frame->data, frame->length)
+            != frame->length) {
+        // the staging pipe refused it, fall back to copying
+        stage_commit();
+        for (int i = 0; i < registry.orderCount + swarmHostCount; i++) {
+            if ((receiver = broadcast_receiver(i)) != NULL) {
+                queue_frame(receiver, frame);
+            }
+        }
+        return;
+    }
+    if (stageCount == stageFramesCapacity) {
+        stageFramesCapacity = stageFramesCapacity == 0 ?
+                QUEUE_SIZE : stageFramesCapacity * 2;
+        stageFrames = (Frame**)realloc(stageFrames,
+                sizeof(Frame*) * stageFramesCapacity);
+    }
+    frame->refs++;
+    stageFrames[stageCount++] = frame;
+    stageLength += frame->length;
+}
+
+/******************************************************************************
+* Function Name  : flush_pending()
+* Description    : Flush every client given frames since the last flush,
+*                  so all the messages of a turn leave in one writev each
+* Input          : None
+* Return         : None
+******************************************************************************/
+void flush_pending() {
+    stage_commit();
+    for (int i = 0; i < pendingCount; i++) {
+        Client* client = &registry.slots[pendingClients[i]];
+        client->pending = 0;
+        if (client->writeFd >= 0) {
+            flush_output(client);
+        }
+    }
+    pendingCount = 0;
+}
+
+/******************************************************************************
+* Function Name  : send_to_client(Client* client, char* message)
+* Description    : Queue a control message for one client, before a child
+*                  with a shared memory link answers it goes into the
+*                  ring as well. A lane's message goes to its swarm child
+* Input          : Client* client;
+*                  char* message;
+* Return         : None
+******************************************************************************/
+void send_to_client(Client* client, char* message) {
+    int length = strlen(message);
+    Frame* frame;
+
+    // staged broadcasts go first
+    stage_commit();
+    record_line(client, TRACE_TO_CHILD, message, length);
+    if (client->host >= 0) {
+        frame = lane_frame(client->lane, message, length);
+        queue_frame(&registry.slots[client->host], frame);
+        frame_release(frame);
+        return;
+    }
+    if (client->binary) {
+        frame = binary_frame(message, length);
+    } else {
+        frame = frame_create(length);
+        memcpy(frame->data, message, length);
+    }
+    queue_frame(client, frame);
+    frame_release(frame);
+
+    // until it answers, a child may be listening on either transport
+    if (client->link != NULL && client->linkState == LINK_UNKNOWN
+            && client->writeFd >= 0) {
+        ring_write(&client->link->toChild, message, length);
+        wake_child(client);
+    }
+}
+
+/******************************************************************************
+* Function Name  : split_lanes(Client* host)
+* Description    : Hand each whole line a swarm child has sent to the lane
+*                  its "lane|" prefix names. Lines for lanes that have left,
+*                  or without a lane, are dropped
+* Input          : Client* host;
+* Return         : None
+******************************************************************************/
+void split_lanes(Client* host) {
+    Client* client;
+    char* line;
+    char* text;
+    int length;
+    int lane;
+
+    while ((line = line_reader_next(&host->reader, &length)) != NULL) {
+        lane = 0;
+        for (text = line; isdigit((unsigned char)*text); text++) {
+            lane = lane < host->laneCount ?
+                    lane * 10 + (*text - '0') : host->laneCount;
+        }
+        if (text == line || *text != '|' || lane >= host->laneCount
+                || host->lanes[lane] < 0) {
+            continue;
+        }
+        text++;
+        client = &registry.slots[host->lanes[lane]];
+        line_reader_push(&client->reader, text, length - (text - line));
+        mark_ready(client);
+    }
+}
+
+/******************************************************************************
+* Function Name  : client_readable(int fd, uint32_t events, void* data)
+* Description    : Reactor handler for a child's output pipe, read everything
+*                  available into the client's buffer whether or not it is
+*                  the client's turn, and note when the child has gone.
+*                  A swarm child's lines are passed on to its lanes
+* Input          : int fd;
+*                  uint32_t events;
+*                  void* data;
+* Return         : None
+******************************************************************************/
+void client_readable(int fd, uint32_t events, void* data) {
+    Client* client = &registry.slots[(intptr_t)data];
+    int count;
+
+    // read until the pipe is empty or enough is waiting
+    do {
+        count = line_reader_fill(&client->reader);
+    } while (count > 0 && !input_waiting(&client->reader, 1));
+    if (client->laneCount > 0) {
+        split_lanes(client);
+    }
+    if (count == 0) {
+        close_read_side(client);
+    } else if (input_waiting(&client->reader, 1)) {
+        // the child blocks once the pipe is full, release_input reads on
+        if (events & EPOLLHUP) {
+            // a hung up pipe is reported whatever is watched
+            reactor_remove(&reactor, fd);
+            client->hold = HOLD_HUNG_UP;
+        } else {
+            reactor_modify(&reactor, fd, 0);
+            client->hold = HOLD_PIPE;
+        }
+    }
+    if (client->laneCount == 0) {
+        mark_ready(client);
+    }
+}
+
+/******************************************************************************
+* Function Name  : client_writable(int fd, uint32_t events, void* data)
+* Description    : Reactor handler for a child's input pipe, drain queued
+*                  output or drop it if the child has closed the pipe
+* Input          : int fd;
+*                  uint32_t events;
+*                  void* data;
+* Return         : None
+******************************************************************************/
+void client_writable(int fd, uint32_t events, void* data) {
+    Client* client = &registry.slots[(intptr_t)data];
+
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        close_write_side(client);
+    } else {
+        flush_output(client);
+    }
+}
+
+/******************************************************************************
+* Function Name  : client_signalled(int fd, uint32_t events, void* data)
+* Description    : Reactor handler for a child's notify eventfd, the child
+*                  has added lines to its ring or made room in the other
+* Input          : int fd;
+*                  uint32_t events;
+*                  void* data;
+* Return         : None
+******************************************************************************/
+void client_signalled(int fd, uint32_t events, void* data) {
+    Client* client = &registry.slots[(intptr_t)data];
+    uint64_t count;
+
+    read(fd, &count, sizeof(count));
+    if (read_ring(client)) {
+        // it may be waiting for the room just made
+        wake_child(client);
+        mark_ready(client);
+    }
+    if (client->linkState == LINK_RING && client->queueCount > 0) {
+        flush_output(client);
+    }
+}
+
+/******************************************************************************
+* Function Name  : turn_deadline(Client* client, int64_t start)
+* Description    : Work out when a turn starting at start must end, the
+*                  earlier of its turn deadline and its round deadline
+* Input          : Client* client;
+*                  int64_t start;
+* Return         : The deadline, 0 if the client has no limit
+******************************************************************************/
+int64_t turn_deadline(Client* client, int64_t start) {
+    int64_t deadline = 0;
+
+    if (client->turnLimit > 0) {
+        deadline = start + client->turnLimit * NS_PER_MS;
+    }
+    if (client->roundLimit > 0 && (deadline == 0
+            || roundStart + client->roundLimit * NS_PER_MS < deadline)) {
+        deadline = roundStart + client->roundLimit * NS_PER_MS;
+    }
+    return deadline;
+}
+
+/******************************************************************************
+* Function Name  : start_turn(Client* client)
+* Description    : Start timing a client's turn and arm the timer for its
+*                  deadline
+* Input          : Client* client;
+* Return         : None
+******************************************************************************/
+void start_turn(Client* client) {
+    int64_t start = now_ns();
+
+    client->stats.turns++;
+    turn_timer_start(&turnTimer, client, start, turn_deadline(client, start));
+}
+
+/******************************************************************************
+* Function Name  : add_latency(TurnStats* stats, int64_t elapsed)
+* Description    : Add the time a turn (or round) took to its latencies
+* Input          : TurnStats* stats;
+*                  int64_t elapsed;
+* Return         : None
+******************************************************************************/
+void add_latency(TurnStats* stats, int64_t elapsed) {
+    int64_t micros = elapsed / 1000;
+    int bucket = 0;
+
+    stats->totalNs += elapsed;
+    if (elapsed > stats->maxNs) {
+        stats->maxNs = elapsed;
+    }
+    while (micros > 0 && bucket < LATENCY_BUCKETS - 1) {
+        micros >>= 1;
+        bucket++;
+    }
+    stats->latency[bucket]++;
+}
+
+/******************************************************************************
+* Function Name  : finish_turn(Client* client)
+* Description    : Stop timing a client's turn, if it is the one timed, and
+*                  add the time it took to its latencies
+* Input          : Client* client;
+* Return         : None
+******************************************************************************/
+void finish_turn(Client* client) {
+    if (client != turnTimer.client) {
+        return;
+    }
+    add_latency(&client->stats, now_ns() - turnTimer.start);
+    turn_timer_stop(&turnTimer);
+}
+
+/******************************************************************************
+* Function Name  : bytes_out(Client* client)
+* Description    : Count the bytes a client has been sent, broadcasts since
+*                  it joined included
+* Input          : Client* client;
+* Return         : The byte count
+******************************************************************************/
+long bytes_out(Client* client) {
+    return client->counters.bytesOut + broadcastBytes
+            - client->counters.broadcastBase;
+}
+
+/******************************************************************************
+* Function Name  : record_latency(Client* client)
+* Description    : Keep a leaving client's latencies for the report, it
+*                  was evicted if it missed two deadlines in a row
+* Input          : Client* client;
+* Return         : None
+******************************************************************************/
+void record_latency(Client* client) {
+    LatencyRecord* record;
+
+    finish_turn(client);
+    if (client->clientName == NULL || client->stats.turns == 0) {
+        return;
+    }
+    if (latencyCount == latencyCapacity) {
+        latencyCapacity = latencyCapacity == 0 ? 16 : latencyCapacity * 2;
+        latencyRecords = (LatencyRecord*)realloc(latencyRecords,
+                sizeof(LatencyRecord) * latencyCapacity);
+    }
+    record = &latencyRecords[latencyCount++];
+    record->name = strdup(client->clientName);
+    record->stats = client->stats;
+    record->counters = client->counters;
+    record->counters.bytesOut = bytes_out(client);
+    record->evicted = client->strikes >= 2;
+}
+
+/******************************************************************************
+* Function Name  : compare_latency(const void* first, const void* second)
+* Description    : qsort comparator putting the client that held the room
+*                  longest first
+* Input          : const void* first;
+*                  const void* second;
+* Return         : Negative, zero or positive as first sorts before,
+*                  with or after second
+******************************************************************************/
+int compare_latency(const void* first, const void* second) {
+    const LatencyRecord* a = (const LatencyRecord*)first;
+    const LatencyRecord* b = (const LatencyRecord*)second;
+
+    return (a->stats.totalNs < b->stats.totalNs)
+            - (a->stats.totalNs > b->stats.totalNs);
+}
+
+/******************************************************************************
+* Function Name  : print_latency_report()
+* Description    : Print every client's turn latencies to stderr, slowest
+*                  first, when some config entry set a limit
+* Input          : None
+* Return         : None
+******************************************************************************/
+void print_latency_report() {
+    if (turnTimer.fd < 0) {
+        return;
+    }
+    qsort(latencyRecords, latencyCount, sizeof(LatencyRecord),
+            compare_latency);
+    fprintf(stderr, "turn latencies, slowest first:\n");
+    for (int i = 0; i < latencyCount; i++) {
+        LatencyRecord* record = &latencyRecords[i];
+        fprintf(stderr, "%s: %d turns, avg %.1f ms, max %.1f ms, "
+                "%d missed%s\n", record->name, record->stats.turns,
+                (double)record->stats.totalNs / record->stats.turns
+                / NS_PER_MS, (double)record->stats.maxNs / NS_PER_MS,
+                record->stats.missed, record->evicted ? ", evicted" : "");
+        free(record->name);
+    }
+    free(latencyRecords);
+}
+
+/******************************************************************************
+* Function Name  : print_histogram(FILE* fp, char* key, int* latency)
+* Description    : Print a latency histogram as " key=n,n,...", without
+*                  its empty buckets at the end
+* Input          : FILE* fp;
+*                  char* key;
+*                  int* latency;
+* Return         : None
+******************************************************************************/
+void print_histogram(FILE* fp, char* key, int* latency) {
+    int used = LATENCY_BUCKETS;
+
+    while (used > 1 && latency[used - 1] == 0) {
+        used--;
+    }
+    fprintf(fp, " %s=", key);
+    for (int i = 0; i < used; i++) {
+        fprintf(fp, i == 0 ? "%d" : ",%d", latency[i]);
+    }
+}
+
+/******************************************************************************
+* Function Name  : print_client(FILE* fp, char* kind, char* name,
+*                  TurnStats* stats, Counters* counters, long bytesOut)
+* Description    : Print the counters line of one client
+* Input          : FILE* fp;
+*                  char* kind; "client" in the chat or "gone" once left
+*                  char* name;
+*                  TurnStats* stats;
+*                  Counters* counters;
+*                  long bytesOut;
+* Return         : None
+******************************************************************************/
+void print_client(FILE* fp, char* kind, char* name, TurnStats* stats,
+        Counters* counters, long bytesOut) {
+    fprintf(fp, "%s turns=%d missed=%d chats=%ld kicks=%ld quits=%ld "
+            "bytes_in=%ld bytes_out=%ld", kind, stats->turns, stats->missed,
+            counters->chats, counters->kicks, counters->quits,
+            counters->bytesIn, bytesOut);
+    print_histogram(fp, "turn_us", stats->latency);
+    fprintf(fp, " name=%s\n", name != NULL ? name : "");
+}
+
+/******************************************************************************
+* Function Name  : write_counters(int fd)
+* Description    : Write the counters of the server, of every client in the
+*                  chat and of those that have left with a single write, so
+*                  the block is not cut into by other output. Each line is
+*                  a kind then key=value fields, a client's name last as it
+*                  may hold spaces, and the block ends with "end".
+*                  Histograms are in microseconds, bucket i counting times
+*                  under 2^i
+* Input          : int fd;
+* Return         : 0 once written, -1 if the write failed
+******************************************************************************/
+int write_counters(int fd) {
+    char* text = NULL;
+    size_t length = 0;
+    size_t written = 0;
+    FILE* fp = open_memstream(&text, &length);
+    Client* current;
+
+    fprintf(fp, "server rounds=%d members=%d broadcast_bytes=%ld "
+            "round_avg_us=%lld round_max_us=%lld", roundStats.turns,
+            registry.members, broadcastBytes, roundStats.turns == 0 ? 0 :
+            (long long)(roundStats.totalNs / roundStats.turns / 1000),
+            (long long)(roundStats.maxNs / 1000));
+    print_histogram(fp, "round_us", roundStats.latency);
+    fprintf(fp, "\n");
+    for (int i = 0; i < registry.orderCount; i++) {
+        if (registry.order[i] >= 0) {
+            current = &registry.slots[registry.order[i]];
+            print_client(fp, "client", current->clientName, &current->stats,
+                    &current->counters, bytes_out(current));
+        }
+    }
+    for (int i = 0; i < latencyCount; i++) {
+        print_client(fp, "gone", latencyRecords[i].name,
+                &latencyRecords[i].stats, &latencyRecords[i].counters,
+                latencyRecords[i].counters.bytesOut);
+    }
+    fprintf(fp, "end\n");
+    fclose(fp);
+
+    while (written < length) {
+        ssize_t count = write(fd, text + written, length - written);
+        if (count < 0 && errno != EINTR) {
+            break;
+        }
+        written += count < 0 ? 0 : count;
+    }
+    free(text);
+    return written == length ? 0 : -1;
+}
+
+/******************************************************************************
+* Function Name  : write_snapshot()
+* Description    : Replace the -stats file with the current counters. They
+*                  are written beside it and renamed over it, so a reader
+*                  always sees a whole snapshot
+* Input          : None
+* Return         : None
+******************************************************************************/
+void write_snapshot() {
+    char temporary[strlen(statsPath) + 5];
+    int fd;
+
+    sprintf(temporary, "%s.tmp", statsPath);
+    if ((fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+            0644)) < 0) {
+        return;
+    }
+    if (write_counters(fd) == 0) {
+        close(fd);
+        rename(temporary, statsPath);
+    } else {
+        close(fd);
+        unlink(temporary);
+    }
+}
+
+/******************************************************************************
+* Function Name  : dump_requested(int fd, uint32_t events, void* data)
+* Description    : Reactor handler for the SIGUSR1 signalfd, dump the
+*                  counters to stderr
+* Input          : int fd;
+*                  uint32_t events;
+*                  void* data;
+* Return         : None
+******************************************************************************/
+void dump_requested(int fd, uint32_t events, void* data) {
+    struct signalfd_siginfo info;
+
+    while (read(fd, &info, sizeof(info)) == sizeof(info)) {
+        write_counters(STDERR_FILENO);
+    }
+}
+
+/******************************************************************************
+* Function Name  : snapshot_due(int fd, uint32_t events, void* data)
+* Description    : Reactor handler for the -stats timer
+* Input          : int fd;
+*                  uint32_t events;
+*                  void* data;
+* Return         : None
+******************************************************************************/
+void snapshot_due(int fd, uint32_t events, void* data) {
+    uint64_t count;
+
+    if (read(fd, &count, sizeof(count)) == sizeof(count)) {
+        write_snapshot();
+    }
+}
+
+/******************************************************************************
+* Function Name  : counters_init()
+* Description    : Take SIGUSR1 through a signalfd watched by the reactor,
+*                  and start the -stats timer. Children are spawned with
+*                  the signal unblocked again
+* Input          : None
+* Return         : None
+******************************************************************************/
+void counters_init() {
+    struct itimerspec spec;
+    sigset_t mask;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    dumpSignal = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    reactor_add(&reactor, dumpSignal, EPOLLIN, dump_requested, NULL);
+
+    if (statsPath == NULL) {
+        return;
+    }
+    statsTimer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = statsInterval / 1000;
+    spec.it_value.tv_nsec = statsInterval % 1000 * NS_PER_MS;
+    spec.it_interval = spec.it_value;
+    timerfd_settime(statsTimer, 0, &spec, NULL);
+    reactor_add(&reactor, statsTimer, EPOLLIN, snapshot_due, NULL);
+}
+
+/******************************************************************************
+* Function Name  : client_input(Client* client)
+* Description    : Pick the reader a client's lines arrive on
+* Input          : Client* client;
+* Return         : The ring reader for a child talking through shared
+*                  memory, the pipe reader otherwise
+******************************************************************************/
+LineReader* client_input(Client* client) {
+    return client->linkState == LINK_RING ?
+            &client->ringReader : &client->reader;
+}
+
+/******************************************************************************
+* Function Name  : bare_message(const Message* message)
+* Description    : Check that a message is its command alone, as "DONE:"
+* Input          : const Message* message;
+* Return         : 1 if nothing follows the only colon, 0 otherwise
+******************************************************************************/
+int bare_message(const Message* message) {
+    return message->colons == 1 && message->field1 == message->end;
+}
+
+/******************************************************************************
+* Function Name  : release_input(Client* client)
+* Description    : Start reading a client's held input again once half of
+*                  what made it stop has been handled
+* Input          : Client* client;
+* Return         : None
+******************************************************************************/
+void release_input(Client* client) {
+    int hold = client->hold;
+
+    if (input_waiting(hold == HOLD_RING ? &client->ringReader
+            : &client->reader, 2)) {
+        return;
+    }
+    client->hold = HOLD_NONE;
+    if (hold == HOLD_PIPE) {
+        reactor_modify(&reactor, client->reader.fd, EPOLLIN);
+    } else if (hold == HOLD_HUNG_UP) {
+        reactor_add(&reactor, client->reader.fd, EPOLLIN, client_readable,
+                (void*)(intptr_t)client->id);
+    } else if (hold == HOLD_RING && read_ring(client)) {
+        // it may be waiting for the room just made
+        wake_child(client);
+    }
+}
+
+/******************************************************************************
+* Function Name  : take_message(Client* client, LineReader* input,
+*                  Message* message)
+* Description    : Take the next whole message a client has sent on one of
+*                  its readers, a frame from a child that asked for them or
+*                  else a line split in place. It is counted and added to
+*                  the -record trace, a frame spelled out as its line. A
+*                  "BIN:" offer is left out, a replayed child talks in lines
+* Input          : Client* client;
+*                  LineReader* input;
+*                  Message* message; valid until the reader's next fill
+* Return         : 1 if a message was taken, 0 if none is ready
+******************************************************************************/
+int take_message(Client* client, LineReader* input, Message* message) {
+    char* line;
+    int length;
+
+    // before the message is taken, reading the ring moves the buffer
+    if (client->hold != HOLD_NONE) {
+        release_input(client);
+    }
+    if (input->binary) {
+        if (!frame_next(input, message)) {
+            return 0;
+        }
+        length = message_line(message, NULL);
+        if (!recording) {
+            // what record_line counts, without spelling the line out
+            client->counters.bytesIn += length + 1;
+            return 1;
+        }
+        if (length + 1 > client->reader.frameLineCapacity) {
+            client->reader.frameLineCapacity = length + 1;
+            client->reader.frameLine = (char*)realloc(
+                    client->reader.frameLine, length + 1);
+        }
+        message_line(message, client->reader.frameLine);
+        record_line(client, TRACE_FROM_CHILD, client->reader.frameLine,
+                length);
+        return 1;
+    }
+    if ((line = line_reader_next(input, &length)) == NULL) {
+        return 0;
+    }
+    if (!binaryMode || client->binary || client->clientName != NULL
+            || length != 4 || memcmp(line, "BIN:", 4) != 0) {
+        record_line(client, TRACE_FROM_CHILD, line, length);
+    }
+    split_message(line, length, message);
+    return 1;
+}
+
+/******************************************************************************
+* Function Name  : await_message(Client* client, Message* message)
+* Description    : Run the event loop until the client has a message ready,
+*                  every other child is served while waiting
+* Input          : Client* client;
+*                  Message* message; valid until the reader's next fill
+* Return         : 1 for a message, 0 once the client has gone, -1 if the
+*                  turn's deadline passed first
+******************************************************************************/
+int await_message(Client* client, Message* message) {
+    while (!take_message(client, client_input(client), message)) {
+        if (client_input(client)->eof) {
+            record_line(client, TRACE_GONE, "", 0);
+            return 0;
+        }
+        if (turnTimer.passed) {
+            return -1;
+        }
+        flush_pending();
+        reactor_run_once(&reactor, -1);
+    }
+    return 1;
+}
+
+void retire_client(Client* client);
+
+/******************************************************************************
+* Function Name  : leave_lane(Client* client)
+* Description    : Tell a swarm child one of its lanes has left, with an
+*                  empty line for the lane standing for its pipe closing.
+*                  The child is closed with its last lane
+* Input          : Client* client;
+* Return         : None
+******************************************************************************/
+void leave_lane(Client* client) {
+    Client* host = &registry.slots[client->host];
+    Frame* frame = lane_frame(client->lane, "\n", 1);
+
+    queue_frame(host, frame);
+    frame_release(frame);
+    host->lanes[client->lane] = -1;
+    if (--host->lanesLive == 0) {
+        retire_client(host);
+    }
+}
+
+/******************************************************************************
+* Function Name  : retire_client(Client* client)
+* Description    : Close a client that has left the chat, output already
+*                  queued for it (such as KICK:) is still delivered
+* Input          : Client* client;
+* Return         : None
+******************************************************************************/
+void retire_client(Client* client) {
+    // broadcasts staged while it was in the chat are still its to read
+    stage_commit();
+    client->departed = 1;
+    close_read_side(client);
+    if (client->host >= 0) {
+        leave_lane(client);
+    }
+    if (client->queueCount == 0) {
+        close_write_side(client);
+    }
+}
+
+/******************************************************************************
+* Function Name  : remove_client(Client* client) 
+* Description    : Take a client out of the chat. Broadcasts it was sent
+*                  while in the chat still reach it
+* Input          : Client* client;
+* Return         : None
+******************************************************************************/
+void remove_client(Client* client) {
+    record_latency(client);
+    stage_commit();
+    registry_unlink(&registry, client);
+    retire_client(client);
+}
+
+/******************************************************************************
+* Function Name  : args_error()
+* Description    : Report client usage error with error message
+*                  "Usage: server [-tee] [-shm] [-concurrent]
+*                  [-record trace] [-rounds n] [-stats file]
+*                  [-interval ms] [-control fifo] [-watch] [-log file]
+*                  [-logsize bytes] [-relays k] [-binary] configfile" with
+*                  exit code 1
+* Input          : None
+* Return         : None
+******************************************************************************/
+void args_error() {
+    fprintf(stderr, "Usage: server [-tee] [-shm] [-concurrent] "
+            "[-record trace] [-rounds n] [-stats file] [-interval ms] "
+            "[-control fifo] [-watch] [-log file] [-logsize bytes] "
+            "[-relays k] [-binary] configfile\n");
+    exit(1);
+}
+
+/******************************************************************************
+* Function Name  : arg_checking(int argc, char** argv)
+* Description    : Check if the arguments input in command line is correct
+*                  and set the options given before the config file.
+*                  Relays cannot be used with -tee or -shm, they write
+*                  the children's pipes themselves. Neither can tee or
+*                  relays share broadcasts with -binary children
+* Input          : int argc;
+*                  char** argv;
+* Return         : The config file path
+******************************************************************************/
+char* arg_checking(int argc, char** argv) {
+    FILE* fp;
+    int i = 1;
+    char rest;
+
+    for (; i < argc - 1 && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "-tee") == 0) {
+            teeMode = 1;
+        } else if (strcmp(argv[i], "-shm") == 0) {
+            shmMode = 1;
+        } else if (strcmp(argv[i], "-concurrent") == 0) {
+            concurrentMode = 1;
+        } else if (strcmp(argv[i], "-record") == 0 && i + 1 < argc - 1) {
+            if (trace_open(&trace, argv[++i]) < 0) {
+                args_error();
+            }
+            recording = 1;
+        } else if (strcmp(argv[i], "-rounds") == 0 && i + 1 < argc - 1
+                && sscanf(argv[i + 1], "%d%c", &maxRounds, &rest) == 1
+                && maxRounds > 0) {
+            i++;
+        } else if (strcmp(argv[i], "-stats") == 0 && i + 1 < argc - 1) {
+            statsPath = argv[++i];
+        } else if (strcmp(argv[i], "-interval") == 0 && i + 1 < argc - 1
+                && sscanf(argv[i + 1], "%d%c", &statsInterval, &rest) == 1
+                && statsInterval > 0) {
+            i++;
+        } else if (strcmp(argv[i], "-control") == 0 && i + 1 < argc - 1) {
+            joining.controlPath = argv[++i];
+        } else if (strcmp(argv[i], "-watch") == 0) {
+            joining.watchMode = 1;
+        } else if (strcmp(argv[i], "-log") == 0 && i + 1 < argc - 1) {
+            logPath = argv[++i];
+        } else if (strcmp(argv[i], "-logsize") == 0 && i + 1 < argc - 1
+                && sscanf(argv[i + 1], "%ld%c", &logSize, &rest) == 1
+                && logSize > 0) {
+            i++;
+        } else if (strcmp(argv[i], "-relays") == 0 && i + 1 < argc - 1
+                && sscanf(argv[i + 1], "%d%c", &relays.count, &rest) == 1
+                && relays.count > 0) {
+            i++;
+        } else if (strcmp(argv[i], "-binary") == 0) {
+            binaryMode = 1;
+        } else {
+            args_error();
+        }
+    }
+    if (relays.count > 0 && (teeMode || shmMode)) {
+        args_error();
+    }
+    if (binaryMode && (teeMode || relays.count > 0)) {
+        args_error();
+    }
+    if (i != argc - 1 || (fp = fopen(argv[i], "r")) == NULL) {
+        args_error();
+    }
+    fclose(fp);
+    return argv[i];
+}
+
+/******************************************************************************
+* Function Name  : parse_limits(char* fileToRun, int* turnLimit,
+*                  int* roundLimit, int* lanes)
+* Description    : Strip the "turn=MS", "round=MS" and "swarm=K" tokens
+*                  that may follow the file of a config entry, setting the
+*                  limits and lanes they give. The turn timer is created
+*                  for the first limit
+* Input          : char* fileToRun;
+*                  int* turnLimit;
+*                  int* roundLimit;
+*                  int* lanes;
+* Return         : None
+******************************************************************************/
+void parse_limits(char* fileToRun, int* turnLimit, int* roundLimit,
+        int* lanes) {
+    char* space;
+    char rest;
+    int value;
+
+    while ((space = strrchr(fileToRun, ' ')) != NULL) {
+        if (sscanf(space + 1, "turn=%d%c", &value, &rest) == 1
+                && value > 0) {
+            *turnLimit = value;
+        } else if (sscanf(space + 1, "round=%d%c", &value, &rest) == 1
+                && value > 0) {
+            *roundLimit = value;
+        } else if (sscanf(space + 1, "swarm=%d%c", &value, &rest) == 1
+                && value > 0) {
+            *lanes = value;
+        } else {
+            break;
+        }
+        while (space > fileToRun && space[-1] == ' ') {
+            space--;
+        }
+        *space = '\0';
+    }
+    if (*turnLimit > 0 || *roundLimit > 0) {
+        turn_timer_create(&turnTimer);
+    }
+}
+
+/******************************************************************************
+* Function Name  : add_swarm_host(int id)
+* Description    : Start sending broadcasts to a swarm child
+* Input          : int id; the child's slot
+* Return         : None
+******************************************************************************/
+void add_swarm_host(int id) {
+    if (swarmHostCount == swarmHostCapacity) {
+        swarmHostCapacity = swarmHostCapacity == 0 ?
+                16 : swarmHostCapacity * 2;
+        swarmHosts = (int*)realloc(swarmHosts,
+                sizeof(int) * swarmHostCapacity);
+    }
+    swarmHosts[swarmHostCount++] = id;
+}
+
+/******************************************************************************
+* Function Name  : add_joiner(Client* client)
+* Description    : Keep a client started while the chat runs out of the
+*                  turn order until it has a name
+* Input          : Client* client;
+* Return         : None
+******************************************************************************/
+void add_joiner(Client* client) {
+    registry_unlink(&registry, client);
+    client->joining = 1;
+    joining_add(&joining, client->id);
+}
+
+/******************************************************************************
+* Function Name  : add_swarm(char* run, char* fileToRun, int lanes,
+*                  int turnLimit, int roundLimit, int joining)
+* Description    : Add a swarm child, one process holding lanes logical
+*                  clients. Each lane is a client of the chat, with its
+*                  own name and turns, whose lines are carried over the
+*                  child's pipes with "lane|" in front, and each gets the
+*                  entry's limits. The child itself is kept out of the
+*                  turn order. A joining swarm's lanes wait to be let in
+*                  one by one, and the child is sent broadcasts from the
+*                  first
+* Input          : char* run;
+*                  char* fileToRun;
+*                  int lanes;
+*                  int turnLimit;
+*                  int roundLimit;
+*                  int joining;
+* Return         : The child's slot
+******************************************************************************/
+int add_swarm(char* run, char* fileToRun, int lanes, int turnLimit,
+        int roundLimit, int joining) {
+    Client* host = registry_add(&registry, run, fileToRun);
+    int hostId = host->id;
+
+    registry_unlink(&registry, host);
+    host->lanes = (int*)malloc(sizeof(int) * lanes);
+    host->laneCount = lanes;
+    host->lanesLive = lanes;
+    host->joining = joining;
+    if (!joining) {
+        add_swarm_host(hostId);
+    }
+
+    for (int i = 0; i < lanes; i++) {
+        // the slots may move as lanes are added
+        Client* lane = registry_add(&registry, run, fileToRun);
+        lane->host = hostId;
+        lane->lane = i;
+        lane->turnLimit = turnLimit;
+        lane->roundLimit = roundLimit;
+        line_reader_init(&lane->reader, -1);
+        registry.slots[hostId].lanes[i] = lane->id;
+        if (joining) {
+            add_joiner(lane);
+        }
+    }
+    return hostId;
+}
+
+/******************************************************************************
+* Function Name  : collect_information(char* buffer, int joining)
+* Description    : Split the message store in buffer, get the information of
+*                  run and fileToRun, with any turn and round limits or
+*                  swarm size after it, and add the client (or the swarm
+*                  and its lanes) to the registry. Clients joining the
+*                  running chat are kept out of the turn order
+* Input          : char* buffer;
+*                  int joining;
+* Return         : The slot of the client or swarm child to spawn, -1 if
+*                  the line is no entry
+******************************************************************************/
+int collect_information(char* buffer, int joining) {
+    char* run = (char*)malloc(sizeof(char) * (strlen(buffer) + 1));
+    char* fileToRun = (char*)malloc(sizeof(char) * (strlen(buffer) + 1));
+    int id = -1;
+    memset(run, '\0', strlen(buffer) + 1);
+    memset(fileToRun, '\0', strlen(buffer) + 1);
+
+    if (check_contain_colon(buffer)) {
+        int turnLimit = 0;
+        int roundLimit = 0;
+        int lanes = 0;
+        sscanf(buffer, "%[^:]:%[^\n]", run, fileToRun);
+        parse_limits(fileToRun, &turnLimit, &roundLimit, &lanes);
+        if (lanes == 0) {
+            Client* client = registry_add(&registry, run, fileToRun);
+            client->turnLimit = turnLimit;
+            client->roundLimit = roundLimit;
+            id = client->id;
+            if (joining) {
+                add_joiner(client);
+            }
+        } else {
+            id = add_swarm(run, fileToRun, lanes, turnLimit, roundLimit,
+                    joining);
+        }
+    }
+    free(run);
+    free(fileToRun);
+    return id;
+}
+
+/******************************************************************************
+* Function Name  : read_file(char* filePath)
+* Description    : Read the execute file ignore lines with "#"
+*                  or with no colon in the line, according to
+*                  the number of valid line add clients to
+*                  the registry. The lines read are counted for -watch
+* Input          : char* filePath;
+* Return         : None
+******************************************************************************/
+void read_file(char* filePath) {
+    char* buffer;
+    int validLine = 0;
+    LineReader config;
+
+    line_reader_init(&config, open(filePath, O_RDONLY));
+    while ((buffer = read_line(&config)) != NULL) {
+        joining.configLines++;
+        if (strncmp(buffer, "#", 1) != 0) {
+            collect_information(buffer, 0);
+            validLine++;
+        }
+    }
+    close(config.fd);
+    free(config.buffer);
+    // swarm children leave gaps in the order
+    registry_compact(&registry);
+    
+    // clients may still join an empty chat
+    if (validLine == 0 && !joining_enabled(&joining)) {
+        exit(0);
+    }
+}
+
+/******************************************************************************
+* Function Name  : raise_fd(int fd)
+* Description    : Move a close-on-exec descriptor to LINK_FD_BASE or above
+*                  so a child's dup2 onto the LINK_*_FD numbers cannot
+*                  clobber another of its descriptors
+* Input          : int fd;
+* Return         : The new descriptor
+******************************************************************************/
+int raise_fd(int fd) {
+    int high = fcntl(fd, F_DUPFD_CLOEXEC, LINK_FD_BASE);
+    close(fd);
+    return high;
+}
+
+/******************************************************************************
+* Function Name  : link_create(Client* client,
+*                  posix_spawn_file_actions_t* actions)
+* Description    : Give a client a shared memory link, a memfd holding both
+*                  rings and an eventfd each way, and have the child find
+*                  them on LINK_MEM_FD, LINK_WAKE_FD and LINK_NOTIFY_FD
+* Input          : Client* client;
+*                  posix_spawn_file_actions_t* actions;
+* Return         : The memfd, to be closed once the child is spawned, or
+*                  -1 if the child only gets its pipes
+******************************************************************************/
+int link_create(Client* client, posix_spawn_file_actions_t* actions) {
+    int memFd = memfd_create("chat", MFD_CLOEXEC);
+    void* link;
+
+    if (memFd < 0 || ftruncate(memFd, sizeof(SharedLink)) < 0
+            || (link = mmap(NULL, sizeof(SharedLink),
+            PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0)) == MAP_FAILED) {
+        // the child just talks over its pipes
+        if (memFd >= 0) {
+            close(memFd);
+        }
+        return -1;
+    }
+    client->link = (SharedLink*)link;
+    memFd = raise_fd(memFd);
+    client->wakeFd = raise_fd(eventfd(0, EFD_CLOEXEC));
+    client->notifyFd = raise_fd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+
+    posix_spawn_file_actions_adddup2(actions, memFd, LINK_MEM_FD);
+    posix_spawn_file_actions_adddup2(actions, client->wakeFd, LINK_WAKE_FD);
+    posix_spawn_file_actions_adddup2(actions, client->notifyFd,
+            LINK_NOTIFY_FD);
+    client->linkState = LINK_UNKNOWN;
+    line_reader_init(&client->ringReader, -1);
+    client->ringReader.ring = &client->link->toServer;
+    return memFd;
+}
+
+/******************************************************************************
+* Function Name  : child_environment(int flags)
+* Description    : Build an environment for children, the server's own
+*                  less any SHM_ENV or BINARY_ENV it was started with, so
+*                  they reach only its own children and only as asked.
+*                  With ENV_LINK SHM_ENV names the link's descriptors,
+*                  with ENV_BINARY BINARY_ENV is set
+* Input          : int flags; ENV_LINK and ENV_BINARY
+* Return         : The new environment, NULL terminated
+******************************************************************************/
+char** child_environment(int flags) {
+    static char linkEntry[64];
+    int shmLength = strlen(SHM_ENV);
+    int binaryLength = strlen(BINARY_ENV);
+    int count = 0;
+    char** envp;
+
+    while (environ[count] != NULL) {
+        count++;
+    }
+    envp = (char**)malloc(sizeof(char*) * (count + 3));
+    count = 0;
+    for (char** entry = environ; *entry != NULL; entry++) {
+        if ((strncmp(*entry, SHM_ENV, shmLength) == 0
+                && (*entry)[shmLength] == '=')
+                || (strncmp(*entry, BINARY_ENV, binaryLength) == 0
+                && (*entry)[binaryLength] == '=')) {
+            continue;
+        }
+        envp[count++] = *entry;
+    }
+    if (flags & ENV_LINK) {
+        snprintf(linkEntry, sizeof(linkEntry), "%s=%d,%d,%d", SHM_ENV,
+                LINK_MEM_FD, LINK_WAKE_FD, LINK_NOTIFY_FD);
+        envp[count++] = linkEntry;
+    }
+    if (flags & ENV_BINARY) {
+        envp[count++] = BINARY_ENV "=1";
+    }
+    envp[count] = NULL;
+    return envp;
+}
+
+/******************************************************************************
+* Function Name  : relay_line(char* line, int length)
+* Description    : Carry out one line from the server in a relay process.
+*                  "+" takes the pipe of a new child, numbered in the order
+*                  they come, "n|line" queues line for child n, "*|line"
+*                  for every child, and "n|" closes child n's pipe once
+*                  its queue is written. Every child comes before any
+*                  pipe is closed, so the numbers are the relay's slots
+* Input          : char* line;
+*                  int length;
+* Return         : None
+******************************************************************************/
+void relay_line(char* line, int length) {
+    char* text = memchr(line, '|', length);
+    Client* child;
+    Frame* frame;
+    int index;
+
+    if (length == 1 && line[0] == '+') {
+        child = registry_add(&registry, "", "");
+        child->writeFd = receive_fd(relays.fds);
+        if (child->writeFd >= 0) {
+            set_nonblocking(child->writeFd);
+            reactor_add(&reactor, child->writeFd, 0, client_writable,
+                    (void*)(intptr_t)child->id);
+        }
+        return;
+    }
+    if (text == NULL) {
+        return;
+    }
+    text++;
+    length -= text - line;
+    frame = frame_create(length + 1);
+    memcpy(frame->data, text, length);
+    frame->data[length] = '\n';
+    if (line[0] == '*') {
+        for (int id = 0; id < registry.slotCount; id++) {
+            queue_frame(&registry.slots[id], frame);
+        }
+    } else if ((index = atoi(line)) >= 0 && index < registry.slotCount) {
+        child = &registry.slots[index];
+        if (length > 0) {
+            queue_frame(child, frame);
+        } else if (child->inUse && !child->departed) {
+            child->departed = 1;
+            if (child->queueCount == 0) {
+                close_write_side(child);
+            }
+        }
+    }
+    frame_release(frame);
+}
+
+/******************************************************************************
+* Function Name  : relay_readable(int fd, uint32_t events, void* data)
+* Description    : Reactor handler for a relay process's socket from the
+*                  server, carry out every whole line and write them out
+* Input          : int fd;
+*                  uint32_t events;
+*                  void* data;
+* Return         : None
+******************************************************************************/
+void relay_readable(int fd, uint32_t events, void* data) {
+    char* line;
+    int length;
+    int count;
+
+    do {
+        count = line_reader_fill(&relays.input);
+        while ((line = line_reader_next(&relays.input, &length)) != NULL) {
+            relay_line(line, length);
+        }
+    } while (count > 0);
+    if (count == 0) {
+        reactor_remove(&reactor, fd);
+    }
+    flush_pending();
+}
+
+/******************************************************************************
+* Function Name  : relay_main(int input, int fds)
+* Description    : Run a relay process, forked from the server before any
+*                  child or thread was started. It drops what it inherited
+*                  and writes the lines the server sends to the children
+*                  whose pipes it is handed, until the server closes the
+*                  socket and everything is written
+* Input          : int input; the socket lines arrive on
+*                  int fds; the socket the pipes arrive on
+* Return         : None, the process exits
+******************************************************************************/
+void relay_main(int input, int fds) {
+    int devNullFd;
+
+    // nothing but the sockets is kept, and the chat log is not its own
+    close_range(3, (input < fds ? input : fds) - 1, 0);
+    close_range((input < fds ? input : fds) + 1,
+            (input < fds ? fds : input) - 1, 0);
+    close_range((input < fds ? fds : input) + 1, ~0U, 0);
+    devNullFd = open("/dev/null", O_RDWR);
+    dup2(devNullFd, 0);
+    dup2(devNullFd, 1);
+    close(devNullFd);
+    signal(SIGPIPE, SIG_IGN);
+
+    registry_init(&registry);
+    reactor_init(&reactor);
+    pendingCount = 0;
+    queuedClients = 0;
+    recording = 0;
+    relays_init(&relays);
+    relays.fds = fds;
+    line_reader_init(&relays.input, input);
+    set_nonblocking(input);
+    reactor_add(&reactor, input, EPOLLIN, relay_readable, NULL);
+    while (!relays.input.eof || queuedClients > 0) {
+        reactor_run_once(&reactor, -1);
+    }
+    _exit(0);
+}
+
+/******************************************************************************
+* Function Name  : fork_relays()
+* Description    : Fork the -relays processes, each reached through a
+*                  stream socket for lines and one for pipes, and add a
+*                  client standing for each. They are kept out of the turn
+*                  order and are never spawned
+* Input          : None
+* Return         : None
+******************************************************************************/
+void fork_relays() {
+    int lines[2];
+    int fds[2];
+    Client* relay;
+    pid_t pid;
+
+    relays.slots = (int*)malloc(sizeof(int) * relays.count);
+    for (int i = 0; i < relays.count; i++) {
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, lines) < 0
+                || socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds)
+                < 0 || (pid = fork()) < 0) {
+            perror("relay");
+            exit(1);
+        }
+        if (pid == 0) {
+            relay_main(lines[1], fds[1]);
+        }
+        close(lines[1]);
+        close(fds[1]);
+        // a full socket makes the server keep writing the child itself
+        set_nonblocking(fds[0]);
+        relay = registry_add(&registry, "relay", "");
+        registry_unlink(&registry, relay);
+        relay->writeFd = lines[0];
+        relay->relayFd = fds[0];
+        set_nonblocking(relay->writeFd);
+        reactor_add(&reactor, relay->writeFd, 0, client_writable,
+                (void*)(intptr_t)relay->id);
+        relays.slots[i] = relay->id;
+    }
+    registry_compact(&registry);
+}
+
+/******************************************************************************
+* Function Name  : relay_child(Client* client, Client* relay)
+* Description    : Hand the pipe to a child over to a relay, which is then
+*                  sent the child's lines. The pipe is passed before the
+*                  "+" line telling the relay to take it
+* Input          : Client* client;
+*                  Client* relay;
+* Return         : None
+******************************************************************************/
+void relay_child(Client* client, Client* relay) {
+    Frame* frame;
+
+    if (client->writeFd < 0 || relay->writeFd < 0
+            || send_fd(relay->relayFd, client->writeFd) < 0) {
+        return;
+    }
+    reactor_remove(&reactor, client->writeFd);
+    close(client->writeFd);
+    client->writeFd = -1;
+    client->relay = relay->id;
+    client->relayIndex = relay->relayIndex++;
+    frame = frame_create(2);
+    memcpy(frame->data, "+\n", 2);
+    queue_frame(relay, frame);
+    frame_release(frame);
+    // the relay takes the pipes as it reads the lines
+    flush_output(relay);
+}
+
+/******************************************************************************
+* Function Name  : spawn_client(Client* current)
+* Description    : Spawn the child process of a client, pipe between parent
+*                  process and child process, store the non-blocking read
+*                  and write descriptors in the client and watch them with
+*                  the reactor. With -shm the child is offered a shared
+*                  memory link as well. A swarm child is spawned once for
+*                  all its lanes, and only talks over its pipes
+* Input          : Client* current;
+* Return         : None
+******************************************************************************/
+void spawn_client(Client* current) {
+    int fdOne[2]; //send msg to child
+    int fdTwo[2]; //receive msg from child
+    posix_spawn_file_actions_t actions;
+    pid_t pid;
+
+    // close-on-exec, so no child holds another child's pipes open
+    pipe2(fdOne, O_CLOEXEC); /* read from 0 write in 1 */
+    pipe2(fdTwo, O_CLOEXEC);
+
+    // child reads stdin from fdOne, writes stdout to fdTwo
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fdOne[0], 0);
+    posix_spawn_file_actions_adddup2(&actions, fdTwo[1], 1);
+    posix_spawn_file_actions_addopen(&actions, 2, "/dev/null",
+            O_WRONLY, 0);
+    int memFd = shmMode && current->laneCount == 0 ?
+            link_create(current, &actions) : -1;
+    char* childArgv[] = {current->run, current->fileToRun, NULL};
+    if (recording) {
+        char* entry = (char*)malloc(strlen(current->run)
+                + strlen(current->fileToRun) + 2);
+        sprintf(entry, "%s:%s", current->run, current->fileToRun);
+        // a swarm is traced as its lanes, each replays on its own
+        for (int i = 0; i < current->laneCount; i++) {
+            record_line(&registry.slots[current->lanes[i]],
+                    TRACE_CLIENT, entry, strlen(entry));
+        }
+        if (current->laneCount == 0) {
+            record_line(current, TRACE_CLIENT, entry, strlen(entry));
+        }
+        free(entry);
+    }
+    // a swarm child's lanes talk in lines
+    int flags = (current->link != NULL ? ENV_LINK : 0)
+            | (binaryMode && current->laneCount == 0 ? ENV_BINARY : 0);
+    int spawnError = posix_spawnp(&pid, current->run, &actions,
+            &spawnAttributes, childArgv, childEnvironments[flags]);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fdOne[0]);
+    close(fdTwo[1]);
+    if (memFd >= 0) {
+        // the mapping keeps the memory alive
+        close(memFd);
+    }
+    if (current->link != NULL) {
+        reactor_add(&reactor, current->notifyFd, EPOLLIN,
+                client_signalled, (void*)(intptr_t)current->id);
+    }
+
+    // parent send msg to child on fdOne
+    current->writeFd = fdOne[1];
+    set_nonblocking(current->writeFd);
+    reactor_add(&reactor, current->writeFd, 0, client_writable,
+            (void*)(intptr_t)current->id);
+    // parent read msg from child on fdTwo
+    line_reader_init(&current->reader, fdTwo[0]);
+    set_nonblocking(fdTwo[0]);
+    reactor_add(&reactor, fdTwo[0], EPOLLIN, client_readable,
+            (void*)(intptr_t)current->id);
+
+    if (spawnError != 0) {
+        // nothing will answer WHO:, the handshake drops it
+        close_read_side(current);
+        close_write_side(current);
+    }
+}
+
+/******************************************************************************
+* Function Name  : open_socket() 
+* Description    : Set up how children are spawned, then spawn the child of
+*                  each client in the registry. With -relays the children
+*                  are handed to the relays in turn
+* Input          : None
+* Return         : None
+******************************************************************************/
+void open_socket() {
+    sigset_t mask;
+    int spawned = 0;
+
+    struct sigaction sa;
+    sa.sa_handler = SIG_IGN;
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGPIPE, &sa, 0);
+    sigaction(SIGCHLD, &sa, 0);
+    // the server takes SIGUSR1 through a signalfd, children as usual
+    sigemptyset(&mask);
+    posix_spawnattr_init(&spawnAttributes);
+    posix_spawnattr_setsigmask(&spawnAttributes, &mask);
+    posix_spawnattr_setflags(&spawnAttributes, POSIX_SPAWN_SETSIGMASK);
+    for (int flags = 0; flags <= (ENV_BINARY | ENV_LINK); flags++) {
+        childEnvironments[flags] = child_environment(flags);
+    }
+
+    // slots are in config order until a client leaves
+    for (int id = 0; id < registry.slotCount; id++) {
+        if (registry.slots[id].host >= 0 || registry.slots[id].relayFd >= 0) {
+            continue;
+        }
+        spawn_client(&registry.slots[id]);
+        if (relays.count > 0) {
+            relay_child(&registry.slots[id],
+                    &registry.slots[relays.slots[spawned++ % relays.count]]);
+        }
+    }
+}
+
+/******************************************************************************
+* Function Name  : start_joiners()
+* Description    : Spawn the children of the entries that have arrived and
+*                  ask their names. Their answers are taken as they come
+*                  in while the chat goes on
+* Input          : None
+* Return         : None
+******************************************************************************/
+void start_joiners() {
+    int first = joining.joinerCount;
+    int hadTimer = turnTimer.fd >= 0;
+    int id;
+
+    for (int i = 0; i < joining.entryCount; i++) {
+        id = collect_information(joining.entries[i], 1);
+        if (id >= 0) {
+            spawn_client(&registry.slots[id]);
+        }
+    }
+    joining_clear_entries(&joining);
+    if (!hadTimer && turnTimer.fd >= 0) {
+        reactor_add(&reactor, turnTimer.fd, EPOLLIN, turn_timer_expired,
+                &turnTimer);
+    }
+    for (int i = first; i < joining.joinerCount; i++) {
+        send_to_client(&registry.slots[joining.joiners[i]], "WHO:\n");
+    }
+}
+
+/******************************************************************************
+* Function Name  : check_name_taken(char* name)
+* Description    : Check if the name sent by client has taken,
+*                  if it has taken then return nameTaken = 1,
+*                  if not return 0
+* Input          : char* name;
+* Return         : nameTaken;
+******************************************************************************/
+int check_name_taken(char* name) {
+    int nameTaken = registry_find(&registry, name) != NULL;
+    return nameTaken;
+}
+
+/******************************************************************************
+* Function Name  : answer_binary(Client* client)
+* Description    : Agree to a child's "BIN:", which it sends before its
+*                  name. What it sends after is read as frames, and the
+*                  server's "BIN:" answer is the last line it is sent. The
+*                  exchange is left out of the -record trace, a replayed
+*                  child talks in lines
+* Input          : Client* client;
+* Return         : None
+******************************************************************************/
+void answer_binary(Client* client) {
+    Frame* frame = frame_create(5);
+
+    memcpy(frame->data, "BIN:\n", 5);
+    queue_frame(client, frame);
+    frame_release(frame);
+    client->binary = 1;
+    client_input(client)->binary = 1;
+}
+
+/******************************************************************************
+* Function Name  : take_name_reply(Client* current)
+* Description    : Take a client's reply to WHO: if it has arrived, and
+*                  answer NAME_TAKEN: and WHO: again at once if the name
+*                  belongs to a client already in the chat. Those names
+*                  are only ever added to, so the answer is the one the
+*                  client would get waiting for its turn. A NAME_ANY:
+*                  reply is never refused, see accept_name. With -binary a
+*                  "BIN:" in front of the reply is agreed to first
+* Input          : Client* current;
+* Return         : 1 if the client's state changed, 0 if not
+******************************************************************************/
+int take_name_reply(Client* current) {
+    int changed = 0;
+    int taken = 0;
+    Message message;
+
+    if (current->candidate == NULL) {
+        // the first answer decides which transport the child uses
+        if (current->link != NULL && current->linkState != LINK_PIPE) {
+            taken = take_message(current, &current->ringReader, &message);
+            if (taken) {
+                current->linkState = LINK_RING;
+            }
+        }
+        if (!taken && current->linkState != LINK_RING) {
+            taken = take_message(current, &current->reader, &message);
+            if (taken && current->link != NULL) {
+                current->linkState = LINK_PIPE;
+            }
+        }
+        if (!taken && !current->reader.eof) {
+            return 0;
+        }
+        if (taken && binaryMode && !current->binary
+                && message.command == CMD_BIN && bare_message(&message)) {
+            answer_binary(current);
+            // the name follows it
+            take_name_reply(current);
+            return 1;
+        }
+        if (!taken) {
+            record_line(current, TRACE_GONE, "", 0);
+            current->candidate = strdup("");
+            current->anyName = 0;
+            return 1;
+        }
+        //the name is what follows the only colon of the reply
+        current->candidate = strdup(message.colons == 1
+                && *message.head != '\0' ? message.field1 : "");
+        // a name is written into lines
+        line_clean(current->candidate, strlen(current->candidate));
+        current->anyName = message.command == CMD_NAME_ANY;
+        changed = 1;
+    }
+    // check if name has taken
+    if (strlen(current->candidate) > 0 && !current->anyName
+            && check_name_taken(current->candidate)) {
+        send_to_client(current, "NAME_TAKEN:\n");
+        send_to_client(current, "WHO:\n");
+        free(current->candidate);
+        current->candidate = NULL;
+        changed = 1;
+    }
+    return changed;
+}
+
+/******************************************************************************
+* Function Name  : accept_name(Client* current)
+* Description    : Let a client with a free name into the chat. A client
+*                  that answered NAME_ANY: is given a free name made from
+*                  it, and told with NAME_ASSIGNED: if it is not the one
+*                  it asked for
+* Input          : Client* current;
+* Return         : None
+******************************************************************************/
+void accept_name(Client* current) {
+    char* name = current->candidate;
+
+    if (current->anyName) {
+        name = registry_free_name(&registry, current->candidate);
+        if (strcmp(name, current->candidate) != 0) {
+            char line[strlen(name) + 16];
+            sprintf(line, "NAME_ASSIGNED:%s\n", name);
+            send_to_client(current, line);
+        }
+        free(current->candidate);
+    }
+    current->candidate = NULL;
+    registry_name(&registry, current, name);
+    current->counters.broadcastBase = broadcastBytes;
+    chat_log_printf(&chatLog, "(%s has entered the chat)\n",
+            current->clientName);
+}
+
+/******************************************************************************
+* Function Name  : collect_client_name()
+* Description    : Ask every client name at once by sending "WHO:" and
+*                  check the names sent back from clients whether 
+*                  have taken or not as they arrive. Names are accepted
+*                  strictly in config order, so the chat sees the same
+*                  names and order as asking one client at a time
+* Input          : None
+* Return         : None
+******************************************************************************/
+void collect_client_name() {
+    Client* current;
+    int head = 0; // turn position of the first client without a name
+    int changed;
+
+    // ask client name by sending WHO:
+    for (int i = 0; i < registry.orderCount; i++) {
+        send_to_client(&registry.slots[registry.order[i]], "WHO:\n");
+    }
+
+    while (head < registry.orderCount) {
+        changed = 0;
+        for (int i = head; i < registry.orderCount; i++) {
+            if (registry.order[i] < 0) {
+                continue;
+            }
+            current = &registry.slots[registry.order[i]];
+            changed |= take_name_reply(current);
+            //handle command like cat, ls
+            if (current->candidate != NULL
+                    && strlen(current->candidate) == 0) {
+                remove_client(current);
+            }
+        }
+        //store names in order, a name taken by the one stored just
+        //before is refused on the next pass
+        while (head < registry.orderCount) {
+            if (registry.order[head] < 0) {
+                head++;
+                continue;
+            }
+            current = &registry.slots[registry.order[head]];
+            if (current->candidate == NULL || strlen(current->candidate) == 0
+                    || (!current->anyName
+                    && check_name_taken(current->candidate))) {
+                break;
+            }
+            accept_name(current);
+            head++;
+            changed = 1;
+        }
+        if (!changed) {
+            flush_pending();
+            reactor_run_once(&reactor, -1);
+        }
+    }
+}
+
+/******************************************************************************
+* Function Name  : admit_joiners()
+* Description    : Let the clients that have joined with a free name into
+*                  the chat, at the end of the turn order in the order they
+*                  were started. Clients that sent no name leave
+* Input          : None
+* Return         : None
+******************************************************************************/
+void admit_joiners() {
+    Client* current;
+    int kept = 0;
+
+    for (int i = 0; i < joining.joinerCount; i++) {
+        current = &registry.slots[joining.joiners[i]];
+        //the name may have been taken since it was checked
+        take_name_reply(current);
+        if (current->candidate == NULL) {
+            joining.joiners[kept++] = joining.joiners[i];
+            continue;
+        }
+        current->joining = 0;
+        //handle command like cat, ls
+        if (strlen(current->candidate) == 0) {
+            remove_client(current);
+            continue;
+        }
+        registry_link(&registry, current);
+        accept_name(current);
+        if (current->host >= 0 && registry.slots[current->host].joining) {
+            registry.slots[current->host].joining = 0;
+            add_swarm_host(current->host);
+        }
+    }
+    joining.joinerCount = kept;
+}
+
+/******************************************************************************
+* Function Name  : kick_notification(char* kickName)
+* Description    : Send the "KICK:" message to the client who is 
+*                  kicked by other client
+* Input          : char* kickName;
+* Return         : The kicked client, NULL if nobody has the name
+******************************************************************************/
+Client* kick_notification(char* kickName) {
+    Client* kicked = registry_find(&registry, kickName);
+
+    if (kicked != NULL) {
+        send_to_client(kicked, "KICK:\n");
+    }
+    return kicked;
+}
+
+/******************************************************************************
+* Function Name  : send_msg_to_clients(char* sender, char* message,
+*                  int length)
+* Description    : Send broadcast message to all clients, the message is
+*                  encoded once and the frame shared by every queue, or
+*                  staged for tee in tee mode. Swarm children get it once
+*                  for all their lanes. Binary children get the message
+*                  bytes unchanged, in a line a newline or NUL in them
+*                  becomes a space
+* Input          : char* sender;
+*                  char* message;
+*                  int length;
+* Return         : None
+******************************************************************************/
+void send_msg_to_clients(char* sender, char* message, int length) {
+    Client* receiver;
+    int senderLength = strlen(sender);
+    Frame* frame = frame_create(senderLength + length + 6);
+    Frame* binary = NULL; //encoded once the first binary child needs it
+    char* line = frame->data;
+
+    memcpy(line, "MSG:", 4);
+    memcpy(line + 4, sender, senderLength);
+    line[senderLength + 4] = ':';
+    memcpy(line + senderLength + 5, message, length);
+    line_clean(line + senderLength + 5, length);
+    line[senderLength + length + 5] = '\n';
+    record_line(NULL, TRACE_BROADCAST, frame->data, frame->length);
+
+    if (teeMode) {
+        stage_frame(frame);
+    } else {
+        for (int i = 0; i < registry.orderCount + swarmHostCount; i++) {
+            if ((receiver = broadcast_receiver(i)) == NULL) {
+                continue;
+            }
+            if (receiver->binary && binary == NULL) {
+                binary = msg_frame(sender, message, length);
+            }
+            queue_frame(receiver, receiver->binary ? binary : frame);
+        }
+    }
+    if (binary != NULL) {
+        frame_release(binary);
+    }
+    if (relays.count > 0) {
+        Frame* relayed = relay_frame(-1, frame->data, frame->length);
+        for (int i = 0; i < relays.count; i++) {
+            queue_frame(&registry.slots[relays.slots[i]], relayed);
+        }
+        frame_release(relayed);
+    }
+    frame_release(frame);
+}
+
+/******************************************************************************
+* Function Name  : miss_turn(Client* current)
+* Description    : A client ran past its deadline. The first miss in a row
+*                  skips the rest of its turn, whatever it sends for that
+*                  turn is dropped when it arrives. The second evicts it
+* Input          : Client* current;
+* Return         : None
+******************************************************************************/
+void miss_turn(Client* current) {
+    current->stats.missed++;
+    if (++current->strikes < 2) {
+        current->lateTurns++;
+        finish_turn(current);
+        return;
+    }
+    chat_log_printf(&chatLog, "(%s has left the chat)\n", current->clientName);
+    remove_client(current);
+}
+
+/******************************************************************************
+* Function Name  : handle_message(Client* current, Message* message)
+* Description    : Take the action asked for by one message of a client's
+*                  turn. The text of a binary child is cleaned in place
+*                  before it goes into the log
+* Input          : Client* current;
+*                  Message* message; NULL once the client has gone
+* Return         : 1 if the message ends the turn, 0 otherwise
+******************************************************************************/
+int handle_message(Client* current, Message* message) {
+    char* text; //what follows the colon, kept only if it is the only one
+    int textLength;
+    Client* kicked; //client going to be kicked
+
+    //remove error client or client executing command like cat, ls
+    if (message == NULL) {
+        chat_log_printf(&chatLog, "(%s has left the chat)\n",
+                current->clientName);
+        remove_client(current);
+        return 1;
+    }
+    text = message->colons == 1 ? message->field1 : "";
+    textLength = message->colons == 1 ? message->end - message->field1 : 0;
+    switch (message->command) {
+    //handle CHAT:
+    case CMD_CHAT:
+        current->counters.chats++;
+        send_msg_to_clients(current->clientName, text, textLength);
+        if (current->binary) {
+            line_clean(text, textLength);
+        }
+        chat_log_printf(&chatLog, "(%s) %s\n", current->clientName, text);
+        return 0;
+    //handle KICK:
+    case CMD_KICK:
+        current->counters.kicks++;
+        if (current->binary) {
+            line_clean(text, textLength);
+        }
+        chat_log_printf(&chatLog, "(%s has left the chat)\n", text);
+        kicked = kick_notification(text);
+        if (kicked != NULL) {
+            remove_client(kicked);
+        }
+        //a client kicking itself has no more turn
+        return kicked == current;
+    //handle DONE:
+    case CMD_DONE:
+        if (bare_message(message)) {
+            current->strikes = 0;
+            return 1;
+        }
+        break;
+    //handle QUIT:
+    case CMD_QUIT:
+        if (bare_message(message)) {
+            current->counters.quits++;
+            chat_log_printf(&chatLog, "(%s has left the chat)\n",
+                    current->clientName);
+            remove_client(current);
+            return 1;
+        }
+        break;
+    }
+    //handle error client
+    chat_log_printf(&chatLog, "(%s has left the chat)\n", current->clientName);
+    remove_client(current);
+    return 1;
+}
+
+/******************************************************************************
+* Function Name  : take_action(Client* current)
+* Description    : Receive messages from clients and take corresponding actions
+* Input          : Client* current;
+* Return         : None
+******************************************************************************/
+void take_action(Client* current){
+    Message message; //receive message send from client
+    int status;
+
+    start_turn(current);
+    while (1) {
+        //wait for the next message, serving the other clients meanwhile
+        status = await_message(current, &message);
+        //deadline passed, skip the turn or evict
+        if (status < 0) {
+            miss_turn(current);
+            break;
+        }
+        //drop what a late client sends for turns it was skipped
+        if (current->lateTurns > 0 && status > 0) {
+            if (message.command == CMD_DONE && bare_message(&message)) {
+                current->lateTurns--;
+            }
+            continue;
+        }
+        if (handle_message(current, status > 0 ? &message : NULL)) {
+            break;
+        }
+    }
+    finish_turn(current);
+}
+
+/******************************************************************************
+* Function Name  : batch_add(Client* client, const Message* message)
+* Description    : Copy a message to the end of a client's batch
+* Input          : Client* client;
+*                  const Message* message; NULL once the client has gone
+* Return         : None
+******************************************************************************/
+void batch_add(Client* client, const Message* message) {
+    BatchEntry entry = {CMD_NONE, -1, 0};
+    int size;
+
+    if (message != NULL) {
+        entry.command = message->command;
+        entry.colons = message->colons;
+        entry.length = message->end - message->field1;
+    }
+    size = sizeof(entry) + entry.length + 1;
+    if (client->batchLength + size > client->batchCapacity) {
+        while (client->batchLength + size > client->batchCapacity) {
+            client->batchCapacity = client->batchCapacity == 0 ?
+                    256 : client->batchCapacity * 2;
+        }
+        client->batch = (char*)realloc(client->batch, client->batchCapacity);
+    }
+    memcpy(client->batch + client->batchLength, &entry, sizeof(entry));
+    if (message != NULL) {
+        memcpy(client->batch + client->batchLength + sizeof(entry),
+                message->field1, entry.length);
+    }
+    client->batch[client->batchLength + sizeof(entry) + entry.length] = '\0';
+    client->batchLength += size;
+}
+
+/******************************************************************************
+* Function Name  : batch_message(Client* client, int offset,
+*                  Message* message)
+* Description    : Read back the message batch_add kept at an offset of a
+*                  client's batch, its colons are -1 if the client had
+*                  gone. There is no head or second field
+* Input          : Client* client;
+*                  int offset;
+*                  Message* message;
+* Return         : The offset of the next message
+******************************************************************************/
+int batch_message(Client* client, int offset, Message* message) {
+    BatchEntry entry;
+
+    memcpy(&entry, client->batch + offset, sizeof(entry));
+    message->command = entry.command;
+    message->colons = entry.colons;
+    message->head = "";
+    message->field1 = client->batch + offset + sizeof(entry);
+    message->second = NULL;
+    message->end = message->field1 + entry.length;
+    return offset + sizeof(entry) + entry.length + 1;
+}
+
+/******************************************************************************
+* Function Name  : gather_turn(Client* current)
+* Description    : Copy the messages a client has sent for its -concurrent
+*                  turn into its batch. The turn is complete at any message
+*                  but CHAT: and KICK:, or when the client has gone
+* Input          : Client* current;
+* Return         : 1 if the turn is now complete, 0 otherwise
+******************************************************************************/
+int gather_turn(Client* current) {
+    LineReader* input = client_input(current);
+    Message message;
+    int taken;
+
+    while ((taken = take_message(current, input, &message)) || input->eof) {
+        if (!taken) {
+            record_line(current, TRACE_GONE, "", 0);
+        } else if (current->lateTurns > 0) {
+            //drop what a late client sends for turns it was skipped
+            if (message.command == CMD_DONE && bare_message(&message)) {
+                current->lateTurns--;
+            }
+            continue;
+        }
+        batch_add(current, taken ? &message : NULL);
+        if (!taken || (message.command != CMD_CHAT
+                && message.command != CMD_KICK)) {
+            current->batchState = BATCH_DONE;
+            add_latency(&current->stats, now_ns() - roundStart);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/******************************************************************************
+* Function Name  : expire_turns(int* open)
+* Description    : Mark the -concurrent turns whose deadline has passed as
+*                  missed and arm the turn timer for the next deadline
+* Input          : int* open; the number of turns still being gathered
+* Return         : None
+******************************************************************************/
+void expire_turns(int* open) {
+    int64_t now = now_ns();
+    int64_t next = 0;
+    Client* current;
+
+    turnTimer.passed = 0;
+    for (int i = 0; i < registry.orderCount; i++) {
+        if (registry.order[i] < 0) {
+            continue;
+        }
+        current = &registry.slots[registry.order[i]];
+        if (current->batchState != BATCH_OPEN || current->deadline == 0) {
+            continue;
+        }
+        if (current->deadline <= now) {
+            current->batchState = BATCH_MISSED;
+            add_latency(&current->stats, now - roundStart);
+            (*open)--;
+        } else if (next == 0 || current->deadline < next) {
+            next = current->deadline;
+        }
+    }
+    turn_timer_set(&turnTimer, next);
+}
+
+/******************************************************************************
+* Function Name  : concurrent_round()
+* Description    : Play a round with -concurrent. "YT:" goes to every client
+*                  at once and their turns are gathered as they come in,
+*                  so the round takes as long as its slowest client. The
+*                  turns are then applied in turn order, a client kicked
+*                  by an earlier one loses its turn unseen
+* Input          : None
+* Return         : None
+******************************************************************************/
+void concurrent_round() {
+    Client* current;
+    int open = 0;
+    Message message;
+
+    gathering = 1;
+    for (int i = 0; i < registry.orderCount; i++) {
+        if (registry.order[i] < 0) {
+            continue;
+        }
+        current = &registry.slots[registry.order[i]];
+        send_to_client(current, "YT:\n");
+        current->stats.turns++;
+        current->batchLength = 0;
+        current->batchState = BATCH_OPEN;
+        current->deadline = turn_deadline(current, roundStart);
+        // it may have sent lines before this round started
+        mark_ready(current);
+        open++;
+    }
+    expire_turns(&open);
+    while (open > 0) {
+        for (int i = 0; i < readyCount; i++) {
+            current = &registry.slots[readyClients[i]];
+            current->ready = 0;
+            if (current->batchState == BATCH_OPEN && gather_turn(current)) {
+                open--;
+            }
+        }
+        readyCount = 0;
+        if (turnTimer.passed) {
+            expire_turns(&open);
+        }
+        if (open > 0) {
+            flush_pending();
+            reactor_run_once(&reactor, -1);
+        }
+    }
+    gathering = 0;
+    turn_timer_set(&turnTimer, 0);
+
+    for (int i = 0; i < registry.orderCount; i++) {
+        if (registry.order[i] < 0) {
+            continue;
+        }
+        current = &registry.slots[registry.order[i]];
+        if (current->batchState == BATCH_MISSED) {
+            miss_turn(current);
+            continue;
+        }
+        for (int offset = 0; offset < current->batchLength; ) {
+            offset = batch_message(current, offset, &message);
+            if (handle_message(current,
+                    message.colons < 0 ? NULL : &message)) {
+                break;
+            }
+        }
+    }
+}
+
+/******************************************************************************
+* Function Name  : end_chat()
+* Description    : Kick every client still in the chat, once -rounds
+*                  rounds have been played. Clients waiting to join are
+*                  closed
+* Input          : None
+* Return         : None
+******************************************************************************/
+void end_chat() {
+    Client* current;
+
+    for (int i = 0; i < joining.joinerCount; i++) {
+        current = &registry.slots[joining.joiners[i]];
+        current->joining = 0;
+        remove_client(current);
+    }
+    joining.joinerCount = 0;
+
+    for (int i = 0; i < registry.orderCount; i++) {
+        if (registry.order[i] < 0) {
+            continue;
+        }
+        current = &registry.slots[registry.order[i]];
+        chat_log_printf(&chatLog, "(%s has left the chat)\n",
+                current->clientName);
+        send_to_client(current, "KICK:\n");
+        remove_client(current);
+    }
+}
+
+/******************************************************************************
+* Function Name  : chating_time()
+* Description    : Send "YT:" to each client in turn order, or to all at
+*                  once with -concurrent, until everyone has left or
+*                  -rounds rounds have been played. Clients that joined
+*                  during a round are let in before the next, and with
+*                  -control or -watch an empty chat waits for them
+* Input          : None
+* Return         : None
+******************************************************************************/
+void chating_time() {
+    Client* current;
+    int rounds = 0;
+
+    //until all client quit
+    while (1) {
+        start_joiners();
+        admit_joiners();
+        if (registry.members == 0) {
+            if (joining.joinerCount == 0 && !joining_enabled(&joining)) {
+                break;
+            }
+            chat_log_flush(&chatLog);
+            flush_pending();
+            reactor_run_once(&reactor, -1);
+            continue;
+        }
+        if (maxRounds > 0 && rounds++ == maxRounds) {
+            end_chat();
+            break;
+        }
+        roundStart = now_ns();
+        if (concurrentMode) {
+            concurrent_round();
+            roundStats.turns++;
+            add_latency(&roundStats, now_ns() - roundStart);
+            registry_compact(&registry);
+            chat_log_flush(&chatLog);
+            continue;
+        }
+        //send "YT:" to each client
+        for (int i = 0; i < registry.orderCount; i++) {
+            if (registry.order[i] < 0) {
+                continue;
+            }
+            current = &registry.slots[registry.order[i]];
+            send_to_client(current, "YT:\n");
+            
+            //take different action according to different response from client
+            take_action(current);
+        }
+        roundStats.turns++;
+        add_latency(&roundStats, now_ns() - roundStart);
+        registry_compact(&registry);
+        chat_log_flush(&chatLog);
+    }
+}
+
+int main(int argc, char** argv) {
+    // argument checking 
+    joining_init(&joining);
+    relays_init(&relays);
+    turn_timer_init(&turnTimer);
+    joining.configPath = arg_checking(argc, argv);
+    
+    // file reading and information collecting
+    registry_init(&registry);
+    read_file(joining.configPath);
+
+    // create multi-progress
+    reactor_init(&reactor);
+    if (turnTimer.fd >= 0) {
+        reactor_add(&reactor, turnTimer.fd, EPOLLIN, turn_timer_expired,
+                &turnTimer);
+    }
+    if (teeMode) {
+        stage_init();
+    }
+    counters_init();
+    // forked before the log's thread is started
+    if (relays.count > 0) {
+        fork_relays();
+    }
+    // started once SIGUSR1 is blocked, so the writer never takes it
+    if (chat_log_open(&chatLog, logPath, logSize) < 0) {
+        perror(logPath);
+        exit(1);
+    }
+    joining_open(&joining, &reactor);
+    open_socket();
+
+    // handshaking
+    collect_client_name();
+    chat_log_flush(&chatLog);
+    chating_time();
+    chat_log_close(&chatLog);
+
+    // let departing clients read what was sent to them (KICK:)
+    flush_pending();
+    while (queuedClients > 0) {
+        reactor_run_once(&reactor, -1);
+    }
+    if (recording) {
+        trace_close(&trace);
+    }
+    if (statsPath != NULL) {
+        write_snapshot();
+    }
+    print_latency_report();
+
+    //valgrind -s --track-origins=yes ./server config.txt
+    return 0;
+}
@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+/* what a generated room looks like */
+typedef struct {
+    int bots; /* clientbots in the room */
+    int swarm; /* bots run by each child, 1 for a child per bot */
+    int stimuli; /* distinct stimuli in each script */
+    int hits; /* percent of the seed messages each script answers */
+    int fanout; /* responses sent for each stimulus found */
+    int messages; /* distinct seed messages */
+    int rounds; /* turns the seed client speaks in */
+    int seed; /* seed of the random choices */
+} Room;
+
+/******************************************************************************
+* Function Name  : args_error()
+* Description    : Report swarmgen usage error with exit code 1
+* Input          : None
+* Return         : None
+******************************************************************************/
+void args_error() {
+    fprintf(stderr, "Usage: swarmgen [-bots n] [-swarm n] [-stimuli n] "
+            "[-hits percent] [-fanout n] [-messages n] [-rounds n] "
+            "[-seed n] dir\n");
+    exit(1);
+}
+
+/******************************************************************************
+* Function Name  : arg_checking(int argc, char** argv, Room* room)
+* Description    : Read the options into room, every value is a whole
+*                  number, -hits at most 100 and all but -hits and -seed
+*                  at least 1
+* Input          : int argc;
+*                  char** argv;
+*                  Room* room;
+* Return         : The directory to write the room to
+******************************************************************************/
+char* arg_checking(int argc, char** argv, Room* room) {
+    char* names[] = {"-bots", "-swarm", "-stimuli", "-hits", "-fanout",
+            "-messages", "-rounds", "-seed"};
+    int* values[] = {&room->bots, &room->swarm, &room->stimuli, &room->hits,
+            &room->fanout, &room->messages, &room->rounds, &room->seed};
+    int i = 1;
+    char rest;
+
+    for (; i < argc - 1 && argv[i][0] == '-'; i += 2) {
+        int option = 0;
+        while (option < 8 && strcmp(argv[i], names[option]) != 0) {
+            option++;
+        }
+        if (option == 8 || sscanf(argv[i + 1], "%d%c", values[option],
+                &rest) != 1) {
+            args_error();
+        }
+        // only -hits and -seed may be 0
+        if (*values[option] < (option == 3 || option == 7 ? 0 : 1)) {
+            args_error();
+        }
+    }
+    if (i != argc - 1 || room->hits > 100) {
+        args_error();
+    }
+    return argv[i];
+}
+
+/******************************************************************************
+* Function Name  : open_output(char* dir, char* name)
+* Description    : Create a file of the room, or give up
+* Input          : char* dir;
+*                  char* name;
+* Return         : The open file
+******************************************************************************/
+FILE* open_output(char* dir, char* name) {
+    char path[strlen(dir) + strlen(name) + 2];
+    FILE* fp;
+
+    sprintf(path, "%s/%s", dir, name);
+    if ((fp = fopen(path, "w")) == NULL) {
+        perror(path);
+        exit(1);
+    }
+    return fp;
+}
+
+/******************************************************************************
+* Function Name  : write_seed(char* dir, Room* room)
+* Description    : Write the script of the client that starts the talk,
+*                  it says one seed message a turn, "m<index>." with the
+*                  dot keeping m1. from matching in m10.
+* Input          : char* dir;
+*                  Room* room;
+* Return         : None
+******************************************************************************/
+void write_seed(char* dir, Room* room) {
+    FILE* fp = open_output(dir, "seed.txt");
+
+    for (int i = 0; i < room->rounds; i++) {
+        fprintf(fp, "CHAT:m%d.\nDONE:\n", i % room->messages);
+    }
+    fclose(fp);
+}
+
+/******************************************************************************
+* Function Name  : write_script(char* dir, Room* room, int child)
+* Description    : Write the script of one child. Each seed message is
+*                  picked as a stimulus with chance -hits, answered by
+*                  -fanout responses, and the script is filled up to
+*                  -stimuli stimuli with ones nobody says. Responses hold
+*                  no stimulus, so the talk never feeds itself
+* Input          : char* dir;
+*                  Room* room;
+*                  int child;
+* Return         : None
+******************************************************************************/
+void write_script(char* dir, Room* room, int child) {
+    char name[32];
+    int count = 0;
+    FILE* fp;
+
+    sprintf(name, "bot%d.txt", child);
+    fp = open_output(dir, name);
+    for (int i = 0; i < room->messages && count < room->stimuli; i++) {
+        if (rand() % 100 >= room->hits) {
+            continue;
+        }
+        for (int j = 0; j < room->fanout; j++) {
+            fprintf(fp, "m%d.:reply %d-%d-%d\n", i, child, i, j);
+        }
+        count++;
+    }
+    for (; count < room->stimuli; count++) {
+        fprintf(fp, "x%d.%d.:never\n", child, count);
+    }
+    fclose(fp);
+}
+
+/******************************************************************************
+* Function Name  : write_room(char* dir, Room* room)
+* Description    : Write the server config, the seed client then a
+*                  clientbot per child, each child run as a swarm when
+*                  it holds more than one bot. Paths are as given, the
+*                  programs are run from the server's directory
+* Input          : char* dir;
+*                  Room* room;
+* Return         : The number of children
+******************************************************************************/
+int write_room(char* dir, Room* room) {
+    FILE* fp = open_output(dir, "room");
+    int children = 0;
+
+    fprintf(fp, "./client:%s/seed.txt\n", dir);
+    for (int left = room->bots; left > 0; left -= room->swarm) {
+        int lanes = left < room->swarm ? left : room->swarm;
+        if (lanes > 1) {
+            fprintf(fp, "./clientbot:%s/bot%d.txt swarm=%d\n", dir,
+                    children, lanes);
+        } else {
+            fprintf(fp, "./clientbot:%s/bot%d.txt\n", dir, children);
+        }
+        write_script(dir, room, children++);
+    }
+    fclose(fp);
+    return children;
+}
+
+int main(int argc, char** argv) {
+    Room room = {100, 1, 16, 10, 1, 16, 20, 1};
+    char* dir = arg_checking(argc, argv, &room);
+    int children;
+
+    if (mkdir(dir, 0777) < 0 && errno != EEXIST) {
+        perror(dir);
+        return 1;
+    }
+    srand(room.seed);
+    write_seed(dir, &room);
+    children = write_room(dir, &room);
+    printf("%s/room: %d bots in %d children\n", dir, room.bots, children);
+    return 0;
+}
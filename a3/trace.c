@@ -0,0 +1,162 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "trace.h"
+#include "varint.h"
+
+/* size of the trace writer's stdio buffer */
+#define TRACE_BUFFER (1024 * 1024)
+
+/*
+ * A trace is TRACE_MAGIC followed by records of three unsigned LEB128
+ * varints and the line itself:
+ *   nanoseconds since the previous record
+ *   client << 3 | kind
+ *   length
+ *   length bytes
+ */
+
+/******************************************************************************
+* Function Name  : read_varint(TraceReader* reader, uint64_t* value)
+* Description    : Decode the varint at the reader's offset
+* Input          : TraceReader* reader;
+*                  uint64_t* value;
+* Return         : 0 on success, -1 if the trace ends inside it
+******************************************************************************/
+static int read_varint(TraceReader* reader, uint64_t* value) {
+    return get_varint(reader->data, reader->length, &reader->offset,
+            value) > 0 ? 0 : -1;
+}
+
+/******************************************************************************
+* Function Name  : trace_open(TraceWriter* writer, const char* path)
+* Description    : Create a trace file and write its magic
+* Input          : TraceWriter* writer;
+*                  const char* path;
+* Return         : 0 on success, -1 if the file could not be created
+******************************************************************************/
+int trace_open(TraceWriter* writer, const char* path) {
+    writer->last = 0;
+    if ((writer->fp = fopen(path, "w")) == NULL) {
+        return -1;
+    }
+    setvbuf(writer->fp, NULL, _IOFBF, TRACE_BUFFER);
+    fwrite(TRACE_MAGIC, 1, strlen(TRACE_MAGIC), writer->fp);
+    return 0;
+}
+
+/******************************************************************************
+* Function Name  : trace_write(TraceWriter* writer, int64_t time,
+*                  int client, int kind, const char* data, int length)
+* Description    : Append a record, times must not go backwards
+* Input          : TraceWriter* writer;
+*                  int64_t time;
+*                  int client;
+*                  int kind;
+*                  const char* data;
+*                  int length;
+* Return         : None
+******************************************************************************/
+void trace_write(TraceWriter* writer, int64_t time, int client, int kind,
+        const char* data, int length) {
+    unsigned char header[3 * VARINT_MAX];
+    int count = 0;
+
+    count += put_varint(header + count, writer->last == 0 ?
+            0 : (uint64_t)(time - writer->last));
+    count += put_varint(header + count, (uint64_t)client << 3 | kind);
+    count += put_varint(header + count, length);
+    fwrite(header, 1, count, writer->fp);
+    fwrite(data, 1, length, writer->fp);
+    writer->last = time;
+}
+
+/******************************************************************************
+* Function Name  : trace_close(TraceWriter* writer)
+* Description    : Flush and close a trace
+* Input          : TraceWriter* writer;
+* Return         : None
+******************************************************************************/
+void trace_close(TraceWriter* writer) {
+    fclose(writer->fp);
+    writer->fp = NULL;
+}
+
+/******************************************************************************
+* Function Name  : trace_map(TraceReader* reader, const char* path)
+* Description    : Map a trace file for reading and check its magic. The
+*                  first record is stamped at time 0
+* Input          : TraceReader* reader;
+*                  const char* path;
+* Return         : 0 on success, -1 if it is not a readable trace
+******************************************************************************/
+int trace_map(TraceReader* reader, const char* path) {
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    void* data;
+
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &info) < 0 || info.st_size < strlen(TRACE_MAGIC)
+            || (data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE,
+            fd, 0)) == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    reader->data = (const unsigned char*)data;
+    reader->length = info.st_size;
+    reader->offset = strlen(TRACE_MAGIC);
+    reader->time = 0;
+    if (memcmp(data, TRACE_MAGIC, strlen(TRACE_MAGIC)) != 0) {
+        trace_unmap(reader);
+        return -1;
+    }
+    return 0;
+}
+
+/******************************************************************************
+* Function Name  : trace_next(TraceReader* reader, TraceRecord* record)
+* Description    : Read the next record, its data points into the mapping
+* Input          : TraceReader* reader;
+*                  TraceRecord* record;
+* Return         : 1 for a record, 0 at the end of the trace, -1 if the
+*                  trace is cut short or corrupt
+******************************************************************************/
+int trace_next(TraceReader* reader, TraceRecord* record) {
+    uint64_t delta;
+    uint64_t tag;
+    uint64_t length;
+
+    if (reader->offset == reader->length) {
+        return 0;
+    }
+    if (read_varint(reader, &delta) < 0 || read_varint(reader, &tag) < 0
+            || read_varint(reader, &length) < 0
+            || length > reader->length - reader->offset) {
+        return -1;
+    }
+    reader->time += delta;
+    record->time = reader->time;
+    record->client = (int)(tag >> 3);
+    record->kind = (int)(tag & 7);
+    record->data = (const char*)reader->data + reader->offset;
+    record->length = (int)length;
+    reader->offset += length;
+    return 1;
+}
+
+/******************************************************************************
+* Function Name  : trace_unmap(TraceReader* reader)
+* Description    : Unmap a trace
+* Input          : TraceReader* reader;
+* Return         : None
+******************************************************************************/
+void trace_unmap(TraceReader* reader) {
+    munmap((void*)reader->data, reader->length);
+    reader->data = NULL;
+}
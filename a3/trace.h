@@ -0,0 +1,53 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* first bytes of a trace file, the digit is the format version */
+#define TRACE_MAGIC "CHATREC1"
+
+/* what a trace record holds */
+#define TRACE_TO_CHILD 0 /* a line sent to one child */
+#define TRACE_FROM_CHILD 1 /* a line taken from a child */
+#define TRACE_CLIENT 2 /* a child started, data is its "run:fileToRun" */
+#define TRACE_BROADCAST 3 /* a MSG: line sent to every client */
+#define TRACE_GONE 4 /* a child's output ended */
+
+/* one record of a trace */
+typedef struct {
+    int64_t time; /* monotonic nanoseconds */
+    int client; /* slot of the child, 0 for broadcasts */
+    int kind; /* one of the TRACE_ kinds */
+    const char* data; /* the line, without its newline, not terminated */
+    int length; /* bytes in data */
+} TraceRecord;
+
+/* a trace being written */
+typedef struct {
+    FILE* fp; /* the trace file */
+    int64_t last; /* time of the previous record */
+} TraceWriter;
+
+/* a trace mapped for reading */
+typedef struct {
+    const unsigned char* data; /* the whole file */
+    size_t length; /* bytes in data */
+    size_t offset; /* start of the next record */
+    int64_t time; /* time of the previous record */
+} TraceReader;
+
+int trace_open(TraceWriter* writer, const char* path);
+
+void trace_write(TraceWriter* writer, int64_t time, int client, int kind,
+        const char* data, int length);
+
+void trace_close(TraceWriter* writer);
+
+int trace_map(TraceReader* reader, const char* path);
+
+int trace_next(TraceReader* reader, TraceRecord* record);
+
+void trace_unmap(TraceReader* reader);
+
+#endif
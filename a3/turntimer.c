@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include "turntimer.h"
+
+/******************************************************************************
+* Function Name  : turn_timer_init(TurnTimer* timer)
+* Description    : Set up with no timerfd and no turn timed
+* Input          : TurnTimer* timer;
+* Return         : None
+******************************************************************************/
+void turn_timer_init(TurnTimer* timer) {
+    timer->fd = -1;
+    timer->client = NULL;
+    timer->start = 0;
+    timer->passed = 0;
+}
+
+/******************************************************************************
+* Function Name  : turn_timer_create(TurnTimer* timer)
+* Description    : Create the timerfd, once some config entry asks for a
+*                  limit
+* Input          : TurnTimer* timer;
+* Return         : None
+******************************************************************************/
+void turn_timer_create(TurnTimer* timer) {
+    if (timer->fd < 0) {
+        timer->fd = timerfd_create(CLOCK_MONOTONIC,
+                TFD_NONBLOCK | TFD_CLOEXEC);
+    }
+}
+
+/******************************************************************************
+* Function Name  : turn_timer_set(TurnTimer* timer, int64_t deadline)
+* Description    : Arm the timer for an absolute monotonic time, or disarm
+*                  it with 0. Without a timerfd nothing is armed
+* Input          : TurnTimer* timer;
+*                  int64_t deadline;
+* Return         : None
+******************************************************************************/
+void turn_timer_set(TurnTimer* timer, int64_t deadline) {
+    struct itimerspec spec;
+
+    if (timer->fd < 0) {
+        return;
+    }
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = deadline / 1000000000LL;
+    spec.it_value.tv_nsec = deadline % 1000000000LL;
+    timerfd_settime(timer->fd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+
+/******************************************************************************
+* Function Name  : turn_timer_start(TurnTimer* timer, Client* client,
+*                  int64_t start, int64_t deadline)
+* Description    : Start timing a client's turn and arm the timer for its
+*                  deadline
+* Input          : TurnTimer* timer;
+*                  Client* client;
+*                  int64_t start;
+*                  int64_t deadline; 0 if the turn has no limit
+* Return         : None
+******************************************************************************/
+void turn_timer_start(TurnTimer* timer, Client* client, int64_t start,
+        int64_t deadline) {
+    timer->client = client;
+    timer->start = start;
+    timer->passed = 0;
+    if (deadline != 0) {
+        turn_timer_set(timer, deadline);
+    }
+}
+
+/******************************************************************************
+* Function Name  : turn_timer_stop(TurnTimer* timer)
+* Description    : Stop timing the current turn and disarm the timer
+* Input          : TurnTimer* timer;
+* Return         : None
+******************************************************************************/
+void turn_timer_stop(TurnTimer* timer) {
+    turn_timer_set(timer, 0);
+    timer->client = NULL;
+}
+
+/******************************************************************************
+* Function Name  : turn_timer_expired(int fd, uint32_t events, void* data)
+* Description    : Reactor handler for the timerfd, the deadline has passed
+* Input          : int fd;
+*                  uint32_t events;
+*                  void* data; the TurnTimer
+* Return         : None
+******************************************************************************/
+void turn_timer_expired(int fd, uint32_t events, void* data) {
+    TurnTimer* timer = (TurnTimer*)data;
+    uint64_t count;
+
+    if (read(fd, &count, sizeof(count)) == sizeof(count)) {
+        timer->passed = 1;
+    }
+}
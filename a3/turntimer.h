@@ -0,0 +1,28 @@
+#ifndef TURNTIMER_H
+#define TURNTIMER_H
+
+#include <stdint.h>
+#include "registry.h"
+
+/* the timer of the current turn, a timerfd firing at its deadline */
+typedef struct {
+    int fd; /* the timerfd, -1 until some config entry asks for a limit */
+    Client* client; /* the client whose turn is timed, NULL between turns */
+    int64_t start; /* when its turn started */
+    int passed; /* the deadline armed has passed */
+} TurnTimer;
+
+void turn_timer_init(TurnTimer* timer);
+
+void turn_timer_create(TurnTimer* timer);
+
+void turn_timer_set(TurnTimer* timer, int64_t deadline);
+
+void turn_timer_start(TurnTimer* timer, Client* client, int64_t start,
+        int64_t deadline);
+
+void turn_timer_stop(TurnTimer* timer);
+
+void turn_timer_expired(int fd, uint32_t events, void* data);
+
+#endif
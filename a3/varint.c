@@ -0,0 +1,67 @@
+#include "varint.h"
+
+/******************************************************************************
+* Function Name  : varint_size(uint64_t value)
+* Description    : Count the bytes the varint of value takes
+* Input          : uint64_t value;
+* Return         : The bytes
+******************************************************************************/
+int varint_size(uint64_t value) {
+    int count = 1;
+
+    while (value >= 0x80) {
+        value >>= 7;
+        count++;
+    }
+    return count;
+}
+
+/******************************************************************************
+* Function Name  : put_varint(unsigned char* out, uint64_t value)
+* Description    : Encode value as a varint
+* Input          : unsigned char* out; room for at least VARINT_MAX bytes
+*                  uint64_t value;
+* Return         : The number of bytes written
+******************************************************************************/
+int put_varint(unsigned char* out, uint64_t value) {
+    int count = 0;
+
+    while (value >= 0x80) {
+        out[count++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    out[count++] = (unsigned char)value;
+    return count;
+}
+
+/******************************************************************************
+* Function Name  : get_varint(const unsigned char* data, size_t length,
+*                  size_t* offset, uint64_t* value)
+* Description    : Decode the varint at offset, moving offset past it
+* Input          : const unsigned char* data;
+*                  size_t length; bytes in data
+*                  size_t* offset;
+*                  uint64_t* value;
+* Return         : 1 if it was read, 0 if it runs past length, -1 if it is
+*                  too long to be one
+******************************************************************************/
+int get_varint(const unsigned char* data, size_t length, size_t* offset,
+        uint64_t* value) {
+    uint64_t result = 0;
+    int shift = 0;
+
+    while (*offset < length) {
+        unsigned char byte = data[(*offset)++];
+
+        if (shift >= 64) {
+            return -1;
+        }
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return 1;
+        }
+        shift += 7;
+    }
+    return 0;
+}
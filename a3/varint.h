@@ -0,0 +1,20 @@
+#ifndef VARINT_H
+#define VARINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* the most bytes a varint of a uint64_t takes */
+#define VARINT_MAX 10
+
+/* unsigned LEB128 varints, 7 bits a byte, low bits first, the top bit set
+ * on every byte but the last. Traces and binary frames both use them */
+
+int varint_size(uint64_t value);
+
+int put_varint(unsigned char* out, uint64_t value);
+
+int get_varint(const unsigned char* data, size_t length, size_t* offset,
+        uint64_t* value);
+
+#endif